@@ -199,13 +199,17 @@ void Environment::pubPlanning() {
 }
 
 void Environment::pubModelHypotheses() {
-  // Temporary Modelling test request
   model_msgs::ModelHypotheses model_hypotheses;
-  // ROS_INFO_STREAM("ENV- NAgents: " << agent_no_);
-  // for (size_t i = 1; i < agent_no_; ++i) { // i = 0 includes Robot Agent
-  //   model_hypotheses.agents.push_back(i);
-  // }
-  if (agent_no_ > 1) {model_hypotheses.agents.push_back(1);}  // Temp fix
+  // Model every tracked agent. Agents are numbered as the environment data
+  // agents of pubEnvironmentData, the untracked robots then the tracked
+  // agents, and the model offsets them when it also simulates the robot
+  size_t first_tracked = 0;
+  if (!track_robots_) {first_tracked = comms_data_.robot_poses.size();}
+  for (size_t i = 0; i < tracker_data_.identity.size(); ++i) {
+    size_t agent = first_tracked + i;
+    if (agent > 254) {break;}  // Sim agent numbers, robot included, are uint8
+    model_hypotheses.agents.push_back(agent);
+  }
   model_hypotheses.goals = true;
   model_hypotheses.awareness = false;
   // FOR GOAL SEQUENCE
@@ -0,0 +1,61 @@
+/**
+ * @file      goal_grid.hpp
+ * @brief     Adaptive coarse-to-fine grid of sampling goals
+ * @author    agent <agent@local>
+ * @date      2026-10-16
+ * @copyright (MIT) 2015 RAD-UoE Informatics
+ */
+
+#ifndef GOAL_GRID_HPP
+#define GOAL_GRID_HPP
+
+#include <vector>
+
+#include <geometry_msgs/Pose2D.h>
+
+// Quadtree cells over the sampling lattice. A cell of level L spans 2^L
+// lattice points per side and is sampled at its central lattice point, so
+// level 0 cells are the goals of the uniform lattice.
+class GoalGrid {
+ public:
+  GoalGrid();
+
+  // Starts on cells of coarse_resolution over sample_space, unless the grid
+  // already covers the same space. Returns false for an invalid space.
+  bool init(const std::vector<geometry_msgs::Pose2D>& sample_space,
+            float resolution, float coarse_resolution);
+  // Splits cells where any row of masses (one per cell) exceeds refine_mass,
+  // and merges sibling cells that stayed below coarsen_mass for
+  // coarsen_cycles calls. Masses are split evenly and summed on merges.
+  // Returns whether the cells changed.
+  bool adapt(std::vector<std::vector<float> >* masses, float refine_mass,
+             float coarsen_mass, int coarsen_cycles);
+
+  std::vector<geometry_msgs::Pose2D> goals() const;
+  size_t size() const { return cells_.size(); }
+
+ private:
+  struct Cell {
+    size_t level;
+    size_t x;
+    size_t y;
+    int negligible_cycles;
+  };
+
+  bool exists(size_t level, size_t x, size_t y) const;
+  size_t children(const Cell& cell, std::vector<Cell>* cells) const;
+  geometry_msgs::Pose2D cellGoal(const Cell& cell) const;
+
+  float min_x_;
+  float min_y_;
+  float max_x_;
+  float max_y_;
+  float resolution_;
+  float coarse_resolution_;
+  size_t size_x_;  // Lattice points per axis
+  size_t size_y_;
+  size_t top_level_;
+  std::vector<Cell> cells_;
+};
+
+#endif  /* GOAL_GRID_HPP */
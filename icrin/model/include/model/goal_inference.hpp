@@ -0,0 +1,26 @@
+/**
+ * @file      goal_inference.hpp
+ * @brief     Log-space Bayesian goal update over SoA sim velocities
+ * @author    agent <agent@local>
+ * @date      2026-10-16
+ * @copyright (MIT) 2015 RAD-UoE Informatics
+ */
+
+#ifndef GOAL_INFERENCE_HPP
+#define GOAL_INFERENCE_HPP
+
+#include <stdint.h>
+
+#include <cstddef>
+
+// Posterior over the goals of one agent given its current velocity, from a
+// bivariate Gaussian likelihood of each goal's sim velocity times its prior.
+// Goals not yet weighed take the uniform prior instead, without likelihood.
+// Log terms are shifted by their maximum before exponentiating, so the
+// posterior cannot underflow to all zeros. Returns false, with a uniform
+// posterior, when no goal has prior mass.
+bool goalPosterior(const float* sim_vel_x, const float* sim_vel_y,
+                   const float* prior, const uint8_t* weighed, size_t n_goals,
+                   float vel_x, float vel_y, float std_dev, float* posterior);
+
+#endif  /* GOAL_INFERENCE_HPP */
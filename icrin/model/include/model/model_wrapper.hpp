@@ -11,8 +11,12 @@
 
 #include <ros/ros.h>
 
+#include <map>
+#include <random>
+
 #include <std_msgs/Bool.h>
 
+#include <model/goal_inference.hpp>
 #include <model/sim_wrapper.hpp>
 
 #include <geometry_msgs/Pose2D.h>
@@ -45,6 +49,15 @@ class ModelWrapper {
   void interactivePrediction();
 
  private:
+  struct GoalBelief {
+    std::vector<uint8_t> init_liks;
+    std::vector<float> prior;
+  };
+
+  void loadBeliefs();
+  void storeBeliefs();
+  void resampleGoals(const std::vector<bool>& weighted);
+
   // Flags
   bool debug_;
   bool use_rvo_lib_;
@@ -62,6 +75,13 @@ class ModelWrapper {
   int foresight_steps_;
   float foresight_time_step_;
 
+  // Goal particle params
+  bool particle_goals_;  // Prune and resample sampling goals by posterior
+  float prune_mass_;
+  int resample_goals_;
+  float resample_spread_;
+  int max_goal_particles_;
+
   // Variables
   std::string robot_name_;
   std::string model_name_;
@@ -71,6 +91,7 @@ class ModelWrapper {
   geometry_msgs::Twist robot_vel_;
   model_msgs::ModelHypotheses hypotheses_;
   std::vector<uint32_t> sampling_sims_;
+  std::vector<geometry_msgs::Pose2D> sampling_goals_;
   std::vector<common_msgs::Vector2> sampling_sim_vels;
   size_t n_sampling_goals;
   std::vector<uint32_t> sequence_sims_;
@@ -81,9 +102,21 @@ class ModelWrapper {
   // std::vector<bool> init_liks_;
   // std::vector<float> prev_prior_;
   std::vector<uint32_t> costmap_sims_;
-  std::vector<std::vector<bool> > init_liks_;
+  std::vector<std::vector<uint8_t> > init_liks_;
   std::vector<std::vector<float> > prev_prior_;
   std::vector<std::vector<float> > agent_goal_inference_;
+  std::vector<float> sim_vel_x_;
+  std::vector<float> sim_vel_y_;
+  std::vector<bool> goal_weighted_;  // Goals with a posterior from a likelihood
+  std::vector<std::vector<float> > goal_posteriors_;  // Per thread
+  std::vector<uint8_t> model_agents_;  // Sim agents of the hypothesis agents
+  std::vector<uint32_t> agent_ids_;  // Tracker ids of the modelled agents
+  std::vector<uint8_t> tracked_agents_;  // Agents with a tracker id
+  std::map<uint32_t, GoalBelief> goal_beliefs_;  // Keyed by tracker id
+  std::vector<geometry_msgs::Pose2D> particle_space_;
+  float particle_resolution_;
+  std::vector<uint32_t> particle_agents_;  // Tracker ids
+  std::mt19937 goal_rng_;
 
   // ROS
   ros::NodeHandle* nh_;
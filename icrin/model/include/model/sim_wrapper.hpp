@@ -16,21 +16,31 @@
 #include <geometry_msgs/Twist.h>
 #include <common_msgs/Vector2.h>
 
+#include <boost/shared_ptr.hpp>
+
+#include <rvo_wrapper/RVOSimulator.h>
+#include <rvo_wrapper/TrajectoryBuffer.h>
+#include <rvo_wrapper/scenario.hpp>
+#include <rvo_wrapper/thread_pool.hpp>
+
 #include <rvo_wrapper_msgs/AddAgent.h>
-#include <rvo_wrapper_msgs/CalcPrefVelocities.h>
 #include <rvo_wrapper_msgs/CreateRVOSim.h>
 #include <rvo_wrapper_msgs/DeleteSimVector.h>
 #include <rvo_wrapper_msgs/DoStep.h>
+#include <rvo_wrapper_msgs/DoSteps.h>
 #include <rvo_wrapper_msgs/GetAgentVelocity.h>
 #include <rvo_wrapper_msgs/SetAgentGoals.h>
 #include <rvo_wrapper_msgs/SetAgentVelocity.h>
 #include <rvo_wrapper_msgs/GetAgentPosition.h>
+#include <rvo_wrapper_msgs/RunScenario.h>
 #include <rvo_wrapper_msgs/SetAgentMaxSpeed.h>
 #include <rvo_wrapper_msgs/SetAgentMaxAccel.h>
 #include <rvo_wrapper_msgs/SetAgentPrefSpeed.h>
 
 #include <model_msgs/InteractivePrediction.h>
 
+#include <model/goal_grid.hpp>
+
 class SimWrapper {
  public:
   explicit SimWrapper(ros::NodeHandle* nh);
@@ -40,6 +50,9 @@ class SimWrapper {
   void init();
   void rosSetup();
 
+  std::vector<geometry_msgs::Pose2D> sampleGoals(
+    std::vector<geometry_msgs::Pose2D> sample_space, float sample_resolution);
+  bool refineGoals(std::vector<std::vector<float> >* goal_priors);
   std::vector<uint32_t> goalSampling(std::vector<geometry_msgs::Pose2D>
                                      sample_space,
                                      float sample_resolution);
@@ -48,6 +61,8 @@ class SimWrapper {
 
   std::vector<common_msgs::Vector2> calcSimVels(std::vector<uint32_t> sims,
                                                 size_t n_goals);
+  std::vector<common_msgs::Vector2> runScenario(
+    std::vector<geometry_msgs::Pose2D> goal_sequence);
 
   void setRobotModel(bool robot_model);
   void setModelAgents(std::vector<uint8_t> model_agents);
@@ -62,10 +77,21 @@ class SimWrapper {
 
   std::vector<geometry_msgs::Pose2D> getSamplingGoals()
   { return sampling_goal_sequence_; }
+  bool adaptiveSampling() const { return adaptive_sampling_; }
+  RVO::ThreadPool* threadPool() { return thread_pool_; }
 
  private:
+  model_msgs::InteractivePrediction
+  interactiveSimInProcess(std::vector<common_msgs::Vector2> a_goals,
+                          size_t foresight, float time_step);
+
   // Flags
   bool use_rvo_lib_;
+  bool in_process_;  // Run sims on the RVO library instead of rvo_wrapper
+  int threads_;  // In-process sim threads, 0 for one per core
+  int sim_steps_;  // Steps each goal sim runs before its velocity is read
+  bool batch_sims_;  // Run multi-step goal sims as the worlds of one batch
+  bool adaptive_sampling_;  // Sample goals on a coarse-to-fine grid
   bool debug_;
   bool persistence_;
 
@@ -86,6 +112,12 @@ class SimWrapper {
   float planner_max_accel_;
   float planner_pref_speed_;
 
+  // Adaptive sampling params
+  float coarse_resolution_;
+  float refine_mass_;
+  float coarsen_mass_;
+  int coarsen_cycles_;
+
   // Variables
   bool robot_model_;
   std::string robot_name_;
@@ -97,18 +129,23 @@ class SimWrapper {
   std::vector<common_msgs::Vector2> agent_poses_;
   std::vector<common_msgs::Vector2> agent_vels_;
   std::vector<geometry_msgs::Pose2D> sampling_goal_sequence_;
+  GoalGrid goal_grid_;
+  RVO::Scenario scenario_;
+  RVO::ScenarioRunner scenario_runner_;  // Keeps sims across model cycles
+  RVO::ThreadPool* thread_pool_;
 
   // ROS
   ros::NodeHandle* nh_;
   ros::ServiceClient add_sim_agent_client_;
-  ros::ServiceClient calc_pref_velocities_client_;
   ros::ServiceClient create_sims_client_;
   ros::ServiceClient delete_sims_client_;
   ros::ServiceClient do_sim_step_client_;
+  ros::ServiceClient do_sim_steps_client_;
   ros::ServiceClient get_agent_vel_client_;
   ros::ServiceClient set_agent_goals_client_;
   ros::ServiceClient set_agent_vel_client_;
   ros::ServiceClient get_agent_position_client_;
+  ros::ServiceClient run_scenario_client_;
   ros::ServiceClient set_agent_max_speed_client_;
   ros::ServiceClient set_agent_max_accel_client_;
   ros::ServiceClient set_agent_pref_speed_client_;
@@ -0,0 +1,186 @@
+/**
+ * @file      goal_grid.cpp
+ * @brief     Adaptive coarse-to-fine grid of sampling goals
+ * @author    agent <agent@local>
+ * @date      2026-10-16
+ * @copyright (MIT) 2015 RAD-UoE Informatics
+ */
+
+#include <model/goal_grid.hpp>
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+GoalGrid::GoalGrid() : min_x_(0.0f), min_y_(0.0f), max_x_(0.0f),
+  max_y_(0.0f), resolution_(0.0f), coarse_resolution_(0.0f), size_x_(0),
+  size_y_(0), top_level_(0) { }
+
+bool GoalGrid::init(const std::vector<geometry_msgs::Pose2D>& sample_space,
+                    float resolution, float coarse_resolution) {
+  if (sample_space.size() < 2) {return false;}
+  float min_x = sample_space[0].x;
+  float min_y = sample_space[0].y;
+  float max_x = sample_space[1].x;
+  float max_y = sample_space[1].y;
+  if (!(min_x <= max_x) || !(min_y <= max_y) || !(resolution > 0.0f)) {
+    return false;
+  }
+  if (!cells_.empty() && (min_x == min_x_) && (min_y == min_y_) &&
+      (max_x == max_x_) && (max_y == max_y_) && (resolution == resolution_) &&
+      (coarse_resolution == coarse_resolution_)) {
+    return true;  // Keep the refined cells
+  }
+  min_x_ = min_x;
+  min_y_ = min_y;
+  max_x_ = max_x;
+  max_y_ = max_y;
+  resolution_ = resolution;
+  coarse_resolution_ = coarse_resolution;
+  // Small tolerance so a space of whole resolutions keeps its far edge
+  size_x_ = static_cast<size_t>(((max_x - min_x) / resolution) + 1e-3f) + 1;
+  size_y_ = static_cast<size_t>(((max_y - min_y) / resolution) + 1e-3f) + 1;
+  top_level_ = 0;
+  while ((resolution * (size_t(1) << (top_level_ + 1))) <=
+         (coarse_resolution * (1.0f + 1e-3f))) {
+    ++top_level_;
+  }
+  cells_.clear();
+  size_t span = size_t(1) << top_level_;
+  for (size_t x = 0; (x * span) < size_x_; ++x) {
+    for (size_t y = 0; (y * span) < size_y_; ++y) {
+      Cell cell = {top_level_, x, y, 0};
+      cells_.push_back(cell);
+    }
+  }
+  return true;
+}
+
+bool GoalGrid::exists(size_t level, size_t x, size_t y) const {
+  return ((x << level) < size_x_) && ((y << level) < size_y_);
+}
+
+size_t GoalGrid::children(const Cell& cell, std::vector<Cell>* cells) const {
+  size_t n_children = 0;
+  for (size_t dx = 0; dx < 2; ++dx) {
+    for (size_t dy = 0; dy < 2; ++dy) {
+      Cell child = {cell.level - 1, 2 * cell.x + dx, 2 * cell.y + dy, 0};
+      if (this->exists(child.level, child.x, child.y)) {
+        cells->push_back(child);
+        ++n_children;
+      }
+    }
+  }
+  return n_children;
+}
+
+geometry_msgs::Pose2D GoalGrid::cellGoal(const Cell& cell) const {
+  // Central lattice point of the span the cell covers within the space
+  size_t span = size_t(1) << cell.level;
+  size_t first_x = cell.x * span;
+  size_t first_y = cell.y * span;
+  size_t span_x = std::min(span, size_x_ - first_x);
+  size_t span_y = std::min(span, size_y_ - first_y);
+  geometry_msgs::Pose2D goal;
+  goal.x = min_x_ + (resolution_ * (first_x + ((span_x - 1) / 2)));
+  goal.y = min_y_ + (resolution_ * (first_y + ((span_y - 1) / 2)));
+  goal.theta = 0.0;
+  return goal;
+}
+
+std::vector<geometry_msgs::Pose2D> GoalGrid::goals() const {
+  std::vector<geometry_msgs::Pose2D> goals;
+  goals.reserve(cells_.size());
+  for (size_t c = 0; c < cells_.size(); ++c) {
+    goals.push_back(this->cellGoal(cells_[c]));
+  }
+  return goals;
+}
+
+bool GoalGrid::adapt(std::vector<std::vector<float> >* masses,
+                     float refine_mass, float coarsen_mass,
+                     int coarsen_cycles) {
+  size_t n_cells = cells_.size();
+  for (size_t r = 0; r < masses->size(); ++r) {
+    if ((*masses)[r].size() != n_cells) {return false;}
+  }
+  std::vector<float> max_mass(n_cells, 0.0f);
+  for (size_t r = 0; r < masses->size(); ++r) {
+    for (size_t c = 0; c < n_cells; ++c) {
+      max_mass[c] = std::max(max_mass[c], (*masses)[r][c]);
+    }
+  }
+  bool changed = false;
+  std::vector<bool> split(n_cells, false);
+  typedef std::tuple<size_t, size_t, size_t> ParentKey;
+  std::map<ParentKey, std::vector<size_t> > siblings;
+  for (size_t c = 0; c < n_cells; ++c) {
+    Cell& cell = cells_[c];
+    if (max_mass[c] < coarsen_mass) {
+      ++cell.negligible_cycles;
+    } else {
+      cell.negligible_cycles = 0;
+    }
+    if ((cell.level > 0) && (max_mass[c] > refine_mass)) {
+      split[c] = true;
+      changed = true;
+    } else if ((cell.level < top_level_) &&
+               (cell.negligible_cycles >= coarsen_cycles)) {
+      siblings[ParentKey(cell.level + 1, cell.x / 2, cell.y / 2)].
+      push_back(c);
+    }
+  }
+  // Siblings merge once every child of their parent is a negligible leaf
+  const size_t no_group = static_cast<size_t>(-1);
+  std::vector<size_t> merge_group(n_cells, no_group);
+  std::vector<std::vector<size_t> > groups;
+  std::vector<Cell> parent_children;
+  for (std::map<ParentKey, std::vector<size_t> >::const_iterator it =
+         siblings.begin(); it != siblings.end(); ++it) {
+    Cell parent = {std::get<0>(it->first), std::get<1>(it->first),
+                   std::get<2>(it->first), 0};
+    parent_children.clear();
+    if (this->children(parent, &parent_children) != it->second.size()) {
+      continue;
+    }
+    for (size_t i = 0; i < it->second.size(); ++i) {
+      merge_group[it->second[i]] = groups.size();
+    }
+    groups.push_back(it->second);
+    changed = true;
+  }
+  if (!changed) {return false;}
+
+  std::vector<Cell> cells;
+  std::vector<std::vector<float> > new_masses(masses->size());
+  for (size_t c = 0; c < n_cells; ++c) {
+    const Cell& cell = cells_[c];
+    if (merge_group[c] != no_group) {
+      const std::vector<size_t>& group = groups[merge_group[c]];
+      if (group[0] != c) {continue;}  // Merged at its first sibling
+      Cell parent = {cell.level + 1, cell.x / 2, cell.y / 2, 0};
+      cells.push_back(parent);
+      for (size_t r = 0; r < masses->size(); ++r) {
+        float mass = 0.0f;
+        for (size_t i = 0; i < group.size(); ++i) {
+          mass += (*masses)[r][group[i]];
+        }
+        new_masses[r].push_back(mass);
+      }
+    } else if (split[c]) {
+      size_t n_children = this->children(cell, &cells);
+      for (size_t r = 0; r < masses->size(); ++r) {
+        new_masses[r].insert(new_masses[r].end(), n_children,
+                             (*masses)[r][c] / n_children);
+      }
+    } else {
+      cells.push_back(cell);
+      for (size_t r = 0; r < masses->size(); ++r) {
+        new_masses[r].push_back((*masses)[r][c]);
+      }
+    }
+  }
+  cells_.swap(cells);
+  masses->swap(new_masses);
+  return true;
+}
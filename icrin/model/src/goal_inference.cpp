@@ -0,0 +1,53 @@
+/**
+ * @file      goal_inference.cpp
+ * @brief     Log-space Bayesian goal update over SoA sim velocities
+ * @author    agent <agent@local>
+ * @date      2026-10-16
+ * @copyright (MIT) 2015 RAD-UoE Informatics
+ */
+
+#include <model/goal_inference.hpp>
+
+#include <cmath>
+
+bool goalPosterior(const float* sim_vel_x, const float* sim_vel_y,
+                   const float* prior, const uint8_t* weighed, size_t n_goals,
+                   float vel_x, float vel_y, float std_dev, float* posterior) {
+  if (n_goals == 0) {return false;}
+  const float PI = 3.14159265358979323846f;
+  const float log_norm = -std::log(2.0f * PI * std_dev * std_dev);
+  const float half_inv_var = 0.5f / (std_dev * std_dev);
+  const float log_uniform = -std::log(static_cast<float>(n_goals));
+  // Log likelihoods of every goal first, so the loop vectorizes
+  for (size_t goal = 0; goal < n_goals; ++goal) {
+    float dx = sim_vel_x[goal] - vel_x;
+    float dy = sim_vel_y[goal] - vel_y;
+    posterior[goal] = log_norm - (half_inv_var * ((dx * dx) + (dy * dy)));
+  }
+  for (size_t goal = 0; goal < n_goals; ++goal) {
+    if (!weighed[goal]) {posterior[goal] = log_uniform;}
+  }
+  float max_term = posterior[0];
+  for (size_t goal = 1; goal < n_goals; ++goal) {
+    max_term = (posterior[goal] > max_term) ? posterior[goal] : max_term;
+  }
+  // Shifted terms are at most the prior, so they neither overflow nor all
+  // underflow while the best goal has prior mass
+  float norm = 0.0f;
+  for (size_t goal = 0; goal < n_goals; ++goal) {
+    float term = std::exp(posterior[goal] - max_term);
+    posterior[goal] = weighed[goal] ? (term * prior[goal]) : term;
+    norm += posterior[goal];
+  }
+  if (!(norm > 0.0f)) {
+    for (size_t goal = 0; goal < n_goals; ++goal) {
+      posterior[goal] = 1.0f / n_goals;
+    }
+    return false;
+  }
+  const float inv_norm = 1.0f / norm;
+  for (size_t goal = 0; goal < n_goals; ++goal) {
+    posterior[goal] *= inv_norm;
+  }
+  return true;
+}
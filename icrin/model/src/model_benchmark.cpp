@@ -0,0 +1,114 @@
+/**
+ * @file      model_benchmark.cpp
+ * @brief     Model cycle time against the number of modelled agents
+ * @author    agent <agent@local>
+ * @date      2026-10-16
+ * @copyright (MIT) 2015 RAD-UoE Informatics
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <rvo_wrapper/scenario.hpp>
+#include <rvo_wrapper/thread_pool.hpp>
+
+#include <model/goal_inference.hpp>
+
+// Runs the in-process goal sims and inference of a model cycle, as the model
+// node does with in_process set, for every agent of a 7x5 m arena sampled at
+// 0.1 m. Usage: model_benchmark [threads] [cycles] [max_agents]
+int main(int argc, char** argv) {
+  size_t threads = (argc > 1) ? std::atoi(argv[1]) : 0;
+  size_t cycles = (argc > 2) ? std::atoi(argv[2]) : 10;
+  size_t max_agents = (argc > 3) ? std::atoi(argv[3]) : 16;
+  if (cycles == 0) {cycles = 1;}
+  const float min_x = -3.5f, min_y = -2.5f, max_x = 3.5f, max_y = 2.5f;
+  const float sample_res = 0.1f;
+  const float std_dev = (1.2f / 2) * 0.1f;  // As ModelWrapper::inferGoals
+
+  RVO::ThreadPool pool(threads);
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> arena_x(min_x, max_x);
+  std::uniform_real_distribution<float> arena_y(min_y, max_y);
+  std::normal_distribution<float> velocity(0.0f, 0.3f);
+
+  RVO::Scenario scenario;
+  for (int i = 0; (min_x + (sample_res * i)) <= max_x + 1e-3f; ++i) {
+    for (int j = 0; (min_y + (sample_res * j)) <= max_y + 1e-3f; ++j) {
+      scenario.goals.push_back(RVO::Vector2(min_x + (sample_res * i),
+                                            min_y + (sample_res * j)));
+    }
+  }
+  size_t n_goals = scenario.goals.size();
+  std::printf("threads=%zu goals=%zu cycles=%zu\n", pool.numThreads(),
+              n_goals, cycles);
+  std::printf("%8s %12s %12s %12s\n", "agents", "sims_ms", "infer_ms",
+              "cycle_ms");
+
+  for (size_t n_agents = 1; n_agents <= max_agents; n_agents *= 2) {
+    scenario.positions.resize(n_agents);
+    scenario.velocities.resize(n_agents);
+    scenario.agent_goals.assign(n_agents, RVO::Vector2());
+    scenario.model_agents.resize(n_agents);
+    for (size_t i = 0; i < n_agents; ++i) {
+      scenario.positions[i] = RVO::Vector2(arena_x(rng), arena_y(rng));
+      scenario.model_agents[i] = i;
+    }
+    RVO::ScenarioRunner runner;
+    std::vector<RVO::Vector2> sim_vels;
+    std::vector<float> sim_vel_x(n_agents * n_goals);
+    std::vector<float> sim_vel_y(n_agents * n_goals);
+    std::vector<std::vector<float> > priors(n_agents);
+    std::vector<std::vector<uint8_t> > weighed(n_agents);
+    for (size_t i = 0; i < n_agents; ++i) {
+      priors[i].assign(n_goals, 1.0f / n_goals);
+      weighed[i].assign(n_goals, 1);
+    }
+    std::vector<std::vector<float> > posteriors(pool.numThreads());
+    for (size_t t = 0; t < posteriors.size(); ++t) {
+      posteriors[t].resize(n_goals);
+    }
+    double sims_ms = 0.0;
+    double infer_ms = 0.0;
+    for (size_t cycle = 0; cycle <= cycles; ++cycle) {  // Cycle 0 warms up
+      for (size_t i = 0; i < n_agents; ++i) {
+        scenario.velocities[i] = RVO::Vector2(velocity(rng), velocity(rng));
+      }
+      std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+      runner.run(scenario, &sim_vels, &pool);
+      std::chrono::steady_clock::time_point sims_end =
+        std::chrono::steady_clock::now();
+      for (size_t i = 0; i < sim_vels.size(); ++i) {
+        sim_vel_x[i] = sim_vels[i].x();
+        sim_vel_y[i] = sim_vels[i].y();
+      }
+      pool.parallelFor(n_agents, [&](size_t begin, size_t end,
+                                     size_t thread) {
+        for (size_t agent = begin; agent < end; ++agent) {
+          size_t first = agent * n_goals;
+          goalPosterior(&sim_vel_x[first], &sim_vel_y[first],
+                        &priors[agent][0], &weighed[agent][0], n_goals,
+                        scenario.velocities[agent].x(),
+                        scenario.velocities[agent].y(), std_dev,
+                        &posteriors[thread][0]);
+          priors[agent] = posteriors[thread];
+        }
+      });
+      std::chrono::steady_clock::time_point infer_end =
+        std::chrono::steady_clock::now();
+      if (cycle > 0) {
+        sims_ms += std::chrono::duration<double, std::milli>(
+                     sims_end - start).count();
+        infer_ms += std::chrono::duration<double, std::milli>(
+                      infer_end - sims_end).count();
+      }
+    }
+    std::printf("%8zu %12.3f %12.3f %12.3f\n", n_agents, sims_ms / cycles,
+                infer_ms / cycles, (sims_ms + infer_ms) / cycles);
+  }
+  return 0;
+}
@@ -8,6 +8,8 @@
 
 #include "model/model_wrapper.hpp"
 
+#include <algorithm>
+
 ModelWrapper::ModelWrapper(ros::NodeHandle* nh) {
   nh_ = nh;
   robot_name_ = ros::this_node::getNamespace();
@@ -51,6 +53,16 @@ void ModelWrapper::loadParams() {
                     foresight_steps_, 10);
   ros::param::param(robot_name_ + model_name_ + "/foresight_time_step",
                     foresight_time_step_, 0.1f);
+  ros::param::param(robot_name_ + model_name_ + "/particle_goals",
+                    particle_goals_, false);
+  ros::param::param(robot_name_ + model_name_ + "/prune_mass",
+                    prune_mass_, 0.001f);
+  ros::param::param(robot_name_ + model_name_ + "/resample_goals",
+                    resample_goals_, 32);
+  ros::param::param(robot_name_ + model_name_ + "/resample_spread",
+                    resample_spread_, 0.2f);
+  ros::param::param(robot_name_ + model_name_ + "/max_goal_particles",
+                    max_goal_particles_, 400);
 }
 
 void ModelWrapper::init() {
@@ -60,6 +72,7 @@ void ModelWrapper::init() {
   initialised_ = false;
   n_sampling_goals = 0;
   n_sequence_goals = 0;
+  particle_resolution_ = 0.0f;
   // inferred_goals_history_.resize(3);
   // init_liks_.resize(3, false);
   // prev_prior_.resize(3);
@@ -109,6 +122,7 @@ void ModelWrapper::runModel() {
     this->runSims();
     this->inferGoals();
   }
+  this->storeBeliefs();
   if (interactive_costmap_) {this->interactivePrediction();}
   if (debug_) {ROS_INFO_STREAM("EndModel" << std::endl);}
 }
@@ -116,114 +130,220 @@ void ModelWrapper::runModel() {
 void ModelWrapper::inferGoals() {
   if (debug_) {ROS_INFO("Infer");}
   float ros_freq = 0.1f;
-  float PI = 3.14159265358979323846f;
+  float std_dev = (max_accel_ / 2) * ros_freq;  // 2 std.dev = max vel change
   bool reset_priors = false;
-  // size_t inf_hist = 10;
-  common_msgs::Vector2 curr_vel;
+  bool particles = particle_goals_ && hypotheses_.goal_hypothesis.sampling;
   size_t n_goals;
   if (hypotheses_.goal_hypothesis.sampling) {
     n_goals = n_sampling_goals;
   } else {
     n_goals = n_sequence_goals;
   }
+  const std::vector<common_msgs::Vector2>& sim_vels =
+    hypotheses_.goal_hypothesis.sampling ? sampling_sim_vels :
+    sequence_sim_vels;
   size_t n_agents = hypotheses_.agents.size();
-  std::vector<float> goals;
-  goals.resize(n_goals);
-  agent_goal_inference_.assign(n_agents, goals);
+  // Without an update, predictions keep the beliefs of the agents so far
+  if (n_goals == 0) {
+    agent_goal_inference_ = prev_prior_;
+    return;
+  }
+  if (sim_vels.size() < (n_agents * n_goals)) {
+    ROS_WARN("ModelW- Missing sim velocities for goal inference");
+    agent_goal_inference_ = prev_prior_;
+    return;
+  }
+  // Sim velocities as contiguous x and y arrays for the inference kernel,
+  // in buffers kept across cycles
+  sim_vel_x_.resize(sim_vels.size());
+  sim_vel_y_.resize(sim_vels.size());
+  for (size_t i = 0; i < sim_vels.size(); ++i) {
+    sim_vel_x_[i] = sim_vels[i].x;
+    sim_vel_y_[i] = sim_vels[i].y;
+  }
+  agent_goal_inference_.resize(n_agents);
+  goal_weighted_.assign(n_goals, true);
   for (size_t agent = 0; agent < n_agents; ++agent) {
-    curr_vel.x = env_data_.agent_vels[agent].linear.x;
-    curr_vel.y = env_data_.agent_vels[agent].linear.y;
-    std::vector<float> g_likelihoods;
-    g_likelihoods.resize(n_goals);
-    std::vector<common_msgs::Vector2> agent_sim_vels;
-    size_t begin = (agent * n_goals);
-    size_t end = begin + (n_goals);
-    if (hypotheses_.goal_hypothesis.sampling) {
-      agent_sim_vels.insert(agent_sim_vels.begin(),
-                            sampling_sim_vels.begin() + begin,
-                            sampling_sim_vels.begin() + end);
-    } else {
-      agent_sim_vels.insert(agent_sim_vels.begin(),
-                            sequence_sim_vels.begin() + begin,
-                            sequence_sim_vels.begin() + end);
-    }
-    if (debug_) {ROS_WARN_STREAM("SimVelSize: " << agent_sim_vels.size());}
+    if (reset_priors) {init_liks_[agent].assign(n_goals, false);}
     for (size_t goal = 0; goal < n_goals; ++goal) {
-      // if (DISPLAY_INFERENCE_VALUES) {
-      if (debug_) {
-        ROS_INFO_STREAM("curr_vel=[" << curr_vel.x <<
-                        ", " << curr_vel.y << "] " <<
-                        "simVel=[" << agent_sim_vels[goal].x <<
-                        ", " << agent_sim_vels[goal].y << "]" << std::endl);
+      if (!init_liks_[agent][goal]) {goal_weighted_[goal] = false;}
+    }
+  }
+  // Agents update independently, sharded across the sim threads
+  auto infer_agents = [&](size_t begin, size_t end, size_t thread) {
+    std::vector<float>& posteriors = goal_posteriors_[thread];
+    posteriors.resize(n_goals);
+    for (size_t agent = begin; agent < end; ++agent) {
+      size_t env_agent = hypotheses_.agents[agent];
+      if (env_agent < env_data_.agent_vels.size()) {
+        std::vector<uint8_t>& init_liks = init_liks_[agent];
+        size_t first = (agent * n_goals);
+        if (!goalPosterior(&sim_vel_x_[first], &sim_vel_y_[first],
+                           &prev_prior_[agent][0], &init_liks[0], n_goals,
+                           env_data_.agent_vels[env_agent].linear.x,
+                           env_data_.agent_vels[env_agent].linear.y,
+                           std_dev, &posteriors[0])) {
+          // Every goal had dropped, so the agent starts over from uniform
+          ROS_WARN("ModelW- No goal left for agent %u, priors reset",
+                   agent_ids_[agent]);
+          init_liks.assign(n_goals, false);
+          prev_prior_[agent].assign(n_goals, 1.0f / n_goals);
+          agent_goal_inference_[agent] = prev_prior_[agent];
+          continue;
+        }
+        init_liks.assign(n_goals, true);
+        for (size_t goal = 0; goal < n_goals; ++goal) {
+          float posterior = posteriors[goal];
+          if (particles || posterior > 0.01f) {  // Particles can drop
+            prev_prior_[agent][goal] = posterior;
+          } else {
+            prev_prior_[agent][goal] = 0.005f;
+          }
+        }
       }
-      // }
-      // Bivariate Gaussian
-      float x = agent_sim_vels[goal].x;
-      float y = agent_sim_vels[goal].y;
-      float ux = curr_vel.x;
-      float uy = curr_vel.y;
-      float ox = (max_accel_ / 2) * ros_freq;  // 2 std.dev = max vel change
-      float oy = (max_accel_ / 2) * ros_freq;
-      float o2x = pow(ox, 2);
-      float o2y = pow(oy, 2);
-      float corr = 0.0f;
-      float corr2 = pow(corr, 2.0f);
-      float t1 = pow(x - ux, 2.0f) / o2x;
-      float t2 = pow(y - uy, 2.0f) / o2y;
-      float t3 = (2 * corr * (x - ux) * (y - uy)) / (ox * oy);
-      float p = (1 / (2 * PI * ox * oy * sqrtf(1 - corr2)));
-      float e = exp(-(1 / (2 * (1 - corr2))) * (t1 + t2 - t3));
-      g_likelihoods[goal] = p * e;
-      // if (debug_) {ROS_INFO_STREAM("Goal: " << goal <<
-      // " Lik: " << g_likelihoods[goal] <<
-      //                 " t1: " << t1 << " t2: " << t2 << " t3: " << t3);}
+      agent_goal_inference_[agent] = prev_prior_[agent];
     }
-
-    float posterior_norm = 0.0f;
-    std::vector<float> g_posteriors;
-    g_posteriors.resize(n_goals);
-    float uniform_prior = 1.0f / n_goals;
-    for (std::size_t goal = 0; goal < n_goals; ++goal) {
-      if (reset_priors || !init_liks_[agent][goal]) {
-        g_posteriors[goal] = uniform_prior;
-        init_liks_[agent][goal] = true;
-      } else {
-        g_posteriors[goal] = g_likelihoods[goal] * prev_prior_[agent][goal];
+  };
+  RVO::ThreadPool* threads = sim_wrapper_->threadPool();
+  if (threads == NULL) {
+    goal_posteriors_.resize(1);
+    infer_agents(0, n_agents, 0);
+  } else {
+    goal_posteriors_.resize(threads->numThreads());
+    threads->parallelFor(n_agents, infer_agents);
+  }
+  if (debug_) {
+    for (size_t agent = 0; agent < n_agents; ++agent) {
+      ROS_INFO_STREAM("InferAgent: " << (int)hypotheses_.agents[agent] <<
+                      " Id: " << agent_ids_[agent]);
+      for (size_t goal = 0; goal < n_goals; ++goal) {
+        ROS_INFO_STREAM("G" << goal << ": " << prev_prior_[agent][goal]);
       }
+    }
+  }
+  if (particles) {this->resampleGoals(goal_weighted_);}
+}
 
-      posterior_norm += g_posteriors[goal];
-      if (debug_) {
-        ROS_INFO_STREAM("GoalPosteriors" << goal << "=" <<
-                        g_posteriors[goal] << " " << std::endl);
-      }
+void ModelWrapper::loadBeliefs() {
+  // Posteriors follow the tracker ids of the agents, not their order
+  size_t n_agents = hypotheses_.agents.size();
+  size_t n_goals = hypotheses_.goal_hypothesis.sampling ? n_sampling_goals :
+                   n_sequence_goals;
+  agent_ids_.resize(n_agents);
+  tracked_agents_.resize(n_agents);
+  init_liks_.resize(n_agents);
+  prev_prior_.resize(n_agents);
+  for (size_t agent = 0; agent < n_agents; ++agent) {
+    size_t env_agent = hypotheses_.agents[agent];
+    // Agent indices could collide with tracker ids, so agents without tracker
+    // data get no beliefs from or for other cycles
+    tracked_agents_[agent] = (env_agent < env_data_.tracker_ids.size());
+    if (tracked_agents_[agent]) {
+      agent_ids_[agent] = env_data_.tracker_ids[env_agent];
+    } else {  // No tracker data yet, the index only labels the agent
+      agent_ids_[agent] = hypotheses_.agents[agent];
     }
+    std::map<uint32_t, GoalBelief>::iterator belief =
+      tracked_agents_[agent] ? goal_beliefs_.find(agent_ids_[agent]) :
+      goal_beliefs_.end();
+    if (belief != goal_beliefs_.end()) {
+      init_liks_[agent].swap(belief->second.init_liks);
+      prev_prior_[agent].swap(belief->second.prior);
+    } else {
+      init_liks_[agent].assign(n_goals, false);
+      prev_prior_[agent].assign(n_goals, (n_goals > 0) ? 1.0f / n_goals : 0.0f);
+    }
+  }
+  goal_beliefs_.clear();  // Agents no longer modelled are forgotten
+}
 
-    float norm_posterior = 0.0f;
-    std::vector<float> norm_posteriors;
-    norm_posteriors.resize(n_goals);
-    for (std::size_t goal = 0; goal < n_goals; ++goal) {
-      if (posterior_norm == 0) {
-        norm_posterior = uniform_prior;
-        // if (debug_) {ROS_INFO_STREAM("Uni: " << norm_posterior);
-        // Avoiding NaNs when likelihoods are all 0
-      } else {
-        norm_posterior = g_posteriors[goal] / posterior_norm;
-        if (norm_posterior > 0.01f) {
-          prev_prior_[agent][goal] = norm_posterior;
-        } else {
-          prev_prior_[agent][goal] = 0.005f;
-        }
-      }
-      norm_posteriors[goal] = prev_prior_[agent][goal];
-      agent_goal_inference_[agent][goal] = prev_prior_[agent][goal];
+void ModelWrapper::storeBeliefs() {
+  for (size_t agent = 0; agent < agent_ids_.size(); ++agent) {
+    if (!tracked_agents_[agent]) {continue;}
+    GoalBelief& belief = goal_beliefs_[agent_ids_[agent]];
+    belief.init_liks.swap(init_liks_[agent]);
+    belief.prior.swap(prev_prior_[agent]);
+  }
+}
+
+void ModelWrapper::resampleGoals(const std::vector<bool>& weighted) {
+  size_t n_goals = sampling_goals_.size();
+  size_t n_agents = prev_prior_.size();
+  std::vector<float> mass(n_goals, 0.0f);
+  std::vector<size_t> kept;
+  for (size_t goal = 0; goal < n_goals; ++goal) {
+    float max_mass = 0.0f;
+    for (size_t agent = 0; agent < n_agents; ++agent) {
+      mass[goal] += prev_prior_[agent][goal];
+      max_mass = std::max(max_mass, prev_prior_[agent][goal]);
     }
-    if (debug_) {
-      ROS_INFO_STREAM("InferAgent: " << (int)hypotheses_.agents[agent]);
-      for (int i = 0; i < n_goals; ++i) {
-        ROS_INFO_STREAM("G" << i << ": " << norm_posteriors[i]);
+    // Goals only drop once a likelihood has weighed them
+    if (!weighted[goal] || (max_mass >= prune_mass_)) {kept.push_back(goal);}
+  }
+  if (kept.empty()) {return;}
+  // Systematic resampling of parent goals by their mass over all agents
+  float total_mass = 0.0f;
+  for (size_t i = 0; i < kept.size(); ++i) {total_mass += mass[kept[i]];}
+  size_t n_new = 0;
+  if (max_goal_particles_ > static_cast<int>(kept.size())) {
+    n_new = std::min(static_cast<size_t>(std::max(resample_goals_, 0)),
+                     max_goal_particles_ - kept.size());
+  }
+  std::vector<size_t> parents;
+  std::vector<size_t> n_children(kept.size(), 0);
+  if ((n_new > 0) && (total_mass > 0.0f)) {
+    float stride = total_mass / n_new;
+    std::uniform_real_distribution<float> offset(0.0f, stride);
+    float pointer = offset(goal_rng_);
+    float cum_mass = 0.0f;
+    for (size_t i = 0; i < kept.size(); ++i) {
+      cum_mass += mass[kept[i]];
+      while ((pointer < cum_mass) && (parents.size() < n_new)) {
+        parents.push_back(i);
+        ++n_children[i];
+        pointer += stride;
       }
     }
   }
+  // Parents share their posterior with the candidates injected near them
+  std::vector<geometry_msgs::Pose2D> goals;
+  std::vector<std::vector<float> > priors(n_agents);
+  for (size_t i = 0; i < kept.size(); ++i) {
+    goals.push_back(sampling_goals_[kept[i]]);
+    for (size_t agent = 0; agent < n_agents; ++agent) {
+      priors[agent].push_back(prev_prior_[agent][kept[i]] /
+                              (n_children[i] + 1));
+    }
+  }
+  std::normal_distribution<float> spread(0.0f, resample_spread_);
+  for (size_t p = 0; p < parents.size(); ++p) {
+    size_t i = parents[p];
+    geometry_msgs::Pose2D goal = sampling_goals_[kept[i]];
+    goal.x = std::min(std::max(static_cast<float>(goal.x) +
+                               spread(goal_rng_),
+                               static_cast<float>(particle_space_[0].x)),
+                      static_cast<float>(particle_space_[1].x));
+    goal.y = std::min(std::max(static_cast<float>(goal.y) +
+                               spread(goal_rng_),
+                               static_cast<float>(particle_space_[0].y)),
+                      static_cast<float>(particle_space_[1].y));
+    goals.push_back(goal);
+    for (size_t agent = 0; agent < n_agents; ++agent) {
+      priors[agent].push_back(prev_prior_[agent][kept[i]] /
+                              (n_children[i] + 1));
+    }
+  }
+  if (debug_) {
+    ROS_INFO_STREAM("ModelW- Goal particles: " << n_goals << " -> " <<
+                    kept.size() << " + " << parents.size());
+  }
+  sampling_goals_.swap(goals);
+  prev_prior_.swap(priors);
+  n_sampling_goals = sampling_goals_.size();
+  for (size_t agent = 0; agent < init_liks_.size(); ++agent) {
+    init_liks_[agent].assign(n_sampling_goals, true);
+  }
+  agent_goal_inference_ = prev_prior_;
 }
 
 void ModelWrapper::setupModel() {
@@ -231,8 +351,58 @@ void ModelWrapper::setupModel() {
   //   prev_prior_.resize(3);
   //   initialised_ = true;
   // }
+  this->loadBeliefs();
   size_t n_goals;
-  if (hypotheses_.goal_hypothesis.sampling) {
+  if (hypotheses_.goal_hypothesis.sampling && particle_goals_) {
+    const std::vector<geometry_msgs::Pose2D>& sample_space =
+      hypotheses_.goal_hypothesis.sample_space;
+    float sample_res = hypotheses_.goal_hypothesis.sample_resolution;
+    bool new_space = (sample_space.size() != particle_space_.size()) ||
+                     (sample_res != particle_resolution_);
+    for (size_t i = 0; !new_space && (i < sample_space.size()); ++i) {
+      new_space = (sample_space[i].x != particle_space_[i].x) ||
+                  (sample_space[i].y != particle_space_[i].y);
+    }
+    bool new_agent = false;
+    std::vector<uint32_t> tracked_ids;  // Untracked agents have no beliefs
+    for (size_t i = 0; i < agent_ids_.size(); ++i) {
+      if (!tracked_agents_[i]) {continue;}
+      if (std::find(particle_agents_.begin(), particle_agents_.end(),
+                    agent_ids_[i]) == particle_agents_.end()) {
+        new_agent = true;
+      }
+      tracked_ids.push_back(agent_ids_[i]);
+    }
+    particle_agents_.swap(tracked_ids);
+    // Particles start on the sampling goals, then follow the posteriors
+    // until a new agent needs goals away from them
+    if (sampling_goals_.empty() || new_space || new_agent) {
+      sampling_goals_ = sim_wrapper_->sampleGoals(sample_space, sample_res);
+      particle_space_ = sample_space;
+      particle_resolution_ = sample_res;
+      init_liks_.clear();
+      prev_prior_.clear();
+    }
+    n_sampling_goals = sampling_goals_.size();
+    n_goals = n_sampling_goals;
+  } else if (hypotheses_.goal_hypothesis.sampling &&
+             sim_wrapper_->adaptiveSampling()) {
+    sampling_goals_ = sim_wrapper_->sampleGoals(
+                        hypotheses_.goal_hypothesis.sample_space,
+                        hypotheses_.goal_hypothesis.sample_resolution);
+    // Cells adapt to the last posteriors, which follow splits and merges
+    if (sim_wrapper_->refineGoals(&prev_prior_)) {
+      sampling_goals_ = sim_wrapper_->getSamplingGoals();
+      for (size_t i = 0; i < init_liks_.size(); ++i) {
+        init_liks_[i].assign(sampling_goals_.size(), true);
+      }
+    } else if (sampling_goals_.size() != n_sampling_goals) {
+      init_liks_.clear();  // New sampling space, priors start uniform
+      prev_prior_.clear();
+    }
+    n_sampling_goals = sampling_goals_.size();
+    n_goals = n_sampling_goals;
+  } else if (hypotheses_.goal_hypothesis.sampling) {
     float min_x = hypotheses_.goal_hypothesis.sample_space[0].x;
     float min_y = hypotheses_.goal_hypothesis.sample_space[0].y;
     float max_x = hypotheses_.goal_hypothesis.sample_space[1].x;
@@ -269,16 +439,21 @@ void ModelWrapper::setupModel() {
                      env_data_.agent_vels.end());
   sim_wrapper_->setEnvironment(agent_poses_, agent_vels_);
 
-  sim_wrapper_->setModelAgents(hypotheses_.agents);
+  // Hypothesis agents index the environment data agents, which follow the
+  // robot in the sims when it is modelled
+  size_t robot_offset = robot_model_ ? 1 : 0;
+  model_agents_.resize(hypotheses_.agents.size());
+  for (size_t i = 0; i < hypotheses_.agents.size(); ++i) {
+    model_agents_[i] = hypotheses_.agents[i] + robot_offset;
+  }
+  sim_wrapper_->setModelAgents(model_agents_);
   if (hypotheses_.agents.size() > 0) {
     if (hypotheses_.goals) {
-      if (hypotheses_.goal_hypothesis.sampling) {
-        sampling_sims_ = sim_wrapper_->goalSampling(
-                           hypotheses_.goal_hypothesis.sample_space,
-                           hypotheses_.goal_hypothesis.sample_resolution);
-      } else {
-        sequence_sims_ = sim_wrapper_->goalSequence(
-                           hypotheses_.goal_hypothesis.goal_sequence);
+      if (hypotheses_.goal_hypothesis.sampling && !particle_goals_ &&
+          !sim_wrapper_->adaptiveSampling()) {
+        sampling_goals_ = sim_wrapper_->sampleGoals(
+                            hypotheses_.goal_hypothesis.sample_space,
+                            hypotheses_.goal_hypothesis.sample_resolution);
       }
     }
     if (hypotheses_.awareness) {
@@ -293,10 +468,11 @@ void ModelWrapper::runSims() {
   if (hypotheses_.goals) {
     if (hypotheses_.goal_hypothesis.sampling) {
       if (debug_) {ROS_WARN("ModelW- Run Goal Sampling Sims!");}
-      sampling_sim_vels = sim_wrapper_->calcSimVels(sampling_sims_, n_sampling_goals);
+      sampling_sim_vels = sim_wrapper_->runScenario(sampling_goals_);
     } else {
       if (debug_) {ROS_WARN("ModelW- Run Goal Sequence Sims!");}
-      sequence_sim_vels = sim_wrapper_->calcSimVels(sequence_sims_, n_sequence_goals);
+      sequence_sim_vels = sim_wrapper_->runScenario(
+                            hypotheses_.goal_hypothesis.goal_sequence);
     }
   }
   if (hypotheses_.awareness) {
@@ -318,6 +494,9 @@ void ModelWrapper::interactivePrediction() {
   if (hypotheses_.goal_hypothesis.sampling) {
     n_goals = n_sampling_goals;
   } else {n_goals = n_sequence_goals;}
+  if ((n_goals == 0) || (agent_goal_inference_.size() < n_agents)) {
+    return;  // No goal beliefs to predict from
+  }
   if (robot_model_) {  // TODO(Alex): Add proper check for non-modelled agents
     goal.x = robot_goal_.x;
     goal.y = robot_goal_.y;
@@ -333,10 +512,8 @@ void ModelWrapper::interactivePrediction() {
       }
     }
     if (hypotheses_.goal_hypothesis.sampling) {
-      std::vector<geometry_msgs::Pose2D> sampling_goal_sequence_ =
-        sim_wrapper_->getSamplingGoals();
-      goal.x = sampling_goal_sequence_[max_goal].x;
-      goal.y = sampling_goal_sequence_[max_goal].y;
+      goal.x = sampling_goals_[max_goal].x;
+      goal.y = sampling_goals_[max_goal].y;
     } else {
       goal.x = hypotheses_.goal_hypothesis.goal_sequence[max_goal].x;
       goal.y = hypotheses_.goal_hypothesis.goal_sequence[max_goal].y;
@@ -20,6 +20,8 @@ SimWrapper::SimWrapper(ros::NodeHandle* nh) {
 }
 
 SimWrapper::~SimWrapper() {
+  delete thread_pool_;
+  thread_pool_ = NULL;
 }
 
 void SimWrapper::loadParams() {
@@ -41,6 +43,24 @@ void SimWrapper::loadParams() {
   ros::param::param(robot_name_ + model_name_ +
                     "/pref_speed", pref_speed_, 0.6f);
   max_neighbors_ = max_neighbors;
+  ros::param::param(robot_name_ + model_name_ + "/in_process",
+                    in_process_, false);
+  ros::param::param(robot_name_ + model_name_ + "/threads", threads_, 0);
+  ros::param::param(robot_name_ + model_name_ + "/sim_steps", sim_steps_, 1);
+  if (sim_steps_ < 1) {sim_steps_ = 1;}
+  ros::param::param(robot_name_ + model_name_ + "/batch_sims",
+                    batch_sims_, false);
+  ros::param::param(robot_name_ + model_name_ + "/adaptive_sampling",
+                    adaptive_sampling_, false);
+  ros::param::param(robot_name_ + model_name_ + "/coarse_resolution",
+                    coarse_resolution_, 0.8f);
+  // Four merged cells stay below the refine mass, so they do not split back
+  ros::param::param(robot_name_ + model_name_ + "/refine_mass",
+                    refine_mass_, 0.05f);
+  ros::param::param(robot_name_ + model_name_ + "/coarsen_mass",
+                    coarsen_mass_, 0.01f);
+  ros::param::param(robot_name_ + model_name_ + "/coarsen_cycles",
+                    coarsen_cycles_, 10);
   bool robot_model;
   ros::param::param(robot_name_ + model_name_ + "/robot_model",
                     robot_model, true);
@@ -60,19 +80,27 @@ void SimWrapper::init() {
   persistence_ = true;
   null_vect_.x = 0.0f;
   null_vect_.y = 0.0f;
+  thread_pool_ = NULL;
+  if (in_process_) {  // 0 threads uses every core
+    thread_pool_ = new RVO::ThreadPool((threads_ > 0) ? threads_ : 0);
+  }
 }
 
 void SimWrapper::rosSetup() {
+  if (in_process_) {
+    ROS_INFO("ModelS- Running sims in-process");
+    return;
+  }
   ros::service::waitForService(robot_name_ + model_name_ +
                                "/rvo_wrapper/add_agent");
-  ros::service::waitForService(robot_name_ + model_name_ +
-                               "/rvo_wrapper/calc_pref_velocities");
   ros::service::waitForService(robot_name_ + model_name_ +
                                "/rvo_wrapper/create_rvosim");
   ros::service::waitForService(robot_name_ + model_name_ +
                                "/rvo_wrapper/delete_sim_vector");
   ros::service::waitForService(robot_name_ + model_name_ +
                                "/rvo_wrapper/do_step");
+  ros::service::waitForService(robot_name_ + model_name_ +
+                               "/rvo_wrapper/do_steps");
   ros::service::waitForService(robot_name_ + model_name_ +
                                "/rvo_wrapper/get_agent_velocity");
   ros::service::waitForService(robot_name_ + model_name_ +
@@ -81,6 +109,8 @@ void SimWrapper::rosSetup() {
                                "/rvo_wrapper/set_agent_velocity");
   ros::service::waitForService(robot_name_ + model_name_ +
                                "/rvo_wrapper/get_agent_position");
+  ros::service::waitForService(robot_name_ + model_name_ +
+                               "/rvo_wrapper/run_scenario");
   ros::service::waitForService(robot_name_ + model_name_ +
                                "/rvo_wrapper/set_agent_max_speed");
   ros::service::waitForService(robot_name_ + model_name_ +
@@ -90,10 +120,6 @@ void SimWrapper::rosSetup() {
   add_sim_agent_client_ =
     nh_->serviceClient<rvo_wrapper_msgs::AddAgent>(
       robot_name_ + model_name_ + "/rvo_wrapper/add_agent", persistence_);
-  calc_pref_velocities_client_ =
-    nh_->serviceClient<rvo_wrapper_msgs::CalcPrefVelocities>(
-      robot_name_ + model_name_ +
-      "/rvo_wrapper/calc_pref_velocities", persistence_);
   create_sims_client_ =
     nh_->serviceClient<rvo_wrapper_msgs::CreateRVOSim>(
       robot_name_ + model_name_ +
@@ -106,6 +132,10 @@ void SimWrapper::rosSetup() {
     nh_->serviceClient<rvo_wrapper_msgs::DoStep>(
       robot_name_ + model_name_ +
       "/rvo_wrapper/do_step", persistence_);
+  do_sim_steps_client_ =
+    nh_->serviceClient<rvo_wrapper_msgs::DoSteps>(
+      robot_name_ + model_name_ +
+      "/rvo_wrapper/do_steps", persistence_);
   get_agent_vel_client_ =
     nh_->serviceClient<rvo_wrapper_msgs::GetAgentVelocity>(
       robot_name_ + model_name_ +
@@ -122,6 +152,10 @@ void SimWrapper::rosSetup() {
     nh_->serviceClient<rvo_wrapper_msgs::GetAgentPosition>(
       robot_name_ + model_name_ +
       "/rvo_wrapper/get_agent_position", persistence_);
+  run_scenario_client_ =
+    nh_->serviceClient<rvo_wrapper_msgs::RunScenario>(
+      robot_name_ + model_name_ +
+      "/rvo_wrapper/run_scenario", persistence_);
   set_agent_max_speed_client_ =
     nh_->serviceClient<rvo_wrapper_msgs::SetAgentMaxSpeed>(
       robot_name_ + model_name_ +
@@ -136,22 +170,30 @@ void SimWrapper::rosSetup() {
       "/rvo_wrapper/set_agent_pref_speed", persistence_);
 }
 
-std::vector<uint32_t> SimWrapper::goalSampling(
+std::vector<geometry_msgs::Pose2D> SimWrapper::sampleGoals(
   std::vector<geometry_msgs::Pose2D> sample_space, float sample_resolution) {
-  std::vector<uint32_t> sim_ids;
+  std::vector<geometry_msgs::Pose2D> goal_sequence;
   if (debug_) {ROS_INFO("ModelS- Sampling!");}
   float min_x = sample_space[0].x;
   float min_y = sample_space[0].y;
   float max_x = sample_space[1].x;
   float max_y = sample_space[1].y;
   float sample_res = sample_resolution;
+  if (adaptive_sampling_) {  // Refined cells are kept while the space holds
+    if (!goal_grid_.init(sample_space, sample_resolution,
+                         coarse_resolution_)) {
+      ROS_ERROR("ModelWrapper: Sampling x,y values are incorrect!");
+      return goal_sequence;
+    }
+    sampling_goal_sequence_ = goal_grid_.goals();
+    return sampling_goal_sequence_;
+  }
   if (!(min_x <= max_x) || !(min_y <= max_y)) {
     ROS_ERROR("ModelWrapper: Sampling x,y values are incorrect!");
   } else {
     size_t size_x = max_x - min_x;
     size_t size_y = max_y - min_y;
     size_t n_goals = ((size_x / sample_res) + 1) * ((size_y / sample_res) + 1);
-    std::vector<geometry_msgs::Pose2D> goal_sequence;
     geometry_msgs::Pose2D goal;
     goal.theta = 0.0;
     for (int i = 0; (min_x + (sample_res * i)) <= max_x; ++i) {
@@ -174,9 +216,36 @@ std::vector<uint32_t> SimWrapper::goalSampling(
                       " nGoals: " << n_goals);
     }
     if (goal_sequence.size() == n_goals) {
-      sim_ids = goalSequence(goal_sequence);
       sampling_goal_sequence_ = goal_sequence;
-    } else {ROS_ERROR("SimWrapper: Sampling goal number does not match!");}
+    } else {
+      ROS_ERROR("SimWrapper: Sampling goal number does not match!");
+      goal_sequence.clear();
+    }
+  }
+  return goal_sequence;
+}
+
+bool SimWrapper::refineGoals(std::vector<std::vector<float> >* goal_priors) {
+  if (!adaptive_sampling_) {return false;}
+  if (!goal_grid_.adapt(goal_priors, refine_mass_, coarsen_mass_,
+                        coarsen_cycles_)) {
+    return false;
+  }
+  sampling_goal_sequence_ = goal_grid_.goals();
+  if (debug_) {
+    ROS_INFO_STREAM("ModelS- Adapted sampling goals: " <<
+                    sampling_goal_sequence_.size());
+  }
+  return true;
+}
+
+std::vector<uint32_t> SimWrapper::goalSampling(
+  std::vector<geometry_msgs::Pose2D> sample_space, float sample_resolution) {
+  std::vector<uint32_t> sim_ids;
+  std::vector<geometry_msgs::Pose2D> goal_sequence =
+    this->sampleGoals(sample_space, sample_resolution);
+  if (goal_sequence.size() > 0) {
+    sim_ids = goalSequence(goal_sequence);
   }
   return sim_ids;
 }
@@ -290,12 +359,7 @@ std::vector<common_msgs::Vector2> SimWrapper::calcSimVels(
     ROS_INFO_STREAM("SimsSize: " << sims.size());
     ROS_INFO_STREAM("SimIDs: " << sims[0] << " - " << sims[1]);
   }
-  // Calc Preferred Velocities
-  rvo_wrapper_msgs::CalcPrefVelocities pref_vel;
-  pref_vel.request.sim_ids = sims;
-  calc_pref_velocities_client_.call(pref_vel);
-
-  // Run Sims
+  // Run Sims, which set pref velocities from the agent goals
   rvo_wrapper_msgs::DoStep run_sims;
   run_sims.request.sim_ids = sims;
   do_sim_step_client_.call(run_sims);
@@ -322,6 +386,90 @@ std::vector<common_msgs::Vector2> SimWrapper::calcSimVels(
   return get_vels.response.velocity;
 }
 
+std::vector<common_msgs::Vector2> SimWrapper::runScenario(
+  std::vector<geometry_msgs::Pose2D> goal_sequence) {
+  // Single round trip alternative to goalSequence + calcSimVels
+  size_t goal_no = goal_sequence.size();
+  std::vector<common_msgs::Vector2> agent_goals(agent_no_, null_vect_);
+  if (robot_model_ && agent_no_ > 0) {agent_goals[0] = robot_goal_;}
+  scenario_.time_step = time_step_;
+  scenario_.neighbor_dist = neighbor_dist_;
+  scenario_.max_neighbors = max_neighbors_;
+  scenario_.time_horizon_agent = time_horizon_agent_;
+  scenario_.time_horizon_obst = time_horizon_obst_;
+  scenario_.radius = radius_;
+  scenario_.max_speed = max_speed_;
+  scenario_.max_accel = max_accel_;
+  scenario_.pref_speed = pref_speed_;
+  scenario_.positions.resize(agent_no_);
+  scenario_.velocities.resize(agent_no_);
+  scenario_.agent_goals.resize(agent_no_);
+  for (size_t i = 0; i < agent_no_; ++i) {
+    scenario_.positions[i] = RVO::Vector2(agent_poses_[i].x,
+                                          agent_poses_[i].y);
+    scenario_.velocities[i] = RVO::Vector2(agent_vels_[i].x,
+                                           agent_vels_[i].y);
+    scenario_.agent_goals[i] = RVO::Vector2(agent_goals[i].x,
+                                            agent_goals[i].y);
+  }
+  scenario_.model_agents.assign(model_agents_.begin(), model_agents_.end());
+  scenario_.goals.resize(goal_no);
+  for (size_t i = 0; i < goal_no; ++i) {
+    scenario_.goals[i] = RVO::Vector2(goal_sequence[i].x,
+                                      goal_sequence[i].y);
+  }
+  scenario_.steps = sim_steps_;
+  scenario_.batch = batch_sims_;
+  // Alone model agents need no sims within one step, so their velocities
+  // are computed here without a round trip to rvo_wrapper
+  bool interaction_free = (sim_steps_ == 1);
+  for (size_t i = 0; i < model_agent_no_ && interaction_free; ++i) {
+    interaction_free = (model_agents_[i] < agent_no_) &&
+                       RVO::interactionFree(scenario_, model_agents_[i]);
+  }
+  if (in_process_ || interaction_free) {
+    std::vector<RVO::Vector2> velocity;
+    if (!scenario_runner_.run(scenario_, &velocity, thread_pool_)) {
+      ROS_ERROR("Scenario could not be run!");
+    }
+    std::vector<common_msgs::Vector2> sim_vels(velocity.size());
+    for (size_t i = 0; i < velocity.size(); ++i) {
+      sim_vels[i].x = velocity[i].x();
+      sim_vels[i].y = velocity[i].y();
+    }
+    return sim_vels;
+  }
+  rvo_wrapper_msgs::RunScenario scenario_msg;
+  scenario_msg.request.time_step = time_step_;
+  scenario_msg.request.defaults.neighbor_dist = neighbor_dist_;
+  scenario_msg.request.defaults.max_neighbors = max_neighbors_;
+  scenario_msg.request.defaults.time_horizon_agent = time_horizon_agent_;
+  scenario_msg.request.defaults.time_horizon_obst = time_horizon_obst_;
+  scenario_msg.request.defaults.radius = radius_;
+  scenario_msg.request.defaults.max_speed = max_speed_;
+  scenario_msg.request.defaults.max_accel = max_accel_;
+  scenario_msg.request.defaults.pref_speed = pref_speed_;
+  scenario_msg.request.position = agent_poses_;
+  scenario_msg.request.velocity = agent_vels_;
+  // Goals shared by all sims, model agent goals are swept by rvo_wrapper
+  scenario_msg.request.agent_goals = agent_goals;
+  scenario_msg.request.model_agents = model_agents_;
+  scenario_msg.request.goals.resize(goal_no);
+  for (size_t i = 0; i < goal_no; ++i) {
+    scenario_msg.request.goals[i].x = goal_sequence[i].x;
+    scenario_msg.request.goals[i].y = goal_sequence[i].y;
+  }
+  scenario_msg.request.steps = sim_steps_;
+  scenario_msg.request.batch = batch_sims_;
+  run_scenario_client_.call(scenario_msg);
+  if (!scenario_msg.response.ok) {ROS_ERROR("Scenario could not be run!");}
+  if (debug_) {
+    ROS_INFO_STREAM("ModelANo: " << model_agent_no_ << " GoalNo: " << goal_no <<
+                    " VelNo: " << scenario_msg.response.velocity.size());
+  }
+  return scenario_msg.response.velocity;
+}
+
 void SimWrapper::setRobotModel(bool robot_model) {
   robot_model_ = robot_model;
 }
@@ -355,6 +503,9 @@ model_msgs::InteractivePrediction SimWrapper::interactiveSim(
   std::vector<common_msgs::Vector2> a_goals, size_t foresight, float time_step
   // , std::vector<geometry_msgs::Pose2D> goals
 ) {
+  if (in_process_) {
+    return this->interactiveSimInProcess(a_goals, foresight, time_step);
+  }
   model_msgs::InteractivePrediction inter_pred_msg;
   inter_pred_msg.foresight = foresight;
   inter_pred_msg.agent.resize(agent_no_ - 1);  // TODO(Alex): Bad Practice
@@ -427,30 +578,20 @@ model_msgs::InteractivePrediction SimWrapper::interactiveSim(
   set_agent_goals_client_.call(goal_msg);
 
 
-  // Run Sims
-  for (size_t i = 0; i < foresight; ++i) {
-    // Calc Preferred Velocities
-    rvo_wrapper_msgs::CalcPrefVelocities pref_vel;
-    pref_vel.request.sim_ids.push_back(sim_id);
-    calc_pref_velocities_client_.call(pref_vel);
-
-    rvo_wrapper_msgs::DoStep run_sims;
-    run_sims.request.sim_ids.push_back(sim_id);
-    do_sim_step_client_.call(run_sims);
-    if (!run_sims.response.ok) {ROS_ERROR("SimSteps could not be run!");}
-
-    // Get Positions
-    for (size_t agent = 0; agent < agent_no_; ++agent) {
-      rvo_wrapper_msgs::GetAgentPosition get_poses;
-      get_poses.request.sim_ids.push_back(sim_id);
-      get_poses.request.agent_id = agent;
-      get_agent_position_client_.call(get_poses);
-      if (!get_poses.response.ok) {
-        ROS_ERROR("SimPoses could not be acquired!");
-      } else {
+  // Run Sims, recording every step in one call
+  rvo_wrapper_msgs::DoSteps run_sims;
+  run_sims.request.sim_ids.push_back(sim_id);
+  run_sims.request.steps = foresight;
+  do_sim_steps_client_.call(run_sims);
+  if (!run_sims.response.ok) {
+    ROS_ERROR("SimSteps could not be run!");
+  } else {
+    const uint32_t num_agents = run_sims.response.num_agents[0];
+    for (size_t i = 0; i < foresight; ++i) {
+      for (size_t agent = 0; agent < agent_no_; ++agent) {
         geometry_msgs::Pose2D pose;
-        pose.x = get_poses.response.position.x;
-        pose.y = get_poses.response.position.y;
+        pose.x = run_sims.response.positions[2 * (i * num_agents + agent)];
+        pose.y = run_sims.response.positions[2 * (i * num_agents + agent) + 1];
         if ((agent == 0) && (robot_model_)) {
           inter_pred_msg.planner_pose.push_back(pose);
         } else {
@@ -467,3 +608,54 @@ model_msgs::InteractivePrediction SimWrapper::interactiveSim(
 
   return inter_pred_msg;
 }
+
+model_msgs::InteractivePrediction SimWrapper::interactiveSimInProcess(
+  std::vector<common_msgs::Vector2> a_goals, size_t foresight, float time_step) {
+  model_msgs::InteractivePrediction inter_pred_msg;
+  inter_pred_msg.foresight = foresight;
+  // Sim agent 0 is the robot when it is modelled, the rest are agents
+  size_t robot_offset = (robot_model_ && (agent_no_ > 0)) ? 1 : 0;
+  inter_pred_msg.agent.resize(agent_no_ - robot_offset);
+  boost::shared_ptr<RVO::RVOSimulator> sim(
+    new RVO::RVOSimulator(time_step, neighbor_dist_, max_neighbors_,
+                          time_horizon_agent_, time_horizon_obst_, radius_,
+                          max_speed_, max_accel_, pref_speed_));
+  for (size_t agent = 0; agent < agent_no_; ++agent) {
+    sim->addAgent(RVO::Vector2(agent_poses_[agent].x, agent_poses_[agent].y));
+    sim->setAgentVelocity(agent, RVO::Vector2(agent_vels_[agent].x,
+                                              agent_vels_[agent].y));
+    // Agents without a goal keep their current velocity
+    sim->setAgentGoal(agent, (agent < a_goals.size()) ?
+                      RVO::Vector2(a_goals[agent].x, a_goals[agent].y) :
+                      RVO::Vector2());
+  }
+
+  // Setup Planner parameters (Different from modelling params)
+  if (robot_offset > 0) {
+    sim->setAgentMaxSpeed(0, planner_max_speed_);
+    sim->setAgentMaxAcceleration(0, planner_max_accel_);
+    sim->setAgentPrefSpeed(0, planner_pref_speed_);
+  }
+
+  // Run Sims
+  RVO::TrajectoryBuffer trajectory;
+  if (thread_pool_ && RVO::splitSimSteps(1, agent_no_, *thread_pool_)) {
+    sim->doSteps(foresight, trajectory, *thread_pool_);
+  } else {
+    sim->doSteps(foresight, trajectory);
+  }
+  for (size_t i = 0; i < foresight; ++i) {
+    for (size_t agent = 0; agent < agent_no_; ++agent) {
+      geometry_msgs::Pose2D pose;
+      pose.x = trajectory.getPosition(i, agent).x();
+      pose.y = trajectory.getPosition(i, agent).y();
+      if (agent < robot_offset) {
+        inter_pred_msg.planner_pose.push_back(pose);
+      } else {
+        inter_pred_msg.agent[agent - robot_offset].pose.push_back(pose);
+      }
+    }
+  }
+
+  return inter_pred_msg;
+}
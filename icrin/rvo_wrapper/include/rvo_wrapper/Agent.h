@@ -77,59 +77,201 @@ class Agent {
 	 */
 	explicit Agent(RVOSimulator* sim);
 
+	/**
+	 * \brief      Copies the parameters and goal of another agent, reserving
+	 *             room for its neighbors.
+	 * \param      other           The agent to copy.
+	 */
+	void copyParameters(const Agent& other);
+
+	/**
+	 * \brief      Reserves the neighbor and ORCA line lists of this agent for
+	 *             its maximum number of agent neighbors and a number of
+	 *             obstacle neighbors.
+	 * \param      maxObstacleNeighbors  The number of obstacle neighbors to
+	 *                             reserve room for.
+	 */
+	void reserveNeighbors(size_t maxObstacleNeighbors);
+
 	/**
 	 * \brief      Computes the neighbors of this agent.
 	 */
 	void computeNeighbors();
 
+	/**
+	 * \brief      Rebuilds the neighbor list candidates of this agent: the
+	 *             agents and obstacles within its neighbor ranges grown by a
+	 *             skin.
+	 * \param      skin            The skin added to the neighbor ranges.
+	 */
+	void computeNeighborCandidates(float skin);
+
+	/**
+	 * \brief      Computes the neighbors of this agent from its neighbor list
+	 *             candidates. Gives the same neighbors as computeNeighbors()
+	 *             while no agent has moved more than half the skin since the
+	 *             candidates were built.
+	 */
+	void computeListedNeighbors();
+
 	/**
 	 * \brief      Computes the new velocity of this agent.
 	 */
 	void computeNewVelocity();
 
+	/**
+	 * \brief      Sets the preferred velocity of this agent towards its goal,
+	 *             capped at its preferred speed, or to its current velocity
+	 *             when it has no goal.
+	 */
+	void computeGoalPrefVelocity();
+
+	/**
+	 * \brief      Sets the preferred velocity of this agent as its policy
+	 *             says, if it is not set by the caller.
+	 */
+	void computePrefVelocity();
+
+	/**
+	 * \brief      Computes the ORCA lines of this agent from its current
+	 *             neighbors.
+	 */
+	void computeORCALines();
+
+	/**
+	 * \brief      Appends the ORCA lines of an agent for its obstacle
+	 *             neighbors.
+	 * \param      obstacleNeighbors  The obstacle neighbors of the agent,
+	 *                                by increasing distance.
+	 * \param      position        The position of the agent.
+	 * \param      velocity        The velocity of the agent.
+	 * \param      radius          The radius of the agent.
+	 * \param      timeHorizonObst The obstacle time horizon of the agent.
+	 * \param      lines           Receives the lines. Must be empty.
+	 */
+	static void computeObstacleORCALines(const std::vector<std::pair<float,
+	                                     const Obstacle*> >& obstacleNeighbors,
+	                                     const Vector2& position,
+	                                     const Vector2& velocity, float radius,
+	                                     float timeHorizonObst,
+	                                     std::vector<Line>& lines);
+
+	/**
+	 * \brief      Computes the ORCA line of an agent for an agent neighbor.
+	 * \param      relativePosition  The position of the neighbor relative to
+	 *                               the agent.
+	 * \param      velocity        The velocity of the agent.
+	 * \param      relativeVelocity  The velocity of the agent relative to
+	 *                               the neighbor.
+	 * \param      combinedRadius  The sum of the radii of the two agents.
+	 * \param      invTimeHorizon  The inverse time horizon of the agent.
+	 * \param      timeStep        The time step of the simulation.
+	 * \return     The ORCA line.
+	 */
+	static Line computeAgentORCALine(const Vector2& relativePosition,
+	                                 const Vector2& velocity,
+	                                 const Vector2& relativeVelocity,
+	                                 float combinedRadius, float invTimeHorizon,
+	                                 float timeStep);
+
+	/**
+	 * \brief      Solves the linear program of this agent's current ORCA
+	 *             lines for a preferred velocity.
+	 * \param      prefVelocity    The preferred velocity to optimize for.
+	 * \return     The new velocity closest to the preferred velocity.
+	 */
+	Vector2 solveVelocity(const Vector2& prefVelocity) const;
+
+	/**
+	 * \brief      Computes the velocity this agent would reach after one
+	 *             time step towards a new velocity, limited by its maximum
+	 *             acceleration.
+	 * \param      newVelocity     The new velocity computed for this agent.
+	 * \return     The velocity after update().
+	 */
+	Vector2 acceleratedVelocity(const Vector2& newVelocity) const;
+
 	/**
 	 * \brief      Inserts an agent neighbor into the set of neighbors of
-	 *             this agent.
-	 * \param      agent           A pointer to the agent to be inserted.
+	 *             this agent, kept as a max-heap on distance of at most
+	 *             maxNeighbors_ entries until the query sorts it. Neighbors at
+	 *             equal distance are ordered by agent number, so the set does
+	 *             not depend on the order in which agents are inserted.
+	 * \param      agentNo         The number of the agent to be inserted.
 	 * \param      rangeSq         The squared range around this agent.
 	 */
-	void insertAgentNeighbor(const Agent* agent, float& rangeSq);
+	void insertAgentNeighbor(size_t agentNo, float& rangeSq);
+
+	/**
+	 * \brief      Inserts an agent neighbor into a max-heap of agent
+	 *             neighbors kept like those of an agent.
+	 * \param      agentNeighbors  The heap of (squared distance, agent
+	 *                             number) pairs.
+	 * \param      maxNeighbors    The maximum number of neighbors.
+	 * \param      neighbor        The neighbor to be inserted.
+	 * \param      rangeSq         The squared range around the agent,
+	 *                             reduced once the heap is full.
+	 */
+	static void insertAgentNeighbor(std::vector<std::pair<float, size_t> >&
+	                                agentNeighbors, size_t maxNeighbors,
+	                                const std::pair<float, size_t>& neighbor,
+	                                float& rangeSq);
 
 	/**
 	 * \brief      Inserts a static obstacle neighbor into the set of neighbors
-	 *             of this agent.
+	 *             of this agent. Neighbors at equal distance are ordered by
+	 *             obstacle number.
 	 * \param      obstacle        The number of the static obstacle to be
 	 *                             inserted.
 	 * \param      rangeSq         The squared range around this agent.
 	 */
 	void insertObstacleNeighbor(const Obstacle* obstacle, float rangeSq);
 
+	/**
+	 * \brief      Inserts a static obstacle neighbor into a set of obstacle
+	 *             neighbors sorted like those of an agent.
+	 * \param      obstacleNeighbors  The obstacle neighbors.
+	 * \param      obstacle        The static obstacle to be inserted.
+	 * \param      position        The position of the agent.
+	 * \param      rangeSq         The squared range around the agent.
+	 */
+	static void insertObstacleNeighbor(std::vector<std::pair<float,
+	                                   const Obstacle*> >& obstacleNeighbors,
+	                                   const Obstacle* obstacle,
+	                                   const Vector2& position, float rangeSq);
+
 	/**
 	 * \brief      Updates the two-dimensional position and two-dimensional
 	 *             velocity of this agent.
 	 */
 	void update();
 
-	std::vector<std::pair<float, const Agent*> > agentNeighbors_;
+	/*
+	 * Position, velocity, preferred velocity, radius and maximum speed are
+	 * stored by the simulator in arrays indexed by id_.
+	 */
+	std::vector<std::pair<float, size_t> > agentNeighbors_;
 	size_t maxNeighbors_;
-	float maxSpeed_;
 	float neighborDist_;
 	Vector2 newVelocity_;
 	std::vector<std::pair<float, const Obstacle*> > obstacleNeighbors_;
 	std::vector<Line> orcaLines_;
-	Vector2 position_;
-	Vector2 prefVelocity_;
-	float radius_;
+	std::vector<size_t> agentCandidates_;
+	std::vector<const Obstacle*> obstacleCandidates_;
 	RVOSimulator* sim_;
 	float timeHorizon_;
 	float timeHorizonObst_;
 	float maxAccel_;
 	float prefSpeed_;
-	Vector2 velocity_;
+	Vector2 goal_;
+	PrefVelocityPolicy prefVelocityPolicy_;
 
 	size_t id_;
+	size_t numObstLines_;
 
+	friend class BatchSimulator;
 	friend class KdTree;
+	friend class ObstacleSet;
 	friend class RVOSimulator;
 };
 
@@ -178,6 +320,14 @@ size_t linearProgram2(const std::vector<Line>& lines, float radius,
 void linearProgram3(const std::vector<Line>& lines, size_t numObstLines,
                     size_t beginLine,
                     float radius, Vector2& result);
+
+/**
+ * \relates    Agent
+ * \brief      Reserves the scratch linearProgram3() keeps on the calling
+ *             thread for a number of lines.
+ * \param      numLines      The number of lines to reserve room for.
+ */
+void reserveLinearProgram3(size_t numLines);
 }
 
 #endif /* RVO_AGENT_H_ */
@@ -0,0 +1,303 @@
+/*
+ * BatchSimulator.h
+ * RVO2 Library
+ *
+ * Copyright (c) 2015 RAD-UoE Informatics (MIT).
+ */
+
+#ifndef RVO_BATCH_SIMULATOR_H_
+#define RVO_BATCH_SIMULATOR_H_
+
+/**
+ * \file       BatchSimulator.h
+ * \brief      Contains the BatchSimulator class.
+ */
+
+#include <memory>
+
+#include "RVOSimulator.h"
+
+namespace RVO {
+/**
+ * \brief      Defines a batch of simulations, or worlds, of the same agents
+ *             and obstacles that only differ in the agent positions,
+ *             velocities and goals. The state of every world is kept in one
+ *             structure-of-arrays block indexed by agent number, then world
+ *             number, so the worlds of an agent are contiguous lanes that
+ *             the pref velocity, neighbor distance and update loops step
+ *             together. Each world steps exactly like an RVOSimulator with
+ *             the same state.
+ *
+ *             Only those loops are vectorized across worlds. Neighbor
+ *             selection, ORCA line construction and the linear programs
+ *             are data dependent and run per world in scalar code. No
+ *             <i>k</i>d-tree is built: neighbors are selected from the
+ *             distances to every other agent, which is O(N^2) per world
+ *             and suits the small scenes of goal inference rather than
+ *             crowds.
+ */
+class BatchSimulator {
+ private:
+	/**
+	 * \brief      Defines the parameters of an agent, shared by every world.
+	 */
+	class AgentParameters {
+	 public:
+		AgentParameters();
+
+		float neighborDist;
+		size_t maxNeighbors;
+		float timeHorizon;
+		float timeHorizonObst;
+		float radius;
+		float maxSpeed;
+		float maxAccel;
+		float prefSpeed;
+		PrefVelocityPolicy prefVelocityPolicy;
+	};
+
+ public:
+	/**
+	 * \brief      Constructs a batch of one world without agent defaults.
+	 *             Agents are then added with their parameters.
+	 */
+	BatchSimulator();
+
+	/**
+	 * \brief      Constructs a batch of one world with default agent
+	 *             parameters, as RVOSimulator does.
+	 * \param      timeStep        The time step of the simulation.
+	 *                             Must be positive.
+	 * \param      neighborDist    The default maximum distance of new agent
+	 *                             neighbors.
+	 * \param      maxNeighbors    The default maximum number of new agent
+	 *                             neighbors.
+	 * \param      timeHorizon     The default time horizon of new agents
+	 *                             for other agents.
+	 * \param      timeHorizonObst The default time horizon of new agents
+	 *                             for obstacles.
+	 * \param      radius          The default radius of new agents.
+	 * \param      maxSpeed        The default maximum speed of new agents.
+	 * \param      maxAccel        The default maximum acceleration of new
+	 *                             agents.
+	 * \param      prefSpeed       The default preferred speed of new agents.
+	 * \param      velocity        The default initial velocity of new
+	 *                             agents.
+	 */
+	BatchSimulator(float timeStep, float neighborDist, size_t maxNeighbors,
+	               float timeHorizon, float timeHorizonObst, float radius,
+	               float maxSpeed, float maxAccel, float prefSpeed,
+	               const Vector2& velocity = Vector2());
+
+	/**
+	 * \brief      Adds a new agent with default parameters to every world.
+	 * \param      position        The starting position of the agent in
+	 *                             every world.
+	 * \return     The number of the agent, or RVO::RVO_ERROR when the agent
+	 *             defaults have not been set.
+	 */
+	size_t addAgent(const Vector2& position);
+
+	/**
+	 * \brief      Adds a new agent to every world.
+	 * \param      position        The starting position of the agent in
+	 *                             every world.
+	 * \param      neighborDist    The maximum distance of the agent
+	 *                             neighbors.
+	 * \param      maxNeighbors    The maximum number of agent neighbors.
+	 * \param      timeHorizon     The time horizon for other agents.
+	 * \param      timeHorizonObst The time horizon for obstacles.
+	 * \param      radius          The radius of the agent.
+	 * \param      maxSpeed        The maximum speed of the agent.
+	 * \param      maxAccel        The maximum acceleration of the agent.
+	 * \param      prefSpeed       The preferred speed of the agent.
+	 * \param      velocity        The initial velocity of the agent.
+	 * \return     The number of the agent.
+	 */
+	size_t addAgent(const Vector2& position, float neighborDist,
+	                size_t maxNeighbors, float timeHorizon,
+	                float timeHorizonObst, float radius, float maxSpeed,
+	                float maxAccel, float prefSpeed,
+	                const Vector2& velocity = Vector2());
+
+	/**
+	 * \brief      Performs a simulation step in every world.
+	 */
+	void doStep();
+
+	/**
+	 * \brief      Performs a simulation step in every world, spreading the
+	 *             worlds over the threads of a pool.
+	 * \param      pool            The thread pool to run the step on.
+	 */
+	void doStep(ThreadPool& pool);
+
+	/**
+	 * \brief      Returns the goal of an agent in a world.
+	 * \param      worldNo         The number of the world.
+	 * \param      agentNo         The number of the agent.
+	 */
+	Vector2 getAgentGoal(size_t worldNo, size_t agentNo) const;
+
+	/**
+	 * \brief      Returns the position of an agent in a world.
+	 * \param      worldNo         The number of the world.
+	 * \param      agentNo         The number of the agent.
+	 */
+	Vector2 getAgentPosition(size_t worldNo, size_t agentNo) const;
+
+	/**
+	 * \brief      Returns the preferred velocity of an agent in a world.
+	 * \param      worldNo         The number of the world.
+	 * \param      agentNo         The number of the agent.
+	 */
+	Vector2 getAgentPrefVelocity(size_t worldNo, size_t agentNo) const;
+
+	/**
+	 * \brief      Returns the velocity of an agent in a world.
+	 * \param      worldNo         The number of the world.
+	 * \param      agentNo         The number of the agent.
+	 */
+	Vector2 getAgentVelocity(size_t worldNo, size_t agentNo) const;
+
+	/**
+	 * \brief      Returns the global time of the simulation.
+	 */
+	float getGlobalTime() const { return globalTime_; }
+
+	/**
+	 * \brief      Returns the number of agents in each world.
+	 */
+	size_t getNumAgents() const { return agents_.size(); }
+
+	/**
+	 * \brief      Returns the number of worlds.
+	 */
+	size_t getNumWorlds() const { return numWorlds_; }
+
+	/**
+	 * \brief      Returns the time step of the simulation.
+	 */
+	float getTimeStep() const { return timeStep_; }
+
+	/**
+	 * \brief      Sets the goal of an agent in a world, and makes the agent
+	 *             seek its goal with RVO::PREF_VELOCITY_GOAL in every world.
+	 * \param      worldNo         The number of the world.
+	 * \param      agentNo         The number of the agent.
+	 * \param      goal            The goal, or (0, 0) for an agent that keeps
+	 *                             its current velocity in this world.
+	 */
+	void setAgentGoal(size_t worldNo, size_t agentNo, const Vector2& goal);
+
+	/**
+	 * \brief      Sets the position of an agent in a world.
+	 * \param      worldNo         The number of the world.
+	 * \param      agentNo         The number of the agent.
+	 * \param      position        The replacement position.
+	 */
+	void setAgentPosition(size_t worldNo, size_t agentNo,
+	                      const Vector2& position);
+
+	/**
+	 * \brief      Sets the preferred velocity of an agent in a world, used
+	 *             while the agent is RVO::PREF_VELOCITY_MANUAL.
+	 * \param      worldNo         The number of the world.
+	 * \param      agentNo         The number of the agent.
+	 * \param      prefVelocity    The replacement preferred velocity.
+	 */
+	void setAgentPrefVelocity(size_t worldNo, size_t agentNo,
+	                          const Vector2& prefVelocity);
+
+	/**
+	 * \brief      Sets how the preferred velocity of an agent is set in
+	 *             every world.
+	 * \param      agentNo         The number of the agent.
+	 * \param      policy          The replacement policy.
+	 */
+	void setAgentPrefVelocityPolicy(size_t agentNo, PrefVelocityPolicy policy);
+
+	/**
+	 * \brief      Sets the velocity of an agent in a world.
+	 * \param      worldNo         The number of the world.
+	 * \param      agentNo         The number of the agent.
+	 * \param      velocity        The replacement velocity.
+	 */
+	void setAgentVelocity(size_t worldNo, size_t agentNo,
+	                      const Vector2& velocity);
+
+	/**
+	 * \brief      Sets the number of worlds. Added worlds start as copies of
+	 *             world zero.
+	 * \param      numWorlds       The number of worlds. Must be positive.
+	 */
+	void setNumWorlds(size_t numWorlds);
+
+	/**
+	 * \brief      Sets the obstacles of every world to a processed obstacle
+	 *             set, which is only read.
+	 * \param      obstacleSet     The obstacle set, or an empty pointer for
+	 *                             no obstacles.
+	 */
+	void setObstacleSet(const std::shared_ptr<const ObstacleSet>& obstacleSet);
+
+	/**
+	 * \brief      Sets the time step of the simulation.
+	 * \param      timeStep        The time step. Must be positive.
+	 */
+	void setTimeStep(float timeStep);
+
+	/**
+	 * \brief      Replaces the agents, obstacles and time of the batch by
+	 *             those of a simulation, and sets every world to its state.
+	 * \param      sim             The simulation to copy.
+	 * \param      numWorlds       The number of worlds. Must be positive.
+	 */
+	void setWorlds(const RVOSimulator& sim, size_t numWorlds);
+
+ private:
+	BatchSimulator(const BatchSimulator& other);
+	BatchSimulator& operator=(const BatchSimulator& other);
+
+	/**
+	 * \brief      Appends an agent to every world.
+	 * \param      parameters      The parameters of the agent.
+	 * \param      position        The position of the agent.
+	 * \param      velocity        The velocity of the agent.
+	 * \return     The number of the agent.
+	 */
+	size_t appendAgent(const AgentParameters& parameters,
+	                   const Vector2& position, const Vector2& velocity);
+
+	/**
+	 * \brief      Performs a simulation step in a range of worlds, which is
+	 *             independent of the other worlds.
+	 * \param      beginWorld      The first world of the range.
+	 * \param      endWorld        The world past the end of the range.
+	 */
+	void stepWorlds(size_t beginWorld, size_t endWorld);
+
+	std::vector<AgentParameters> agents_;
+	AgentParameters defaultAgent_;
+	Vector2 defaultVelocity_;
+	bool hasDefaults_;
+	float globalTime_;
+	size_t numWorlds_;
+	std::shared_ptr<const ObstacleSet> obstacleSet_;
+	float timeStep_;
+
+	/* World state, indexed by agentNo * numWorlds_ + worldNo. */
+	std::vector<float> positionsX_;
+	std::vector<float> positionsY_;
+	std::vector<float> velocitiesX_;
+	std::vector<float> velocitiesY_;
+	std::vector<float> prefVelocitiesX_;
+	std::vector<float> prefVelocitiesY_;
+	std::vector<float> newVelocitiesX_;
+	std::vector<float> newVelocitiesY_;
+	std::vector<float> goalsX_;
+	std::vector<float> goalsY_;
+};
+}
+
+#endif /* RVO_BATCH_SIMULATOR_H_ */
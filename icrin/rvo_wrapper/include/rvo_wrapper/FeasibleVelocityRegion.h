@@ -0,0 +1,81 @@
+/*
+ * FeasibleVelocityRegion.h
+ * RVO2 Library
+ *
+ * Copyright (c) 2015 RAD-UoE Informatics (MIT).
+ */
+
+#ifndef RVO_FEASIBLE_VELOCITY_REGION_H_
+#define RVO_FEASIBLE_VELOCITY_REGION_H_
+
+/**
+ * \file       FeasibleVelocityRegion.h
+ * \brief      Contains the FeasibleVelocityRegion class.
+ */
+
+#include "Definitions.h"
+#include "RVOSimulator.h"
+
+namespace RVO {
+/**
+ * \brief      Defines the set of velocities permitted by a fixed set of ORCA
+ *             lines and a maximum speed, as a convex polygon clipped by the
+ *             maximum speed disc. Built once, it projects any number of
+ *             preferred velocities onto the region, giving the same result
+ *             as linearProgram2 up to floating point rounding.
+ */
+class FeasibleVelocityRegion {
+ public:
+	/**
+	 * \brief      Constructs the feasible region of a set of ORCA lines.
+	 * \param      lines           The ORCA lines, obstacle lines first. Must
+	 *                             outlive the region.
+	 * \param      numObstLines    Count of obstacle lines.
+	 * \param      maxSpeed        The radius of the maximum speed disc.
+	 */
+	FeasibleVelocityRegion(const std::vector<Line>& lines,
+	                       size_t numObstLines, float maxSpeed);
+
+	/**
+	 * \brief      Returns true if the region is not empty. When it is empty,
+	 *             project() falls back to linearProgram3.
+	 */
+	bool isFeasible() const { return feasible_; }
+
+	/**
+	 * \brief      Computes the new velocity for each of a batch of preferred
+	 *             velocities, i.e. the closest velocity in the region, or the
+	 *             linearProgram3 result when the region is empty.
+	 * \param      prefVelocities  The preferred velocities.
+	 * \param      newVelocities   Receives the new velocities, may alias
+	 *                             prefVelocities.
+	 * \param      count           The number of preferred velocities.
+	 */
+	void project(const Vector2* prefVelocities, Vector2* newVelocities,
+	             size_t count) const;
+
+ private:
+	void projectBlock(const Vector2* prefVelocities, Vector2* newVelocities,
+	                  size_t count) const;
+
+	const std::vector<Line>& lines_;
+	size_t numObstLines_;
+	float maxSpeed_;
+	bool feasible_;
+
+	/* Half-planes, det(dir, point - v) <= 0 holds inside. */
+	std::vector<float> linePointX_;
+	std::vector<float> linePointY_;
+	std::vector<float> lineDirX_;
+	std::vector<float> lineDirY_;
+
+	/* Polygon edges clipped to the maximum speed disc. */
+	std::vector<float> edgeStartX_;
+	std::vector<float> edgeStartY_;
+	std::vector<float> edgeDirX_;
+	std::vector<float> edgeDirY_;
+	std::vector<float> edgeInvLengthSq_;
+};
+}
+
+#endif /* RVO_FEASIBLE_VELOCITY_REGION_H_ */
@@ -66,8 +66,8 @@
 
 namespace RVO {
 /**
- * \brief      Defines <i>k</i>d-trees for agents and static obstacles in the
- *             simulation.
+ * \brief      Defines the agent <i>k</i>d-tree of the simulation. Static
+ *             obstacles are kept in an ObstacleSet.
  */
 class KdTree {
  private:
@@ -76,6 +76,11 @@ class KdTree {
 	 */
 	class AgentTreeNode {
 	 public:
+		/**
+		 * \brief      Returns the half perimeter of the node bounds.
+		 */
+		float halfPerimeter() const { return (maxX - minX) + (maxY - minY); }
+
 		/**
 		 * \brief      The beginning node number.
 		 */
@@ -115,27 +120,12 @@ class KdTree {
 		 * \brief      The right node number.
 		 */
 		size_t right;
-	};
 
-	/**
-	 * \brief      Defines an obstacle <i>k</i>d-tree node.
-	 */
-	class ObstacleTreeNode {
-	 public:
 		/**
-		 * \brief      The left obstacle tree node.
+		 * \brief      The summed half perimeters of the left and right node
+		 *             bounds when the node was last split.
 		 */
-		ObstacleTreeNode* left;
-
-		/**
-		 * \brief      The obstacle number.
-		 */
-		const Obstacle* obstacle;
-
-		/**
-		 * \brief      The right obstacle tree node.
-		 */
-		ObstacleTreeNode* right;
+		float splitExtent;
 	};
 
 	/**
@@ -150,19 +140,16 @@ class KdTree {
 	~KdTree();
 
 	/**
-	 * \brief      Builds an agent <i>k</i>d-tree.
+	 * \brief      Builds an agent <i>k</i>d-tree. When the agents are the
+	 *             same as in the last build, the tree is refitted instead:
+	 *             node bounds are updated bottom-up, and only subtrees whose
+	 *             split has degraded are built again.
 	 */
 	void buildAgentTree();
 
 	void buildAgentTreeRecursive(size_t begin, size_t end, size_t node);
 
-	/**
-	 * \brief      Builds an obstacle <i>k</i>d-tree.
-	 */
-	void buildObstacleTree();
-
-	ObstacleTreeNode* buildObstacleTreeRecursive(const std::vector<Obstacle*>&
-	                                             obstacles);
+	void refitAgentTreeRecursive(size_t node);
 
 	/**
 	 * \brief      Computes the agent neighbors of the specified agent.
@@ -173,7 +160,8 @@ class KdTree {
 	void computeAgentNeighbors(Agent* agent, float& rangeSq) const;
 
 	/**
-	 * \brief      Computes the obstacle neighbors of the specified agent.
+	 * \brief      Computes the obstacle neighbors of the specified agent from
+	 *             the obstacle set of the simulation.
 	 * \param      agent           A pointer to the agent for which obstacle
 	 *                             neighbors are to be computed.
 	 * \param      rangeSq         The squared range around the agent.
@@ -181,40 +169,32 @@ class KdTree {
 	void computeObstacleNeighbors(Agent* agent, float rangeSq) const;
 
 	/**
-	 * \brief      Deletes the specified obstacle tree node.
-	 * \param      node            A pointer to the obstacle tree node to be
-	 *                             deleted.
+	 * \brief      Collects every agent within range of the specified agent
+	 *             into its neighbor list candidates.
+	 * \param      agent           A pointer to the agent for which agent
+	 *                             candidates are to be collected.
+	 * \param      rangeSq         The squared range including the skin.
 	 */
-	void deleteObstacleTree(ObstacleTreeNode* node);
-
-	void queryAgentTreeRecursive(Agent* agent, float& rangeSq,
-	                             size_t node) const;
-
-	void queryObstacleTreeRecursive(Agent* agent, float rangeSq,
-	                                const ObstacleTreeNode* node) const;
+	void computeAgentCandidates(Agent* agent, float rangeSq) const;
 
 	/**
-	 * \brief      Queries the visibility between two points within a
-	 *             specified radius.
-	 * \param      q1              The first point between which visibility is
-	 *                             to be tested.
-	 * \param      q2              The second point between which visibility is
-	 *                             to be tested.
-	 * \param      radius          The radius within which visibility is to be
-	 *                             tested.
-	 * \return     True if q1 and q2 are mutually visible within the radius;
-	 *             false otherwise.
+	 * \brief      Collects the obstacles within range of the specified agent
+	 *             into its neighbor list candidates.
+	 * \param      agent           A pointer to the agent for which obstacle
+	 *                             candidates are to be collected.
+	 * \param      rangeSq         The squared range including the skin.
 	 */
-	bool queryVisibility(const Vector2& q1, const Vector2& q2,
-	                     float radius) const;
+	void computeObstacleCandidates(Agent* agent, float rangeSq) const;
+
+	void queryAgentTreeRecursive(Agent* agent, const Vector2& position,
+	                             float& rangeSq, size_t node) const;
 
-	bool queryVisibilityRecursive(const Vector2& q1, const Vector2& q2,
-	                              float radius,
-	                              const ObstacleTreeNode* node) const;
+	void queryAgentRangeRecursive(Agent* agent, const Vector2& position,
+	                              float rangeSq, size_t node) const;
 
-	std::vector<Agent*> agents_;
+	/* Agent numbers, sorted so that every tree node owns a contiguous range. */
+	std::vector<size_t> agents_;
 	std::vector<AgentTreeNode> agentTree_;
-	ObstacleTreeNode* obstacleTree_;
 	RVOSimulator* sim_;
 
 	static const size_t MAX_LEAF_SIZE = 10;
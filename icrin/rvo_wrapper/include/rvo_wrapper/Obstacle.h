@@ -85,6 +85,7 @@ class Obstacle {
 
 	friend class Agent;
 	friend class KdTree;
+	friend class ObstacleSet;
 	friend class RVOSimulator;
 };
 }
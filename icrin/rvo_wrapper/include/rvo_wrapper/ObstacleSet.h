@@ -0,0 +1,300 @@
+/*
+ * ObstacleSet.h
+ * RVO2 Library
+ *
+ * Copyright (c) 2015 RAD-UoE Informatics (MIT).
+ */
+
+#ifndef RVO_OBSTACLE_SET_H_
+#define RVO_OBSTACLE_SET_H_
+
+/**
+ * \file       ObstacleSet.h
+ * \brief      Contains the ObstacleSet class.
+ */
+
+#include "Definitions.h"
+
+namespace RVO {
+/**
+ * \brief      Defines a set of static obstacles and their obstacle
+ *             <i>k</i>d-tree. Simulators only read an attached set, so one
+ *             processed set can be shared by any number of simulators.
+ */
+class ObstacleSet {
+ private:
+	/**
+	 * \brief      Defines an obstacle <i>k</i>d-tree node. Nodes are stored
+	 *             in one array in depth-first order, and hold a copy of the
+	 *             obstacle edge so that queries do not visit the obstacles.
+	 */
+	class ObstacleTreeNode {
+	 public:
+		/**
+		 * \brief      The first point of the obstacle edge.
+		 */
+		Vector2 point1;
+
+		/**
+		 * \brief      The second point of the obstacle edge.
+		 */
+		Vector2 point2;
+
+		/**
+		 * \brief      The squared length of the obstacle edge.
+		 */
+		float lengthSq;
+
+		/**
+		 * \brief      The obstacle.
+		 */
+		const Obstacle* obstacle;
+
+		/**
+		 * \brief      The left obstacle tree node number, or NO_NODE.
+		 */
+		size_t left;
+
+		/**
+		 * \brief      The right obstacle tree node number, or NO_NODE.
+		 */
+		size_t right;
+	};
+
+	/**
+	 * \brief      Defines a pending node of an obstacle neighbor query.
+	 */
+	class ObstacleStackEntry {
+	 public:
+		/**
+		 * \brief      The obstacle tree node number.
+		 */
+		size_t node;
+
+		/**
+		 * \brief      The signed distance of the agent from the node line.
+		 */
+		float leftOfLine;
+	};
+
+	/**
+	 * \brief      Defines the part of an obstacle <i>k</i>d-tree built by one
+	 *             thread.
+	 */
+	class ObstacleTreeBuild {
+	 public:
+		ObstacleTreeBuild() : depth(0) { }
+
+		/**
+		 * \brief      The nodes, numbered from the subtree root.
+		 */
+		std::vector<ObstacleTreeNode> nodes;
+
+		/**
+		 * \brief      The obstacle vertices created by splitting obstacles,
+		 *             in creation order.
+		 */
+		std::vector<Obstacle*> newObstacles;
+
+		/**
+		 * \brief      The depth of the deepest node below the build root.
+		 */
+		size_t depth;
+	};
+
+	/**
+	 * \brief      Child number of a missing obstacle tree node.
+	 */
+	static const size_t NO_NODE = static_cast<size_t>(-1);
+
+ public:
+	/**
+	 * \brief      Constructs an empty obstacle set.
+	 */
+	ObstacleSet();
+
+	/**
+	 * \brief      Constructs a copy of an obstacle set from its polygons. The
+	 *             copy is processed if the other set has been processed.
+	 * \param      other           The obstacle set to copy.
+	 */
+	ObstacleSet(const ObstacleSet& other);
+
+	/**
+	 * \brief      Destroys this obstacle set and its obstacles.
+	 */
+	~ObstacleSet();
+
+	/**
+	 * \brief      Adds a new obstacle to the set.
+	 * \param      vertices        List of the vertices of the polygonal
+	 *             obstacle in counterclockwise order.
+	 * \return     The number of the first vertex of the obstacle,
+	 *             or RVO::RVO_ERROR when the number of vertices is less than two.
+	 * \note       To add a "negative" obstacle, e.g. a bounding polygon around
+	 *             the environment, the vertices should be listed in clockwise
+	 *             order.
+	 */
+	size_t addObstacle(const std::vector<Vector2>& vertices);
+
+	/**
+	 * \brief      Builds the obstacle <i>k</i>d-tree of the obstacles that
+	 *             have been added. The top subtrees of large maps are built
+	 *             in parallel.
+	 * \param      maxSplitCandidates  The number of obstacles a node tries
+	 *                             as its split line, zero to try all of
+	 *                             them as RVO2 does. Bounding it builds
+	 *                             large maps much faster, but splits
+	 *                             obstacle edges at other points, which
+	 *                             changes the velocities of agents near
+	 *                             them.
+	 */
+	void processObstacles(size_t maxSplitCandidates = 0);
+
+	/**
+	 * \brief      Returns true if no obstacle has been added since the set
+	 *             was last processed.
+	 */
+	bool isProcessed() const { return processed_; }
+
+	/**
+	 * \brief      Returns the depth of the obstacle <i>k</i>d-tree, zero when
+	 *             it is empty.
+	 */
+	size_t getTreeDepth() const { return treeDepth_; }
+
+	/**
+	 * \brief      Returns the time the last processObstacles() took, in
+	 *             seconds.
+	 */
+	float getBuildTime() const { return buildTime_; }
+
+	/**
+	 * \brief      Returns the count of obstacle vertices in the set.
+	 */
+	size_t getNumObstacleVertices() const;
+
+	/**
+	 * \brief      Returns the two-dimensional position of a specified obstacle
+	 *             vertex.
+	 * \param      vertexNo        The number of the obstacle vertex to be
+	 *                             retrieved.
+	 */
+	const Vector2& getObstacleVertex(size_t vertexNo) const;
+
+	/**
+	 * \brief      Returns the number of the obstacle vertex succeeding the
+	 *             specified obstacle vertex in its polygon.
+	 * \param      vertexNo        The number of the obstacle vertex whose
+	 *                             successor is to be retrieved.
+	 */
+	size_t getNextObstacleVertexNo(size_t vertexNo) const;
+
+	/**
+	 * \brief      Returns the number of the obstacle vertex preceding the
+	 *             specified obstacle vertex in its polygon.
+	 * \param      vertexNo        The number of the obstacle vertex whose
+	 *                             predecessor is to be retrieved.
+	 */
+	size_t getPrevObstacleVertexNo(size_t vertexNo) const;
+
+	/**
+	 * \brief      Queries the visibility between two points within a
+	 *             specified radius.
+	 * \param      q1              The first point between which visibility is
+	 *                             to be tested.
+	 * \param      q2              The second point between which visibility is
+	 *                             to be tested.
+	 * \param      radius          The radius within which visibility is to be
+	 *                             tested.
+	 * \return     True if q1 and q2 are mutually visible within the radius;
+	 *             false otherwise.
+	 */
+	bool queryVisibility(const Vector2& q1, const Vector2& q2,
+	                     float radius) const;
+
+	/**
+	 * \brief      Reserves the traversal stacks that queries keep on the
+	 *             calling thread for trees too deep for the call stack.
+	 */
+	void reserveQueryStacks() const;
+
+ private:
+	ObstacleSet& operator=(const ObstacleSet& other);
+
+	static size_t buildObstacleTreeRecursive(const std::vector<Obstacle*>&
+	                                         obstacles, size_t depth,
+	                                         size_t maxSplitCandidates,
+	                                         ObstacleTreeBuild& build);
+
+	/**
+	 * \brief      Computes the obstacle neighbors of the specified agent.
+	 * \param      agent           A pointer to the agent for which obstacle
+	 *                             neighbors are to be computed.
+	 * \param      position        The position of the agent.
+	 * \param      rangeSq         The squared range around the agent.
+	 */
+	void computeObstacleNeighbors(Agent* agent, const Vector2& position,
+	                              float rangeSq) const;
+
+	/**
+	 * \brief      Computes the obstacle neighbors of a position, sorted like
+	 *             those of an agent.
+	 * \param      position        The position of the agent.
+	 * \param      rangeSq         The squared range around the agent.
+	 * \param      obstacleNeighbors  Receives the obstacle neighbors.
+	 */
+	void computeObstacleNeighbors(const Vector2& position, float rangeSq,
+	                              std::vector<std::pair<float,
+	                              const Obstacle*> >& obstacleNeighbors) const;
+
+	/**
+	 * \brief      Collects the obstacles within range of a position on either
+	 *             side of their line, as neighbor list candidates.
+	 * \param      agent           A pointer to the agent whose obstacle
+	 *                             candidates are to be collected.
+	 * \param      position        The position the list is built at.
+	 * \param      rangeSq         The squared range including the skin.
+	 */
+	void computeObstacleCandidates(Agent* agent, const Vector2& position,
+	                               float rangeSq) const;
+
+	/**
+	 * \brief      Visits the nodes whose line is within range of a position,
+	 *             in the order of a recursive traversal that first descends
+	 *             the side of the position.
+	 * \param      position        The query position.
+	 * \param      rangeSq         The squared range of the query.
+	 * \param      visit           Called with each node in range and the
+	 *                             signed distance of the position from its
+	 *                             line.
+	 */
+	/**
+	 * \brief      Returns the obstacle tree traversal stack of the calling
+	 *             thread.
+	 */
+	static std::vector<ObstacleStackEntry>& threadTreeStack();
+
+	/**
+	 * \brief      Returns the visibility query stack of the calling thread.
+	 */
+	static std::vector<size_t>& threadVisibilityStack();
+
+	template <class Visitor>
+	void queryObstacleTree(const Vector2& position, float rangeSq,
+	                       Visitor visit) const;
+
+	std::vector<Obstacle*> obstacles_;
+	std::vector<std::vector<Vector2> > polygons_;
+	std::vector<ObstacleTreeNode> obstacleTree_;
+	bool processed_;
+	size_t treeDepth_;
+	float buildTime_;
+	size_t maxSplitCandidates_;
+
+	friend class BatchSimulator;
+	friend class KdTree;
+};
+}
+
+#endif /* RVO_OBSTACLE_SET_H_ */
@@ -64,6 +64,7 @@
 
 #include <cstddef>
 #include <limits>
+#include <memory>
 #include <vector>
 
 #include "Vector2.h"
@@ -77,6 +78,28 @@ namespace RVO {
  */
 const size_t RVO_ERROR = std::numeric_limits<size_t>::max();
 
+/**
+ * \brief      Defines how the preferred velocity of an agent is set.
+ */
+enum PrefVelocityPolicy {
+	/**
+	 * \brief      Set by the caller with
+	 *             RVO::RVOSimulator::setAgentPrefVelocity().
+	 */
+	PREF_VELOCITY_MANUAL,
+
+	/**
+	 * \brief      Towards the goal of the agent, capped at its preferred
+	 *             speed, or its current velocity when it has no goal.
+	 */
+	PREF_VELOCITY_GOAL,
+
+	/**
+	 * \brief      The current velocity of the agent.
+	 */
+	PREF_VELOCITY_KEEP
+};
+
 /**
  * \brief      Defines a directed line.
  */
@@ -96,6 +119,9 @@ class Line {
 class Agent;
 class KdTree;
 class Obstacle;
+class ObstacleSet;
+class ThreadPool;
+class TrajectoryBuffer;
 
 /**
  * \brief      Defines the simulation.
@@ -226,9 +252,29 @@ class RVOSimulator {
 	 * \note       To add a "negative" obstacle, e.g. a bounding polygon around
 	 *             the environment, the vertices should be listed in clockwise
 	 *             order.
+	 * \note       If the obstacle set of the simulation is shared, it is
+	 *             copied first and the simulation detaches from it.
 	 */
 	size_t addObstacle(const std::vector<Vector2>& vertices);
 
+	/**
+	 * \brief      Returns a new simulation with the same state as this one.
+	 *             See copyFrom().
+	 * \return     The new simulation, owned by the caller.
+	 */
+	RVOSimulator* clone() const;
+
+	/**
+	 * \brief      Replaces the state of this simulation by that of another:
+	 *             its agents with their parameters, positions, velocities and
+	 *             goals, the agent defaults, time step, global time and
+	 *             neighbor skin. The obstacle set is shared and only copied
+	 *             when one of the simulations edits it. Agent instances and
+	 *             storage kept by reset() are reused.
+	 * \param      other           The simulation to copy.
+	 */
+	void copyFrom(const RVOSimulator& other);
+
 	/**
 	 * \brief      Lets the simulator perform a simulation step and updates the
 	 *             two-dimensional position and two-dimensional velocity of
@@ -236,6 +282,52 @@ class RVOSimulator {
 	 */
 	void doStep();
 
+	/**
+	 * \brief      Performs a simulation step like doStep(), spreading the
+	 *             agents over the threads of a pool. The neighbors and new
+	 *             velocities of all agents are computed before any agent is
+	 *             updated, so the result does not depend on the thread count.
+	 * \param      pool            The thread pool to run the step on. Must
+	 *                             not be running another loop.
+	 */
+	void doStep(ThreadPool& pool);
+
+	/**
+	 * \brief      Performs a number of simulation steps and records the
+	 *             position of every agent after each step.
+	 * \param      numSteps        The number of steps to perform.
+	 * \param      trajectory      Receives the positions. Only allocates
+	 *                             when it holds fewer positions than needed.
+	 */
+	void doSteps(size_t numSteps, TrajectoryBuffer& trajectory);
+
+	/**
+	 * \brief      Performs a number of simulation steps like
+	 *             doSteps(size_t, TrajectoryBuffer&), spreading the agents of
+	 *             each step over the threads of a pool.
+	 * \param      numSteps        The number of steps to perform.
+	 * \param      trajectory      Receives the positions.
+	 * \param      pool            The thread pool to run the steps on.
+	 */
+	void doSteps(size_t numSteps, TrajectoryBuffer& trajectory,
+	             ThreadPool& pool);
+
+	/**
+	 * \brief      Reserves the scratch that steps keep on the calling thread
+	 *             for the current agents and obstacles. Agents reserve their
+	 *             own neighbor and ORCA line lists when they are added, so
+	 *             steps after this only allocate on maps with more obstacle
+	 *             vertices than agents reserve room for.
+	 */
+	void reserveStepScratch() const;
+
+	/**
+	 * \brief      Reserves the step scratch like reserveStepScratch() on
+	 *             every thread of a pool.
+	 * \param      pool            The thread pool the steps are run on.
+	 */
+	void reserveStepScratch(ThreadPool& pool) const;
+
 	/**
 	 * \brief      Returns the specified agent neighbor of the specified
 	 *             agent.
@@ -339,6 +431,29 @@ class RVOSimulator {
 	 */
 	const Vector2& getAgentPosition(size_t agentNo) const;
 
+	/**
+	 * \brief      Returns the two-dimensional goal of a specified agent.
+	 * \param      agentNo         The number of the agent whose goal is to be
+	 *                             retrieved.
+	 * \return     The goal of the agent, (0, 0) when it has none.
+	 */
+	const Vector2& getAgentGoal(size_t agentNo) const;
+
+	/**
+	 * \brief      Returns how the preferred velocity of a specified agent is
+	 *             set.
+	 * \param      agentNo         The number of the agent whose policy is to
+	 *                             be retrieved.
+	 */
+	PrefVelocityPolicy getAgentPrefVelocityPolicy(size_t agentNo) const;
+
+	/**
+	 * \brief      Copies the two-dimensional positions of all agents.
+	 * \param      positions       Receives the x and y coordinates of each
+	 *                             agent in turn, 2 * getNumAgents() floats.
+	 */
+	void getAgentPositions(float* positions) const;
+
 	/**
 	 * \brief      Returns the two-dimensional preferred velocity of a
 	 *             specified agent.
@@ -396,6 +511,13 @@ class RVOSimulator {
 	 */
 	const Vector2& getAgentVelocity(size_t agentNo) const;
 
+	/**
+	 * \brief      Copies the two-dimensional linear velocities of all agents.
+	 * \param      velocities      Receives the x and y components of each
+	 *                             agent in turn, 2 * getNumAgents() floats.
+	 */
+	void getAgentVelocities(float* velocities) const;
+
 	/**
 	 * \brief      Returns the global time of the simulation.
 	 * \return     The present global time of the simulation (zero initially).
@@ -408,6 +530,25 @@ class RVOSimulator {
 	 */
 	size_t getNumAgents() const;
 
+	/**
+	 * \brief      Returns the neighbor list skin of the simulation.
+	 * \return     The neighbor list skin, zero when neighbor lists are not
+	 *             used.
+	 */
+	float getNeighborSkin() const;
+
+	/**
+	 * \brief      Returns the count of steps on which the neighbor lists were
+	 *             rebuilt since the simulation was created or reset.
+	 */
+	size_t getNumNeighborListBuilds() const;
+
+	/**
+	 * \brief      Returns the count of steps that used neighbor lists since
+	 *             the simulation was created or reset.
+	 */
+	size_t getNumNeighborListSteps() const;
+
 	/**
 	 * \brief      Returns the count of obstacle vertices in the simulation.
 	 * \return     The count of obstacle vertices in the simulation.
@@ -444,6 +585,13 @@ class RVOSimulator {
 	 */
 	size_t getPrevObstacleVertexNo(size_t vertexNo) const;
 
+	/**
+	 * \brief      Returns the obstacle set of the simulation, which may be
+	 *             shared with other simulations. Empty if no obstacle has been
+	 *             added.
+	 */
+	const std::shared_ptr<const ObstacleSet>& getObstacleSet() const;
+
 	/**
 	 * \brief      Returns the time step of the simulation.
 	 * \return     The present time step of the simulation.
@@ -453,10 +601,40 @@ class RVOSimulator {
 	/**
 	 * \brief      Processes the obstacles that have been added so that they
 	 *             are accounted for in the simulation.
+	 * \param      maxSplitCandidates  The number of obstacles an obstacle tree
+	 *                             node tries as its split line, zero to try
+	 *                             all of them as RVO2 does. See
+	 *                             ObstacleSet::processObstacles().
 	 * \note       Obstacles added to the simulation after this function has
 	 *             been called are not accounted for in the simulation.
 	 */
-	void processObstacles();
+	void processObstacles(size_t maxSplitCandidates = 0);
+
+	/**
+	 * \brief      Sets the neighbor list skin of the simulation. With a
+	 *             positive skin, each agent keeps the agents and obstacles
+	 *             within its neighbor ranges grown by the skin, and selects
+	 *             its neighbors from them instead of querying the
+	 *             <i>k</i>d-trees. The lists are rebuilt once an agent has
+	 *             moved more than half the skin, so the neighbors are the
+	 *             same as without lists.
+	 * \param      skin            The skin added to the neighbor ranges, or
+	 *                             zero to query the <i>k</i>d-trees on every
+	 *                             step.
+	 */
+	void setNeighborSkin(float skin);
+
+	/**
+	 * \brief      Replaces the obstacles of the simulation by an obstacle set
+	 *             that other simulations may share. The set is only read, so
+	 *             it should have been processed already, and it is copied
+	 *             before any obstacle is added or processed through this
+	 *             simulation.
+	 * \param      obstacleSet     The obstacle set to use, or an empty
+	 *                             pointer for no obstacles.
+	 */
+	void setObstacleSet(const std::shared_ptr<const ObstacleSet>& obstacleSet);
+
 
 	/**
 	 * \brief      Performs a visibility query between the two specified
@@ -474,6 +652,15 @@ class RVOSimulator {
 	bool queryVisibility(const Vector2& point1, const Vector2& point2,
 	                     float radius = 0.0f) const;
 
+	/**
+	 * \brief      Removes all agents and obstacles from the simulation and
+	 *             resets the global time. Removed agents and the agent
+	 *             <i>k</i>d-tree storage are kept for reuse by agents added
+	 *             afterwards, so a reset simulation can be rebuilt without
+	 *             heap allocations.
+	 */
+	void reset();
+
 	/**
 	 * \brief      Sets the default properties for any new agent that is
 	 *             added.
@@ -564,6 +751,23 @@ class RVOSimulator {
 	 */
 	void setAgentPosition(size_t agentNo, const Vector2& position);
 
+	/**
+	 * \brief      Sets the two-dimensional goal of a specified agent, and
+	 *             makes it seek the goal with RVO::PREF_VELOCITY_GOAL.
+	 * \param      agentNo         The number of the agent whose goal is to be
+	 *                             modified.
+	 * \param      goal            The goal, or (0, 0) for an agent that keeps
+	 *                             its current velocity.
+	 */
+	void setAgentGoal(size_t agentNo, const Vector2& goal);
+
+	/**
+	 * \brief      Sets the two-dimensional positions of all agents.
+	 * \param      positions       The x and y coordinates of each agent in
+	 *                             turn, 2 * getNumAgents() floats.
+	 */
+	void setAgentPositions(const float* positions);
+
 	/**
 	 * \brief      Sets the float preferred speed of a specified agent.
 	 * \param      agentNo         The number of the agent whose
@@ -585,6 +789,32 @@ class RVOSimulator {
 	 */
 	void setAgentPrefVelocity(size_t agentNo, const Vector2& prefVelocity);
 
+	/**
+	 * \brief      Sets the two-dimensional preferred velocities of all
+	 *             agents.
+	 * \param      prefVelocities  The x and y components of each agent in
+	 *                             turn, 2 * getNumAgents() floats.
+	 */
+	void setAgentPrefVelocities(const float* prefVelocities);
+
+	/**
+	 * \brief      Sets the preferred velocity of every agent towards its
+	 *             goal, capped at its preferred speed. Agents without a goal
+	 *             keep their current velocity.
+	 */
+	void setAgentPrefVelocitiesFromGoals();
+
+	/**
+	 * \brief      Sets how the preferred velocity of a specified agent is
+	 *             set. Agents are RVO::PREF_VELOCITY_MANUAL when added; the
+	 *             other policies are evaluated at the start of each step and
+	 *             replace any preferred velocity set by the caller.
+	 * \param      agentNo         The number of the agent whose policy is to
+	 *                             be modified.
+	 * \param      policy          The replacement policy.
+	 */
+	void setAgentPrefVelocityPolicy(size_t agentNo, PrefVelocityPolicy policy);
+
 	/**
 	 * \brief      Sets the radius of a specified agent.
 	 * \param      agentNo         The number of the agent whose radius is to
@@ -625,6 +855,13 @@ class RVOSimulator {
 	 */
 	void setAgentVelocity(size_t agentNo, const Vector2& velocity);
 
+	/**
+	 * \brief      Sets the two-dimensional linear velocities of all agents.
+	 * \param      velocities      The x and y components of each agent in
+	 *                             turn, 2 * getNumAgents() floats.
+	 */
+	void setAgentVelocities(const float* velocities);
+
 	/**
 	 * \brief      Sets the time step of the simulation.
 	 * \param      timeStep        The time step of the simulation.
@@ -632,15 +869,107 @@ class RVOSimulator {
 	 */
 	void setTimeStep(float timeStep);
 
+	/**
+	 * \brief      Computes the velocity a specified agent would reach after
+	 *             one simulation step for each of a set of preferred
+	 *             velocities, all other agents being unchanged. The agent
+	 *             <i>k</i>d-tree, the neighbors and the ORCA lines of the agent
+	 *             are computed once, and the preferred velocities are then
+	 *             projected in batch onto the resulting feasible velocity
+	 *             region. Agrees with doStep() only up to floating point
+	 *             rounding and tie choice: where several feasible
+	 *             velocities are nearest to a preferred velocity, the
+	 *             projection may return another one than the linear
+	 *             program of doStep(). The simulation is not advanced.
+	 * \param      agentNo         The number of the agent to sweep.
+	 * \param      prefVelocities  The preferred velocities to evaluate.
+	 * \param      velocities      Receives the velocity after one step for
+	 *                             each preferred velocity.
+	 */
+	void sweepAgentPrefVelocities(size_t agentNo,
+	                              const std::vector<Vector2>& prefVelocities,
+	                              std::vector<Vector2>& velocities);
+
  private:
+	/**
+	 * \brief      Appends a new agent, reusing an agent instance freed by
+	 *             reset() when available.
+	 * \param      position        The two-dimensional starting position of
+	 *                             the new agent.
+	 * \param      radius          The radius of the new agent.
+	 * \param      maxSpeed        The maximum speed of the new agent.
+	 * \param      velocity        The initial two-dimensional linear
+	 *                             velocity of the new agent.
+	 * \return     A pointer to the new agent, with cleared neighbors and
+	 *             ORCA lines.
+	 */
+	Agent* newAgent(const Vector2& position, float radius, float maxSpeed,
+	                const Vector2& velocity);
+
+	/**
+	 * \brief      Returns the obstacle set of the simulation for editing,
+	 *             first replacing a set it does not own, or that is shared
+	 *             with another simulation, by a copy.
+	 */
+	ObstacleSet* editObstacleSet();
+
+	/**
+	 * \brief      Returns the number of obstacle neighbors agents reserve
+	 *             room for: every obstacle vertex, up to a bound.
+	 */
+	size_t maxReservedObstacleNeighbors() const;
+
+	/**
+	 * \brief      Reserves the neighbor and ORCA line lists of every agent.
+	 */
+	void reserveAgentNeighbors();
+
+	/**
+	 * \brief      Prepares the neighbor search of a step: decides whether
+	 *             the neighbor lists are rebuilt, and builds the agent
+	 *             <i>k</i>d-tree if it is queried.
+	 */
+	void prepareNeighbors();
+
+	/**
+	 * \brief      Computes the neighbors of an agent for the current step.
+	 * \param      agent           The agent whose neighbors are computed.
+	 */
+	void computeNeighbors(Agent* agent) const;
+
 	std::vector<Agent*> agents_;
 	Agent* defaultAgent_;
+	std::vector<Agent*> freeAgents_;
+
+	/*
+	 * Per-agent state read by the neighbor search and the ORCA line
+	 * computation, stored contiguously and indexed by agent number.
+	 */
+	std::vector<Vector2> agentPositions_;
+	std::vector<Vector2> agentVelocities_;
+	std::vector<Vector2> agentPrefVelocities_;
+	std::vector<float> agentRadii_;
+	std::vector<float> agentMaxSpeeds_;
+
+	float defaultMaxSpeed_;
+	float defaultRadius_;
+	Vector2 defaultVelocity_;
 	float globalTime_;
 	KdTree* kdTree_;
-	std::vector<Obstacle*> obstacles_;
+	std::shared_ptr<const ObstacleSet> obstacleSet_;
+	ObstacleSet* ownObstacleSet_;
 	float timeStep_;
 
+	/* Neighbor lists, positions are those the lists were built at. */
+	float neighborSkin_;
+	bool neighborListsValid_;
+	bool rebuildNeighborLists_;
+	std::vector<Vector2> neighborListPositions_;
+	size_t numNeighborListBuilds_;
+	size_t numNeighborListSteps_;
+
 	friend class Agent;
+	friend class BatchSimulator;
 	friend class KdTree;
 	friend class Obstacle;
 };
@@ -0,0 +1,88 @@
+/*
+ * TrajectoryBuffer.h
+ * RVO2 Library
+ *
+ * Copyright (c) 2015 RAD-UoE Informatics (MIT).
+ */
+
+#ifndef RVO_TRAJECTORY_BUFFER_H_
+#define RVO_TRAJECTORY_BUFFER_H_
+
+/**
+ * \file       TrajectoryBuffer.h
+ * \brief      Contains the TrajectoryBuffer class.
+ */
+
+#include "Definitions.h"
+
+namespace RVO {
+/**
+ * \brief      Defines a buffer of the positions of every agent of a
+ *             simulation after each of a number of steps, stored step after
+ *             step as interleaved x and y coordinates. Its storage is only
+ *             reallocated when a longer trajectory than before is recorded.
+ */
+class TrajectoryBuffer {
+ public:
+	/**
+	 * \brief      Constructs an empty trajectory buffer.
+	 */
+	TrajectoryBuffer();
+
+	/**
+	 * \brief      Allocates the buffer for a number of steps and agents, so
+	 *             that recording them does not allocate.
+	 * \param      numSteps        The number of steps.
+	 * \param      numAgents       The number of agents.
+	 */
+	void reserve(size_t numSteps, size_t numAgents);
+
+	/**
+	 * \brief      Sizes the buffer for a number of steps and agents, keeping
+	 *             its storage.
+	 * \param      numSteps        The number of steps.
+	 * \param      numAgents       The number of agents.
+	 */
+	void resize(size_t numSteps, size_t numAgents);
+
+	/**
+	 * \brief      Returns the number of steps in the buffer.
+	 */
+	size_t getNumSteps() const { return numSteps_; }
+
+	/**
+	 * \brief      Returns the number of agents in the buffer.
+	 */
+	size_t getNumAgents() const { return numAgents_; }
+
+	/**
+	 * \brief      Returns the position of an agent after a step.
+	 * \param      stepNo          The number of the step, from zero.
+	 * \param      agentNo         The number of the agent.
+	 */
+	const Vector2& getPosition(size_t stepNo, size_t agentNo) const {
+		return positions_[stepNo * numAgents_ + agentNo];
+	}
+
+	/**
+	 * \brief      Returns the positions of the agents after a step.
+	 * \param      stepNo          The number of the step, from zero.
+	 */
+	Vector2* getStep(size_t stepNo) {
+		return &positions_[stepNo * numAgents_];
+	}
+
+	/**
+	 * \brief      Returns the x and y coordinates of every agent after every
+	 *             step, 2 * getNumSteps() * getNumAgents() floats.
+	 */
+	const float* data() const;
+
+ private:
+	std::vector<Vector2> positions_;
+	size_t numSteps_;
+	size_t numAgents_;
+};
+}
+
+#endif /* RVO_TRAJECTORY_BUFFER_H_ */
@@ -11,9 +11,19 @@
 
 #include <ros/ros.h>
 
+#include <algorithm>
+#include <map>
+#include <vector>
+
 #include <rvo_wrapper/RVO.h>
+#include <rvo_wrapper/BatchSimulator.h>
 #include <rvo_wrapper/Definitions.h>
+#include <rvo_wrapper/ObstacleSet.h>
+#include <rvo_wrapper/TrajectoryBuffer.h>
 #include <rvo_wrapper/Vector2.h>
+#include <rvo_wrapper/scenario.hpp>
+#include <rvo_wrapper/sim_pool.hpp>
+#include <rvo_wrapper/thread_pool.hpp>
 
 #include <std_srvs/Empty.h>
 
@@ -24,6 +34,8 @@
 #include <rvo_wrapper_msgs/CreateRVOSim.h>
 #include <rvo_wrapper_msgs/DeleteSimVector.h>
 #include <rvo_wrapper_msgs/DoStep.h>
+#include <rvo_wrapper_msgs/DoSteps.h>
+#include <rvo_wrapper_msgs/ForkSim.h>
 #include <rvo_wrapper_msgs/GetAgentAgentNeighbor.h>
 #include <rvo_wrapper_msgs/GetAgentMaxNeighbors.h>
 #include <rvo_wrapper_msgs/GetAgentMaxSpeed.h>
@@ -34,6 +46,7 @@
 #include <rvo_wrapper_msgs/GetAgentPosition.h>
 #include <rvo_wrapper_msgs/GetAgentPrefVelocity.h>
 #include <rvo_wrapper_msgs/GetAgentRadius.h>
+#include <rvo_wrapper_msgs/GetAgentStates.h>
 #include <rvo_wrapper_msgs/GetAgentTimeHorizon.h>
 #include <rvo_wrapper_msgs/GetAgentTimeHorizonObst.h>
 #include <rvo_wrapper_msgs/GetAgentVelocity.h>
@@ -42,6 +55,7 @@
 #include <rvo_wrapper_msgs/GetTimeStep.h>
 #include <rvo_wrapper_msgs/ProcessObstacles.h>
 #include <rvo_wrapper_msgs/QueryVisibility.h>
+#include <rvo_wrapper_msgs/RunScenario.h>
 #include <rvo_wrapper_msgs/SetAgentDefaults.h>
 #include <rvo_wrapper_msgs/SetAgentGoals.h>
 #include <rvo_wrapper_msgs/SetAgentMaxNeighbors.h>
@@ -52,6 +66,7 @@
 #include <rvo_wrapper_msgs/SetAgentPosition.h>
 #include <rvo_wrapper_msgs/SetAgentPrefVelocity.h>
 #include <rvo_wrapper_msgs/SetAgentRadius.h>
+#include <rvo_wrapper_msgs/SetAgentStates.h>
 #include <rvo_wrapper_msgs/SetAgentTimeHorizon.h>
 #include <rvo_wrapper_msgs/SetAgentTimeHorizonObst.h>
 #include <rvo_wrapper_msgs/SetAgentVelocity.h>
@@ -87,6 +102,11 @@ class RVOWrapper {
 
   bool doStep(rvo_wrapper_msgs::DoStep::Request& req,
               rvo_wrapper_msgs::DoStep::Response& res);
+  bool doSteps(rvo_wrapper_msgs::DoSteps::Request& req,
+               rvo_wrapper_msgs::DoSteps::Response& res);
+
+  bool forkSim(rvo_wrapper_msgs::ForkSim::Request& req,
+               rvo_wrapper_msgs::ForkSim::Response& res);
 
   bool getAgentAgentNeighbor(
     rvo_wrapper_msgs::GetAgentAgentNeighbor::Request& req,
@@ -127,6 +147,9 @@ class RVOWrapper {
   bool getAgentRadius(
     rvo_wrapper_msgs::GetAgentRadius::Request& req,
     rvo_wrapper_msgs::GetAgentRadius::Response& res);
+  bool getAgentStates(
+    rvo_wrapper_msgs::GetAgentStates::Request& req,
+    rvo_wrapper_msgs::GetAgentStates::Response& res);
 
   bool getAgentTimeHorizon(
     rvo_wrapper_msgs::GetAgentTimeHorizon::Request& req,
@@ -160,6 +183,10 @@ class RVOWrapper {
     rvo_wrapper_msgs::QueryVisibility::Request& req,
     rvo_wrapper_msgs::QueryVisibility::Response& res);
 
+  bool runScenario(
+    rvo_wrapper_msgs::RunScenario::Request& req,
+    rvo_wrapper_msgs::RunScenario::Response& res);
+
   bool setAgentDefaults(
     rvo_wrapper_msgs::SetAgentDefaults::Request& req,
     rvo_wrapper_msgs::SetAgentDefaults::Response& res);
@@ -199,6 +226,9 @@ class RVOWrapper {
   bool setAgentRadius(
     rvo_wrapper_msgs::SetAgentRadius::Request& req,
     rvo_wrapper_msgs::SetAgentRadius::Response& res);
+  bool setAgentStates(
+    rvo_wrapper_msgs::SetAgentStates::Request& req,
+    rvo_wrapper_msgs::SetAgentStates::Response& res);
 
   bool setAgentTimeHorizon(
     rvo_wrapper_msgs::SetAgentTimeHorizon::Request& req,
@@ -217,14 +247,31 @@ class RVOWrapper {
     rvo_wrapper_msgs::SetTimeStep::Response& res);
 
  private:
+  // Checks sim_ids holds a first..last range of sim_vect_, which may only
+  // reach into batch worlds when the handler steps or edits them per world
+  bool goodSimRange(const std::vector<uint32_t>& sim_ids,
+                    bool batch_ok = false) const;
+
+  // Returns the batch holding the world of a sim id without its own sim
+  RVO::BatchSimulator* simBatch(uint32_t sim_id, size_t* world) const;
+
+  // Adds vertices, or processes obstacles when NULL, for sims first..last.
+  // Processed trees try max_split_candidates split lines per node, 0 all.
+  void editObstacleSets(uint32_t first_sim, uint32_t last_sim,
+                        const std::vector<RVO::Vector2>* vertices,
+                        size_t max_split_candidates = 0);
+
+  // Keeps the slowest build and deepest obstacle tree of sim in res
+  void addObstacleTreeStats(const RVO::RVOSimulator* sim,
+                            rvo_wrapper_msgs::ProcessObstacles::Response* res);
+
   // Flags
   bool planner_init_;
   bool debug_;
 
   // Variables
   RVO::Vector2 null_vect_;
-  std::vector<RVO::Vector2> planner_goals_;
-  std::vector< std::vector<RVO::Vector2> > sim_vect_goals_;
+  float neighbor_skin_;
 
   // ROS
   ros::NodeHandle* nh_;
@@ -235,6 +282,8 @@ class RVOWrapper {
   ros::ServiceServer srv_create_rvosim_;
   ros::ServiceServer srv_delete_sim_vector_;
   ros::ServiceServer srv_do_step_;
+  ros::ServiceServer srv_do_steps_;
+  ros::ServiceServer srv_fork_sim_;
   ros::ServiceServer srv_get_agent_agent_neighbor_;
   ros::ServiceServer srv_get_agent_max_neighbors_;
   ros::ServiceServer srv_get_agent_max_speed_;
@@ -245,6 +294,7 @@ class RVOWrapper {
   ros::ServiceServer srv_get_agent_position_;
   ros::ServiceServer srv_get_agent_pref_velocity_;
   ros::ServiceServer srv_get_agent_radius_;
+  ros::ServiceServer srv_get_agent_states_;
   ros::ServiceServer srv_get_agent_time_horizon_;
   ros::ServiceServer srv_get_agent_time_horizon_obst_;
   ros::ServiceServer srv_get_agent_velocity_;
@@ -253,6 +303,7 @@ class RVOWrapper {
   ros::ServiceServer srv_get_time_step_;
   ros::ServiceServer srv_process_obstacles_;
   ros::ServiceServer srv_query_visibility_;
+  ros::ServiceServer srv_run_scenario_;
   ros::ServiceServer srv_set_agent_defaults_;
   ros::ServiceServer srv_set_agent_goals_;
   ros::ServiceServer srv_set_agent_max_neighbors_;
@@ -263,6 +314,7 @@ class RVOWrapper {
   ros::ServiceServer srv_set_agent_position_;
   ros::ServiceServer srv_set_agent_pref_velocity_;
   ros::ServiceServer srv_set_agent_radius_;
+  ros::ServiceServer srv_set_agent_states_;
   ros::ServiceServer srv_set_agent_time_horizon_;
   ros::ServiceServer srv_set_agent_time_horizon_obst_;
   ros::ServiceServer srv_set_agent_velocity_;
@@ -270,7 +322,12 @@ class RVOWrapper {
 
   // Class pointers
   RVO::RVOSimulator* planner_;
-  std::vector<RVO::RVOSimulator*> sim_vect_;
+  std::vector<RVO::RVOSimulator*> sim_vect_;  // NULL for batch worlds
+  std::vector<RVO::BatchSimulator*> batch_vect_;
+  std::vector<uint32_t> batch_first_ids_;  // Sim id of each batch world 0
+  RVO::SimPool sim_pool_;
+  RVO::ScenarioRunner scenario_runner_;
+  RVO::ThreadPool* thread_pool_;
 };
 
 #endif /* RVO_WRAPPER_HPP */
@@ -0,0 +1,145 @@
+/**
+ * @file      scenario.hpp
+ * @brief     Goal inference scenarios run directly on the RVO library
+ * @author    agent <agent@local>
+ * @date      2026-10-16
+ * @copyright (MIT) 2015 RAD-UoE Informatics
+ */
+
+#ifndef SCENARIO_HPP
+#define SCENARIO_HPP
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <rvo_wrapper/BatchSimulator.h>
+#include <rvo_wrapper/RVOSimulator.h>
+#include <rvo_wrapper/sim_pool.hpp>
+#include <rvo_wrapper/thread_pool.hpp>
+#include <rvo_wrapper/Vector2.h>
+
+namespace RVO {
+  /**
+   * Scene shared by a batch of goal inference sims. One sim is run for every
+   * (model agent, goal) pair, where the model agent goal is replaced by the
+   * swept goal and every other agent keeps its entry in agent_goals. With
+   * batch set, multi-step sims are run as the worlds of one BatchSimulator.
+   */
+  struct Scenario {
+    Scenario();
+
+    float time_step;
+    float neighbor_dist;
+    size_t max_neighbors;
+    float time_horizon_agent;
+    float time_horizon_obst;
+    float radius;
+    float max_speed;
+    float max_accel;
+    float pref_speed;
+
+    std::vector<Vector2> positions;
+    std::vector<Vector2> velocities;
+    std::vector<Vector2> agent_goals;  // Null goal keeps current velocity
+    std::vector<size_t> model_agents;
+    std::vector<Vector2> goals;
+    size_t steps;
+    bool batch;
+  };
+
+  /** Agents per sim from which a single sim step is split across threads */
+  const size_t MIN_PARALLEL_AGENTS = 64;
+
+  /**
+   * Returns true when sims are best stepped one at a time with their agents
+   * spread over the threads, i.e. there are fewer sims than threads and each
+   * has enough agents to pay for the split. Otherwise whole sims are spread
+   * over the threads.
+   */
+  bool splitSimSteps(size_t sim_no, size_t agent_no,
+                     const ThreadPool& threads);
+
+  /**
+   * Steps sims [begin, end) once, in parallel across or within sims as
+   * splitSimSteps() picks. Steps serially without a thread pool.
+   */
+  void doSimSteps(const std::vector<RVOSimulator*>& sims, size_t begin,
+                  size_t end, ThreadPool* threads);
+
+  /**
+   * Returns true when no other agent is within the neighbour distance of a
+   * model agent. Scenarios have no obstacles, so its one step velocity is then
+   * its pref velocity clipped by the max speed and max acceleration.
+   */
+  bool interactionFree(const Scenario& scenario, size_t model_agent);
+
+  /**
+   * Velocity of an interaction free model agent after one step towards goal,
+   * as a sim of the scenario would compute it.
+   */
+  Vector2 freeGoalVelocity(const Scenario& scenario, size_t model_agent,
+                           const Vector2& goal);
+
+  /**
+   * Runs every sim of the scenario and stores the model agent velocities,
+   * model agent major, in velocities. One step scenarios sweep the goals of
+   * each model agent with RVOSimulator::sweepAgentPrefVelocities(), so they
+   * agree with stepping a sim per goal only up to rounding and tie choice.
+   * Sims are taken from and returned to pool when given, and run on threads
+   * when given. Returns false on an invalid scenario.
+   */
+  bool runScenario(const Scenario& scenario, std::vector<Vector2>* velocities,
+                   SimPool* pool = NULL, ThreadPool* threads = NULL);
+
+  /**
+   * Runs scenarios like runScenario(), keeping the sims alive between runs.
+   * While the sim parameters, agent number, model agents and number of steps
+   * hold, a run only pushes the agent positions and velocities into the kept
+   * sims, and sets the sim goals again only when they changed. Sims are
+   * copied from a scene sim filled once with the agents, and only when a
+   * model agent first needs one, so interaction free agents of one step
+   * scenarios never get one.
+   */
+  class ScenarioRunner {
+   public:
+    /** Sims are taken from and returned to pool when given */
+    explicit ScenarioRunner(SimPool* pool = NULL);
+    ~ScenarioRunner();
+
+    bool run(const Scenario& scenario, std::vector<Vector2>* velocities,
+             ThreadPool* threads = NULL);
+
+    /** Returns the kept sims to the pool */
+    void clear();
+
+    /** Times the scene sim was built from scratch */
+    size_t numBuilds() const { return builds_; }
+
+   private:
+    ScenarioRunner(const ScenarioRunner& other);
+    ScenarioRunner& operator=(const ScenarioRunner& other);
+
+    bool sameSims(const Scenario& scenario, size_t sim_no) const;
+    void buildScene(const Scenario& scenario);
+    // Takes an empty sim from the pool, to be copied from the scene sim
+    RVOSimulator* acquireSim(const Scenario& scenario);
+    // Copies the scene into an empty sim and pushes the agent states
+    void prepareSim(RVOSimulator* sim) const;
+
+    Scenario scenario_;  // Last scenario run on the sims
+    RVOSimulator* scene_;  // NULL until a sim is needed
+    std::vector<RVOSimulator*> sims_;  // NULL until their agent needs one
+    BatchSimulator batch_;  // Worlds set from the scene sim
+    std::vector<uint8_t> free_agents_;  // Interaction free model agents
+    std::vector<std::vector<Vector2> > pref_vels_;  // Goal sweeps per thread
+    std::vector<std::vector<Vector2> > goal_vels_;
+    std::vector<float> positions_;  // Flat agent states pushed into the sims
+    std::vector<float> velocities_;
+    SimPool own_pool_;
+    SimPool* pool_;
+    size_t builds_;
+  };
+}
+
+#endif  /* SCENARIO_HPP */
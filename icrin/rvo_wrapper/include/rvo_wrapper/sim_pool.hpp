@@ -0,0 +1,45 @@
+/**
+ * @file      sim_pool.hpp
+ * @brief     Pool of reusable RVO simulators
+ * @author    agent <agent@local>
+ * @date      2026-10-16
+ * @copyright (MIT) 2015 RAD-UoE Informatics
+ */
+
+#ifndef SIM_POOL_HPP
+#define SIM_POOL_HPP
+
+#include <vector>
+
+#include <rvo_wrapper/RVOSimulator.h>
+
+namespace RVO {
+  /**
+   * Keeps released simulators alive so that the next batch of sims reuses
+   * their agents and kd-tree storage instead of reallocating it.
+   */
+  class SimPool {
+   public:
+    SimPool();
+    ~SimPool();
+
+    /**
+     * Returns a reset simulator from the pool, or a new one if it is empty.
+     * Acquired sims have no agents, callers set their time step and agent
+     * defaults. The caller owns the simulator until it is released.
+     */
+    RVOSimulator* acquire();
+
+    void release(RVOSimulator* sim);
+
+    size_t size() const { return sims_.size(); }
+
+   private:
+    SimPool(const SimPool& other);
+    SimPool& operator=(const SimPool& other);
+
+    std::vector<RVOSimulator*> sims_;
+  };
+}
+
+#endif  /* SIM_POOL_HPP */
@@ -0,0 +1,76 @@
+/**
+ * @file      thread_pool.hpp
+ * @brief     Persistent worker threads for parallel simulation loops
+ * @author    agent <agent@local>
+ * @date      2026-10-16
+ * @copyright (MIT) 2015 RAD-UoE Informatics
+ */
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RVO {
+  /**
+   * Worker threads started once and woken for every parallel loop, so a
+   * simulation step does not pay for spawning threads. The calling thread
+   * takes part in each loop. Loops must be issued from one thread at a time.
+   */
+  class ThreadPool {
+   public:
+    /** Runs items [begin, end) of a loop on the given thread number */
+    typedef std::function<void(size_t begin, size_t end, size_t thread)> Task;
+
+    /**
+     * Starts num_threads - 1 workers. Zero uses one thread per hardware
+     * thread.
+     */
+    explicit ThreadPool(size_t num_threads = 0);
+    ~ThreadPool();
+
+    /** Number of threads running a loop, the calling thread included */
+    size_t numThreads() const { return workers_.size() + 1; }
+
+    /**
+     * Splits [0, count) into chunks handed out to the threads as they become
+     * free, and returns once every chunk has run. Thread numbers are below
+     * numThreads(), so tasks can index per-thread scratch with them.
+     */
+    void parallelFor(size_t count, const Task& task);
+
+    /**
+     * Runs task once on every thread, the calling thread included, with its
+     * thread number. Used to set up per-thread scratch before a loop.
+     */
+    void forEachThread(const std::function<void(size_t thread)>& task);
+
+   private:
+    ThreadPool(const ThreadPool& other);
+    ThreadPool& operator=(const ThreadPool& other);
+
+    void workerLoop(size_t thread);
+    void runChunks(size_t thread);
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    bool stop_;
+    size_t generation_;
+    size_t active_;
+
+    const Task* task_;
+    size_t count_;
+    size_t chunk_;
+    std::atomic<size_t> next_;
+  };
+}
+
+#endif  /* THREAD_POOL_HPP */
@@ -56,18 +56,41 @@
 
 #include "rvo_wrapper/Agent.h"
 
+#include <algorithm>
+
 #include "rvo_wrapper/KdTree.h"
 #include "rvo_wrapper/Obstacle.h"
 
 namespace RVO {
-Agent::Agent(RVOSimulator* sim) : maxNeighbors_(0), maxSpeed_(0.0f),
-	neighborDist_(0.0f), radius_(0.0f), sim_(sim), timeHorizon_(0.0f),
-	timeHorizonObst_(0.0f), maxAccel_(0.0f), prefSpeed_(0.0f), id_(0) {
+Agent::Agent(RVOSimulator* sim) : maxNeighbors_(0),
+	neighborDist_(0.0f), sim_(sim), timeHorizon_(0.0f),
+	timeHorizonObst_(0.0f), maxAccel_(0.0f), prefSpeed_(0.0f),
+	prefVelocityPolicy_(PREF_VELOCITY_MANUAL), id_(0), numObstLines_(0) {
+}
+
+void Agent::copyParameters(const Agent& other) {
+	maxNeighbors_ = other.maxNeighbors_;
+	agentNeighbors_.reserve(maxNeighbors_);
+	neighborDist_ = other.neighborDist_;
+	timeHorizon_ = other.timeHorizon_;
+	timeHorizonObst_ = other.timeHorizonObst_;
+	maxAccel_ = other.maxAccel_;
+	prefSpeed_ = other.prefSpeed_;
+	goal_ = other.goal_;
+	prefVelocityPolicy_ = other.prefVelocityPolicy_;
+}
+
+void Agent::reserveNeighbors(size_t maxObstacleNeighbors) {
+	agentNeighbors_.reserve(maxNeighbors_);
+	obstacleNeighbors_.reserve(maxObstacleNeighbors);
+	obstacleCandidates_.reserve(maxObstacleNeighbors);
+	orcaLines_.reserve(maxObstacleNeighbors + maxNeighbors_);
 }
 
 void Agent::computeNeighbors() {
 	obstacleNeighbors_.clear();
-	float rangeSq = sqr(timeHorizonObst_ * maxSpeed_ + radius_);
+	float rangeSq = sqr(timeHorizonObst_ * sim_->agentMaxSpeeds_[id_] +
+	                    sim_->agentRadii_[id_]);
 	sim_->kdTree_->computeObstacleNeighbors(this, rangeSq);
 
 	agentNeighbors_.clear();
@@ -75,23 +98,133 @@ void Agent::computeNeighbors() {
 	if (maxNeighbors_ > 0) {
 		rangeSq = sqr(neighborDist_);
 		sim_->kdTree_->computeAgentNeighbors(this, rangeSq);
+		std::sort_heap(agentNeighbors_.begin(), agentNeighbors_.end());
+	}
+}
+
+void Agent::computeNeighborCandidates(float skin) {
+	obstacleCandidates_.clear();
+	const float obstRange = timeHorizonObst_ * sim_->agentMaxSpeeds_[id_] +
+	                        sim_->agentRadii_[id_];
+	sim_->kdTree_->computeObstacleCandidates(this, sqr(obstRange + skin));
+
+	agentCandidates_.clear();
+
+	if (maxNeighbors_ > 0) {
+		sim_->kdTree_->computeAgentCandidates(this, sqr(neighborDist_ + skin));
+	}
+}
+
+void Agent::computeListedNeighbors() {
+	const Vector2 position = sim_->agentPositions_[id_];
+
+	obstacleNeighbors_.clear();
+	float rangeSq = sqr(timeHorizonObst_ * sim_->agentMaxSpeeds_[id_] +
+	                    sim_->agentRadii_[id_]);
+
+	for (size_t i = 0; i < obstacleCandidates_.size(); ++i) {
+		const Obstacle* const obstacle = obstacleCandidates_[i];
+		const Vector2& point1 = obstacle->point_;
+		const Vector2& point2 = obstacle->nextObstacle_->point_;
+		const float agentLeftOfLine = leftOf(point1, point2, position);
+
+		/* The tests the obstacle tree query applies at the obstacle node. */
+		if (agentLeftOfLine < 0.0f &&
+		    sqr(agentLeftOfLine) / absSq(point2 - point1) < rangeSq) {
+			insertObstacleNeighbor(obstacle, rangeSq);
+		}
+	}
+
+	agentNeighbors_.clear();
+
+	if (maxNeighbors_ > 0) {
+		rangeSq = sqr(neighborDist_);
+
+		for (size_t i = 0; i < agentCandidates_.size(); ++i) {
+			insertAgentNeighbor(agentCandidates_[i], rangeSq);
+		}
+
+		std::sort_heap(agentNeighbors_.begin(), agentNeighbors_.end());
 	}
 }
 
 /* Search for the best new velocity. */
 void Agent::computeNewVelocity() {
+	computeORCALines();
+	newVelocity_ = solveVelocity(sim_->agentPrefVelocities_[id_]);
+}
+
+void Agent::computeGoalPrefVelocity() {
+	if (goal_ != Vector2()) {
+		Vector2 goalVector = goal_ - sim_->agentPositions_[id_];
+
+		if (absSq(goalVector) > 1.0f) {
+			goalVector = normalize(goalVector);
+		}
+
+		sim_->agentPrefVelocities_[id_] = prefSpeed_ * goalVector;
+	} else {
+		/* Agents without a goal keep their current velocity. */
+		sim_->agentPrefVelocities_[id_] = sim_->agentVelocities_[id_];
+	}
+}
+
+void Agent::computePrefVelocity() {
+	switch (prefVelocityPolicy_) {
+	case PREF_VELOCITY_GOAL:
+		computeGoalPrefVelocity();
+		break;
+	case PREF_VELOCITY_KEEP:
+		sim_->agentPrefVelocities_[id_] = sim_->agentVelocities_[id_];
+		break;
+	default:
+		break;
+	}
+}
+
+/* Create the ORCA lines of the current neighbors. */
+void Agent::computeORCALines() {
 	orcaLines_.clear();
 
-	const float invTimeHorizonObst = 1.0f / timeHorizonObst_;
+	const Vector2 position = sim_->agentPositions_[id_];
+	const Vector2 velocity = sim_->agentVelocities_[id_];
+	const float radius = sim_->agentRadii_[id_];
+
+	computeObstacleORCALines(obstacleNeighbors_, position, velocity, radius,
+	                         timeHorizonObst_, orcaLines_);
+
+	numObstLines_ = orcaLines_.size();
+
+	const float invTimeHorizon = 1.0f / timeHorizon_;
+
+	/* Create agent ORCA lines. */
+	for (size_t i = 0; i < agentNeighbors_.size(); ++i) {
+		const size_t other = agentNeighbors_[i].second;
+
+		orcaLines_.push_back(computeAgentORCALine(
+		                       sim_->agentPositions_[other] - position, velocity,
+		                       velocity - sim_->agentVelocities_[other],
+		                       radius + sim_->agentRadii_[other], invTimeHorizon,
+		                       sim_->timeStep_));
+	}
+}
+
+/* Create the obstacle ORCA lines of an agent. */
+void Agent::computeObstacleORCALines(const std::vector<std::pair<float,
+                                     const Obstacle*> >& obstacleNeighbors,
+                                     const Vector2& position,
+                                     const Vector2& velocity, float radius,
+                                     float timeHorizonObst,
+                                     std::vector<Line>& lines) {
+	const float invTimeHorizonObst = 1.0f / timeHorizonObst;
 
-	/* Create obstacle ORCA lines. */
-	for (size_t i = 0; i < obstacleNeighbors_.size(); ++i) {
+	for (size_t i = 0; i < obstacleNeighbors.size(); ++i) {
 
-		const Obstacle* obstacle1 = obstacleNeighbors_[i].second;
+		const Obstacle* obstacle1 = obstacleNeighbors[i].second;
 		const Obstacle* obstacle2 = obstacle1->nextObstacle_;
 
-		const Vector2 relativePosition1 = obstacle1->point_ - position_;
-		const Vector2 relativePosition2 = obstacle2->point_ - position_;
+		const Vector2 relativePosition1 = obstacle1->point_ - position;
+		const Vector2 relativePosition2 = obstacle2->point_ - position;
 
 		/*
 		 * Check if velocity obstacle of obstacle is already taken care of by
@@ -99,11 +232,11 @@ void Agent::computeNewVelocity() {
 		 */
 		bool alreadyCovered = false;
 
-		for (size_t j = 0; j < orcaLines_.size(); ++j) {
-			if (det(invTimeHorizonObst * relativePosition1 - orcaLines_[j].point,
-			        orcaLines_[j].direction) - invTimeHorizonObst * radius_ >= -RVO_EPSILON &&
-			    det(invTimeHorizonObst * relativePosition2 - orcaLines_[j].point,
-			        orcaLines_[j].direction) - invTimeHorizonObst * radius_ >=  -RVO_EPSILON) {
+		for (size_t j = 0; j < lines.size(); ++j) {
+			if (det(invTimeHorizonObst * relativePosition1 - lines[j].point,
+			        lines[j].direction) - invTimeHorizonObst * radius >= -RVO_EPSILON &&
+			    det(invTimeHorizonObst * relativePosition2 - lines[j].point,
+			        lines[j].direction) - invTimeHorizonObst * radius >=  -RVO_EPSILON) {
 				alreadyCovered = true;
 				break;
 			}
@@ -118,7 +251,7 @@ void Agent::computeNewVelocity() {
 		const float distSq1 = absSq(relativePosition1);
 		const float distSq2 = absSq(relativePosition2);
 
-		const float radiusSq = sqr(radius_);
+		const float radiusSq = sqr(radius);
 
 		const Vector2 obstacleVector = obstacle2->point_ - obstacle1->point_;
 		const float s = (-relativePosition1 * obstacleVector) / absSq(obstacleVector);
@@ -132,7 +265,7 @@ void Agent::computeNewVelocity() {
 				line.point = Vector2(0.0f, 0.0f);
 				line.direction = normalize(Vector2(-relativePosition1.y(),
 				                                   relativePosition1.x()));
-				orcaLines_.push_back(line);
+				lines.push_back(line);
 			}
 
 			continue;
@@ -144,7 +277,7 @@ void Agent::computeNewVelocity() {
 				line.point = Vector2(0.0f, 0.0f);
 				line.direction = normalize(Vector2(-relativePosition2.y(),
 				                                   relativePosition2.x()));
-				orcaLines_.push_back(line);
+				lines.push_back(line);
 			}
 
 			continue;
@@ -152,7 +285,7 @@ void Agent::computeNewVelocity() {
 			/* Collision with obstacle segment. */
 			line.point = Vector2(0.0f, 0.0f);
 			line.direction = -obstacle1->unitDir_;
-			orcaLines_.push_back(line);
+			lines.push_back(line);
 			continue;
 		}
 
@@ -178,10 +311,10 @@ void Agent::computeNewVelocity() {
 
 			const float leg1 = std::sqrt(distSq1 - radiusSq);
 			leftLegDirection = Vector2(relativePosition1.x() * leg1 - relativePosition1.y()
-			                           * radius_, relativePosition1.x() * radius_ + relativePosition1.y() * leg1) /
+			                           * radius, relativePosition1.x() * radius + relativePosition1.y() * leg1) /
 			                   distSq1;
 			rightLegDirection = Vector2(relativePosition1.x() * leg1 + relativePosition1.y()
-			                            * radius_, -relativePosition1.x() * radius_ + relativePosition1.y() * leg1) /
+			                            * radius, -relativePosition1.x() * radius + relativePosition1.y() * leg1) /
 			                    distSq1;
 		} else if (s > 1.0f && distSqLine <= radiusSq) {
 			/*
@@ -197,17 +330,17 @@ void Agent::computeNewVelocity() {
 
 			const float leg2 = std::sqrt(distSq2 - radiusSq);
 			leftLegDirection = Vector2(relativePosition2.x() * leg2 - relativePosition2.y()
-			                           * radius_, relativePosition2.x() * radius_ + relativePosition2.y() * leg2) /
+			                           * radius, relativePosition2.x() * radius + relativePosition2.y() * leg2) /
 			                   distSq2;
 			rightLegDirection = Vector2(relativePosition2.x() * leg2 + relativePosition2.y()
-			                            * radius_, -relativePosition2.x() * radius_ + relativePosition2.y() * leg2) /
+			                            * radius, -relativePosition2.x() * radius + relativePosition2.y() * leg2) /
 			                    distSq2;
 		} else {
 			/* Usual situation. */
 			if (obstacle1->isConvex_) {
 				const float leg1 = std::sqrt(distSq1 - radiusSq);
 				leftLegDirection = Vector2(relativePosition1.x() * leg1 - relativePosition1.y()
-				                           * radius_, relativePosition1.x() * radius_ + relativePosition1.y() * leg1) /
+				                           * radius, relativePosition1.x() * radius + relativePosition1.y() * leg1) /
 				                   distSq1;
 			} else {
 				/* Left vertex non-convex; left leg extends cut-off line. */
@@ -217,7 +350,7 @@ void Agent::computeNewVelocity() {
 			if (obstacle2->isConvex_) {
 				const float leg2 = std::sqrt(distSq2 - radiusSq);
 				rightLegDirection = Vector2(relativePosition2.x() * leg2 + relativePosition2.y()
-				                            * radius_, -relativePosition2.x() * radius_ + relativePosition2.y() * leg2) /
+				                            * radius, -relativePosition2.x() * radius + relativePosition2.y() * leg2) /
 				                    distSq2;
 			} else {
 				/* Right vertex non-convex; right leg extends cut-off line. */
@@ -251,35 +384,35 @@ void Agent::computeNewVelocity() {
 		}
 
 		/* Compute cut-off centers. */
-		const Vector2 leftCutoff = invTimeHorizonObst * (obstacle1->point_ - position_);
+		const Vector2 leftCutoff = invTimeHorizonObst * (obstacle1->point_ - position);
 		const Vector2 rightCutoff = invTimeHorizonObst * (obstacle2->point_ -
-		                                                  position_);
+		                                                  position);
 		const Vector2 cutoffVec = rightCutoff - leftCutoff;
 
 		/* Project current velocity on velocity obstacle. */
 
 		/* Check if current velocity is projected on cutoff circles. */
-		const float t = (obstacle1 == obstacle2 ? 0.5f : ((velocity_ - leftCutoff) *
+		const float t = (obstacle1 == obstacle2 ? 0.5f : ((velocity - leftCutoff) *
 		                                                  cutoffVec) / absSq(cutoffVec));
-		const float tLeft = ((velocity_ - leftCutoff) * leftLegDirection);
-		const float tRight = ((velocity_ - rightCutoff) * rightLegDirection);
+		const float tLeft = ((velocity - leftCutoff) * leftLegDirection);
+		const float tRight = ((velocity - rightCutoff) * rightLegDirection);
 
 		if ((t < 0.0f && tLeft < 0.0f) || (obstacle1 == obstacle2 && tLeft < 0.0f &&
 		                                   tRight < 0.0f)) {
 			/* Project on left cut-off circle. */
-			const Vector2 unitW = normalize(velocity_ - leftCutoff);
+			const Vector2 unitW = normalize(velocity - leftCutoff);
 
 			line.direction = Vector2(unitW.y(), -unitW.x());
-			line.point = leftCutoff + radius_ * invTimeHorizonObst * unitW;
-			orcaLines_.push_back(line);
+			line.point = leftCutoff + radius * invTimeHorizonObst * unitW;
+			lines.push_back(line);
 			continue;
 		} else if (t > 1.0f && tRight < 0.0f) {
 			/* Project on right cut-off circle. */
-			const Vector2 unitW = normalize(velocity_ - rightCutoff);
+			const Vector2 unitW = normalize(velocity - rightCutoff);
 
 			line.direction = Vector2(unitW.y(), -unitW.x());
-			line.point = rightCutoff + radius_ * invTimeHorizonObst * unitW;
-			orcaLines_.push_back(line);
+			line.point = rightCutoff + radius * invTimeHorizonObst * unitW;
+			lines.push_back(line);
 			continue;
 		}
 
@@ -289,20 +422,20 @@ void Agent::computeNewVelocity() {
 		 */
 		const float distSqCutoff = ((t < 0.0f || t > 1.0f ||
 		                             obstacle1 == obstacle2) ? std::numeric_limits<float>::infinity() : absSq(
-		                              velocity_ - (leftCutoff + t * cutoffVec)));
+		                              velocity - (leftCutoff + t * cutoffVec)));
 		const float distSqLeft = ((tLeft < 0.0f) ?
-		                          std::numeric_limits<float>::infinity() : absSq(velocity_ -
+		                          std::numeric_limits<float>::infinity() : absSq(velocity -
 		                                                                         (leftCutoff + tLeft * leftLegDirection)));
 		const float distSqRight = ((tRight < 0.0f) ?
-		                           std::numeric_limits<float>::infinity() : absSq(velocity_ -
+		                           std::numeric_limits<float>::infinity() : absSq(velocity -
 		                                                                          (rightCutoff + tRight * rightLegDirection)));
 
 		if (distSqCutoff <= distSqLeft && distSqCutoff <= distSqRight) {
 			/* Project on cut-off line. */
 			line.direction = -obstacle1->unitDir_;
-			line.point = leftCutoff + radius_ * invTimeHorizonObst * Vector2(
+			line.point = leftCutoff + radius * invTimeHorizonObst * Vector2(
 			               -line.direction.y(), line.direction.x());
-			orcaLines_.push_back(line);
+			lines.push_back(line);
 			continue;
 		} else if (distSqLeft <= distSqRight) {
 			/* Project on left leg. */
@@ -311,9 +444,9 @@ void Agent::computeNewVelocity() {
 			}
 
 			line.direction = leftLegDirection;
-			line.point = leftCutoff + radius_ * invTimeHorizonObst * Vector2(
+			line.point = leftCutoff + radius * invTimeHorizonObst * Vector2(
 			               -line.direction.y(), line.direction.x());
-			orcaLines_.push_back(line);
+			lines.push_back(line);
 			continue;
 		} else {
 			/* Project on right leg. */
@@ -322,147 +455,171 @@ void Agent::computeNewVelocity() {
 			}
 
 			line.direction = -rightLegDirection;
-			line.point = rightCutoff + radius_ * invTimeHorizonObst * Vector2(
+			line.point = rightCutoff + radius * invTimeHorizonObst * Vector2(
 			               -line.direction.y(), line.direction.x());
-			orcaLines_.push_back(line);
+			lines.push_back(line);
 			continue;
 		}
 	}
+}
 
-	const size_t numObstLines = orcaLines_.size();
-
-	const float invTimeHorizon = 1.0f / timeHorizon_;
-
-	/* Create agent ORCA lines. */
-	for (size_t i = 0; i < agentNeighbors_.size(); ++i) {
-		const Agent* const other = agentNeighbors_[i].second;
-
-		const Vector2 relativePosition = other->position_ - position_;
-		const Vector2 relativeVelocity = velocity_ - other->velocity_;
-		const float distSq = absSq(relativePosition);
-		const float combinedRadius = radius_ + other->radius_;
-		const float combinedRadiusSq = sqr(combinedRadius);
-
-		Line line;
-		Vector2 u;
-
-		if (distSq > combinedRadiusSq) {
-			/* No collision. */
-			const Vector2 w = relativeVelocity - invTimeHorizon * relativePosition;
-			/* Vector from cutoff center to relative velocity. */
-			const float wLengthSq = absSq(w);
-
-			const float dotProduct1 = w * relativePosition;
-
-			if (dotProduct1 < 0.0f && sqr(dotProduct1) > combinedRadiusSq * wLengthSq) {
-				/* Project on cut-off circle. */
-				const float wLength = std::sqrt(wLengthSq);
-				const Vector2 unitW = w / wLength;
+/* Create the ORCA line of an agent for one neighbor. */
+Line Agent::computeAgentORCALine(const Vector2& relativePosition,
+                                 const Vector2& velocity,
+                                 const Vector2& relativeVelocity,
+                                 float combinedRadius, float invTimeHorizon,
+                                 float timeStep) {
+	const float distSq = absSq(relativePosition);
+	const float combinedRadiusSq = sqr(combinedRadius);
+
+	Line line;
+	Vector2 u;
+
+	if (distSq > combinedRadiusSq) {
+		/* No collision. */
+		const Vector2 w = relativeVelocity - invTimeHorizon * relativePosition;
+		/* Vector from cutoff center to relative velocity. */
+		const float wLengthSq = absSq(w);
+
+		const float dotProduct1 = w * relativePosition;
+
+		if (dotProduct1 < 0.0f && sqr(dotProduct1) > combinedRadiusSq * wLengthSq) {
+			/* Project on cut-off circle. */
+			const float wLength = std::sqrt(wLengthSq);
+			const Vector2 unitW = w / wLength;
 
-				line.direction = Vector2(unitW.y(), -unitW.x());
-				u = (combinedRadius * invTimeHorizon - wLength) * unitW;
+			line.direction = Vector2(unitW.y(), -unitW.x());
+			u = (combinedRadius * invTimeHorizon - wLength) * unitW;
+		} else {
+			/* Project on legs. */
+			const float leg = std::sqrt(distSq - combinedRadiusSq);
+
+			if (det(relativePosition, w) > 0.0f) {
+				/* Project on left leg. */
+				line.direction = Vector2(relativePosition.x() * leg - relativePosition.y() *
+				                         combinedRadius, relativePosition.x() * combinedRadius + relativePosition.y() *
+				                         leg) / distSq;
 			} else {
-				/* Project on legs. */
-				const float leg = std::sqrt(distSq - combinedRadiusSq);
-
-				if (det(relativePosition, w) > 0.0f) {
-					/* Project on left leg. */
-					line.direction = Vector2(relativePosition.x() * leg - relativePosition.y() *
-					                         combinedRadius, relativePosition.x() * combinedRadius + relativePosition.y() *
-					                         leg) / distSq;
-				} else {
-					/* Project on right leg. */
-					line.direction = -Vector2(relativePosition.x() * leg + relativePosition.y() *
-					                          combinedRadius, -relativePosition.x() * combinedRadius + relativePosition.y() *
-					                          leg) / distSq;
-				}
-
-				const float dotProduct2 = relativeVelocity * line.direction;
-
-				u = dotProduct2 * line.direction - relativeVelocity;
+				/* Project on right leg. */
+				line.direction = -Vector2(relativePosition.x() * leg + relativePosition.y() *
+				                          combinedRadius, -relativePosition.x() * combinedRadius + relativePosition.y() *
+				                          leg) / distSq;
 			}
-		} else {
-			/* Collision. Project on cut-off circle of time timeStep. */
-			const float invTimeStep = 1.0f / sim_->timeStep_;
 
-			/* Vector from cutoff center to relative velocity. */
-			const Vector2 w = relativeVelocity - invTimeStep * relativePosition;
+			const float dotProduct2 = relativeVelocity * line.direction;
 
-			const float wLength = abs(w);
-			const Vector2 unitW = w / wLength;
-
-			line.direction = Vector2(unitW.y(), -unitW.x());
-			u = (combinedRadius * invTimeStep - wLength) * unitW;
+			u = dotProduct2 * line.direction - relativeVelocity;
 		}
+	} else {
+		/* Collision. Project on cut-off circle of time timeStep. */
+		const float invTimeStep = 1.0f / timeStep;
 
-		line.point = velocity_ + 0.5f * u;
-		orcaLines_.push_back(line);
-	}
+		/* Vector from cutoff center to relative velocity. */
+		const Vector2 w = relativeVelocity - invTimeStep * relativePosition;
 
-	size_t lineFail = linearProgram2(orcaLines_, maxSpeed_, prefVelocity_, false,
-	                                 newVelocity_);
+		const float wLength = abs(w);
+		const Vector2 unitW = w / wLength;
 
-	if (lineFail < orcaLines_.size()) {
-		linearProgram3(orcaLines_, numObstLines, lineFail, maxSpeed_, newVelocity_);
+		line.direction = Vector2(unitW.y(), -unitW.x());
+		u = (combinedRadius * invTimeStep - wLength) * unitW;
 	}
+
+	line.point = velocity + 0.5f * u;
+	return line;
 }
 
-void Agent::insertAgentNeighbor(const Agent* agent, float& rangeSq) {
-	if (this != agent) {
-		const float distSq = absSq(position_ - agent->position_);
+Vector2 Agent::solveVelocity(const Vector2& prefVelocity) const {
+	Vector2 result;
+	const float maxSpeed = sim_->agentMaxSpeeds_[id_];
+	size_t lineFail = linearProgram2(orcaLines_, maxSpeed, prefVelocity, false,
+	                                 result);
 
-		if (distSq < rangeSq) {
-			if (agentNeighbors_.size() < maxNeighbors_) {
-				agentNeighbors_.push_back(std::make_pair(distSq, agent));
-			}
+	if (lineFail < orcaLines_.size()) {
+		linearProgram3(orcaLines_, numObstLines_, lineFail, maxSpeed, result);
+	}
 
-			size_t i = agentNeighbors_.size() - 1;
+	return result;
+}
 
-			while (i != 0 && distSq < agentNeighbors_[i - 1].first) {
-				agentNeighbors_[i] = agentNeighbors_[i - 1];
-				--i;
-			}
+void Agent::insertAgentNeighbor(size_t agentNo, float& rangeSq) {
+	if (id_ != agentNo) {
+		const float distSq = absSq(sim_->agentPositions_[id_] -
+		                           sim_->agentPositions_[agentNo]);
 
-			agentNeighbors_[i] = std::make_pair(distSq, agent);
+		insertAgentNeighbor(agentNeighbors_, maxNeighbors_,
+		                    std::make_pair(distSq, agentNo), rangeSq);
+	}
+}
 
-			if (agentNeighbors_.size() == maxNeighbors_) {
-				rangeSq = agentNeighbors_.back().first;
+void Agent::insertAgentNeighbor(std::vector<std::pair<float, size_t> >&
+                                agentNeighbors, size_t maxNeighbors,
+                                const std::pair<float, size_t>& neighbor,
+                                float& rangeSq) {
+	if (agentNeighbors.size() < maxNeighbors) {
+		if (neighbor.first < rangeSq) {
+			agentNeighbors.push_back(neighbor);
+			std::push_heap(agentNeighbors.begin(), agentNeighbors.end());
+
+			if (agentNeighbors.size() == maxNeighbors) {
+				rangeSq = agentNeighbors.front().first;
 			}
 		}
+	} else if (neighbor < agentNeighbors.front()) {
+		/* Replace the furthest neighbor, which is at the top. */
+		std::pop_heap(agentNeighbors.begin(), agentNeighbors.end());
+		agentNeighbors.back() = neighbor;
+		std::push_heap(agentNeighbors.begin(), agentNeighbors.end());
+		rangeSq = agentNeighbors.front().first;
 	}
 }
 
 void Agent::insertObstacleNeighbor(const Obstacle* obstacle, float rangeSq) {
+	insertObstacleNeighbor(obstacleNeighbors_, obstacle,
+	                       sim_->agentPositions_[id_], rangeSq);
+}
+
+void Agent::insertObstacleNeighbor(std::vector<std::pair<float,
+                                   const Obstacle*> >& obstacleNeighbors,
+                                   const Obstacle* obstacle,
+                                   const Vector2& position, float rangeSq) {
 	const Obstacle* const nextObstacle = obstacle->nextObstacle_;
 
 	const float distSq = distSqPointLineSegment(obstacle->point_,
-	                                            nextObstacle->point_, position_);
+	                                            nextObstacle->point_, position);
 
 	if (distSq < rangeSq) {
-		obstacleNeighbors_.push_back(std::make_pair(distSq, obstacle));
+		obstacleNeighbors.push_back(std::make_pair(distSq, obstacle));
 
-		size_t i = obstacleNeighbors_.size() - 1;
+		size_t i = obstacleNeighbors.size() - 1;
 
-		while (i != 0 && distSq < obstacleNeighbors_[i - 1].first) {
-			obstacleNeighbors_[i] = obstacleNeighbors_[i - 1];
+		while (i != 0 && (distSq < obstacleNeighbors[i - 1].first ||
+		                  (distSq == obstacleNeighbors[i - 1].first &&
+		                   obstacle->id_ < obstacleNeighbors[i - 1].second->id_))) {
+			obstacleNeighbors[i] = obstacleNeighbors[i - 1];
 			--i;
 		}
 
-		obstacleNeighbors_[i] = std::make_pair(distSq, obstacle);
+		obstacleNeighbors[i] = std::make_pair(distSq, obstacle);
 	}
 }
 
 void Agent::update() {
-	const float dv = abs(newVelocity_ - velocity_);
+	Vector2& velocity = sim_->agentVelocities_[id_];
+	velocity = acceleratedVelocity(newVelocity_);
+	sim_->agentPositions_[id_] += velocity * sim_->timeStep_;
+}
+
+Vector2 Agent::acceleratedVelocity(const Vector2& newVelocity) const {
+	const Vector2& velocity = sim_->agentVelocities_[id_];
+	const float dv = abs(newVelocity - velocity);
 
 	if (dv < maxAccel_ * sim_->timeStep_) {
-		velocity_ = newVelocity_;
-	} else {
-		velocity_ = (1.0f - (maxAccel_ * sim_->timeStep_ / dv))
-		            * velocity_ + (maxAccel_ * sim_->timeStep_ / dv)
-		            * newVelocity_;
+		return newVelocity;
 	}
-	position_ += velocity_ * sim_->timeStep_;
+
+	return (1.0f - (maxAccel_ * sim_->timeStep_ / dv))
+	       * velocity + (maxAccel_ * sim_->timeStep_ / dv)
+	       * newVelocity;
 }
 
 bool linearProgram1(const std::vector<Line>& lines, size_t lineNo, float radius,
@@ -565,6 +722,9 @@ size_t linearProgram2(const std::vector<Line>& lines, float radius,
 	return lines.size();
 }
 
+/* Scratch of linearProgram3() kept per thread, so steps do not allocate. */
+static thread_local std::vector<Line> projLines;
+
 void linearProgram3(const std::vector<Line>& lines, size_t numObstLines,
                     size_t beginLine, float radius, Vector2& result) {
 	float distance = 0.0f;
@@ -572,8 +732,8 @@ void linearProgram3(const std::vector<Line>& lines, size_t numObstLines,
 	for (size_t i = beginLine; i < lines.size(); ++i) {
 		if (det(lines[i].direction, lines[i].point - result) > distance) {
 			/* Result does not satisfy constraint of line i. */
-			std::vector<Line> projLines(lines.begin(),
-			                            lines.begin() + static_cast<ptrdiff_t>(numObstLines));
+			projLines.assign(lines.begin(),
+			                 lines.begin() + static_cast<ptrdiff_t>(numObstLines));
 
 			for (size_t j = numObstLines; j < i; ++j) {
 				Line line;
@@ -614,4 +774,8 @@ void linearProgram3(const std::vector<Line>& lines, size_t numObstLines,
 		}
 	}
 }
+
+void reserveLinearProgram3(size_t numLines) {
+	projLines.reserve(numLines);
+}
 }
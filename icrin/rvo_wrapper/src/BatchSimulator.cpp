@@ -0,0 +1,460 @@
+/*
+ * BatchSimulator.cpp
+ * RVO2 Library
+ *
+ * Copyright (c) 2015 RAD-UoE Informatics (MIT).
+ */
+
+#include "rvo_wrapper/BatchSimulator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "rvo_wrapper/Agent.h"
+#include "rvo_wrapper/ObstacleSet.h"
+#include "rvo_wrapper/thread_pool.hpp"
+
+namespace RVO {
+namespace {
+/*
+ * Lays the lanes of every agent out for a new number of worlds, in place so
+ * that the capacity of the array is reused. Added worlds copy world zero.
+ */
+void resizeWorlds(std::vector<float>& values, size_t numAgents,
+                  size_t oldWorlds, size_t newWorlds) {
+	if (newWorlds > oldWorlds) {
+		/* Lanes move up, so they are laid out from the last one. */
+		values.resize(numAgents * newWorlds);
+
+		for (size_t i = numAgents; i-- > 0; ) {
+			for (size_t j = newWorlds; j-- > 0; ) {
+				values[i * newWorlds + j] =
+				    values[i * oldWorlds + (j < oldWorlds ? j : 0)];
+			}
+		}
+	} else {
+		for (size_t i = 0; i < numAgents; ++i) {
+			for (size_t j = 0; j < newWorlds; ++j) {
+				values[i * newWorlds + j] = values[i * oldWorlds + j];
+			}
+		}
+
+		values.resize(numAgents * newWorlds);
+	}
+}
+}
+
+BatchSimulator::AgentParameters::AgentParameters() : neighborDist(0.0f),
+	maxNeighbors(0), timeHorizon(0.0f), timeHorizonObst(0.0f), radius(0.0f),
+	maxSpeed(0.0f), maxAccel(0.0f), prefSpeed(0.0f),
+	prefVelocityPolicy(PREF_VELOCITY_MANUAL) { }
+
+BatchSimulator::BatchSimulator() : hasDefaults_(false), globalTime_(0.0f),
+	numWorlds_(1), timeStep_(0.0f) { }
+
+BatchSimulator::BatchSimulator(float timeStep, float neighborDist,
+                               size_t maxNeighbors, float timeHorizon,
+                               float timeHorizonObst, float radius,
+                               float maxSpeed, float maxAccel, float prefSpeed,
+                               const Vector2& velocity) :
+	defaultVelocity_(velocity), hasDefaults_(true), globalTime_(0.0f),
+	numWorlds_(1), timeStep_(timeStep) {
+	defaultAgent_.neighborDist = neighborDist;
+	defaultAgent_.maxNeighbors = maxNeighbors;
+	defaultAgent_.timeHorizon = timeHorizon;
+	defaultAgent_.timeHorizonObst = timeHorizonObst;
+	defaultAgent_.radius = radius;
+	defaultAgent_.maxSpeed = maxSpeed;
+	defaultAgent_.maxAccel = maxAccel;
+	defaultAgent_.prefSpeed = prefSpeed;
+}
+
+size_t BatchSimulator::addAgent(const Vector2& position) {
+	if (!hasDefaults_) {
+		return RVO_ERROR;
+	}
+
+	return appendAgent(defaultAgent_, position, defaultVelocity_);
+}
+
+size_t BatchSimulator::addAgent(const Vector2& position, float neighborDist,
+                                size_t maxNeighbors, float timeHorizon,
+                                float timeHorizonObst, float radius,
+                                float maxSpeed, float maxAccel,
+                                float prefSpeed, const Vector2& velocity) {
+	AgentParameters parameters;
+	parameters.neighborDist = neighborDist;
+	parameters.maxNeighbors = maxNeighbors;
+	parameters.timeHorizon = timeHorizon;
+	parameters.timeHorizonObst = timeHorizonObst;
+	parameters.radius = radius;
+	parameters.maxSpeed = maxSpeed;
+	parameters.maxAccel = maxAccel;
+	parameters.prefSpeed = prefSpeed;
+
+	return appendAgent(parameters, position, velocity);
+}
+
+size_t BatchSimulator::appendAgent(const AgentParameters& parameters,
+                                   const Vector2& position,
+                                   const Vector2& velocity) {
+	agents_.push_back(parameters);
+
+	const size_t size = agents_.size() * numWorlds_;
+	positionsX_.resize(size, position.x());
+	positionsY_.resize(size, position.y());
+	velocitiesX_.resize(size, velocity.x());
+	velocitiesY_.resize(size, velocity.y());
+	prefVelocitiesX_.resize(size, 0.0f);
+	prefVelocitiesY_.resize(size, 0.0f);
+	newVelocitiesX_.resize(size, 0.0f);
+	newVelocitiesY_.resize(size, 0.0f);
+	goalsX_.resize(size, 0.0f);
+	goalsY_.resize(size, 0.0f);
+
+	return agents_.size() - 1;
+}
+
+void BatchSimulator::doStep() {
+	stepWorlds(0, numWorlds_);
+	globalTime_ += timeStep_;
+}
+
+void BatchSimulator::doStep(ThreadPool& pool) {
+	pool.parallelFor(numWorlds_, [this](size_t begin, size_t end, size_t) {
+		stepWorlds(begin, end);
+	});
+	globalTime_ += timeStep_;
+}
+
+Vector2 BatchSimulator::getAgentGoal(size_t worldNo, size_t agentNo) const {
+	const size_t i = agentNo * numWorlds_ + worldNo;
+	return Vector2(goalsX_[i], goalsY_[i]);
+}
+
+Vector2 BatchSimulator::getAgentPosition(size_t worldNo,
+                                         size_t agentNo) const {
+	const size_t i = agentNo * numWorlds_ + worldNo;
+	return Vector2(positionsX_[i], positionsY_[i]);
+}
+
+Vector2 BatchSimulator::getAgentPrefVelocity(size_t worldNo,
+                                             size_t agentNo) const {
+	const size_t i = agentNo * numWorlds_ + worldNo;
+	return Vector2(prefVelocitiesX_[i], prefVelocitiesY_[i]);
+}
+
+Vector2 BatchSimulator::getAgentVelocity(size_t worldNo,
+                                         size_t agentNo) const {
+	const size_t i = agentNo * numWorlds_ + worldNo;
+	return Vector2(velocitiesX_[i], velocitiesY_[i]);
+}
+
+void BatchSimulator::setAgentGoal(size_t worldNo, size_t agentNo,
+                                  const Vector2& goal) {
+	const size_t i = agentNo * numWorlds_ + worldNo;
+	goalsX_[i] = goal.x();
+	goalsY_[i] = goal.y();
+	agents_[agentNo].prefVelocityPolicy = PREF_VELOCITY_GOAL;
+}
+
+void BatchSimulator::setAgentPosition(size_t worldNo, size_t agentNo,
+                                      const Vector2& position) {
+	const size_t i = agentNo * numWorlds_ + worldNo;
+	positionsX_[i] = position.x();
+	positionsY_[i] = position.y();
+}
+
+void BatchSimulator::setAgentPrefVelocity(size_t worldNo, size_t agentNo,
+                                          const Vector2& prefVelocity) {
+	const size_t i = agentNo * numWorlds_ + worldNo;
+	prefVelocitiesX_[i] = prefVelocity.x();
+	prefVelocitiesY_[i] = prefVelocity.y();
+}
+
+void BatchSimulator::setAgentPrefVelocityPolicy(size_t agentNo,
+                                                PrefVelocityPolicy policy) {
+	agents_[agentNo].prefVelocityPolicy = policy;
+}
+
+void BatchSimulator::setAgentVelocity(size_t worldNo, size_t agentNo,
+                                      const Vector2& velocity) {
+	const size_t i = agentNo * numWorlds_ + worldNo;
+	velocitiesX_[i] = velocity.x();
+	velocitiesY_[i] = velocity.y();
+}
+
+void BatchSimulator::setNumWorlds(size_t numWorlds) {
+	if (numWorlds == numWorlds_) {
+		return;
+	}
+
+	const size_t numAgents = agents_.size();
+	resizeWorlds(positionsX_, numAgents, numWorlds_, numWorlds);
+	resizeWorlds(positionsY_, numAgents, numWorlds_, numWorlds);
+	resizeWorlds(velocitiesX_, numAgents, numWorlds_, numWorlds);
+	resizeWorlds(velocitiesY_, numAgents, numWorlds_, numWorlds);
+	resizeWorlds(prefVelocitiesX_, numAgents, numWorlds_, numWorlds);
+	resizeWorlds(prefVelocitiesY_, numAgents, numWorlds_, numWorlds);
+	resizeWorlds(newVelocitiesX_, numAgents, numWorlds_, numWorlds);
+	resizeWorlds(newVelocitiesY_, numAgents, numWorlds_, numWorlds);
+	resizeWorlds(goalsX_, numAgents, numWorlds_, numWorlds);
+	resizeWorlds(goalsY_, numAgents, numWorlds_, numWorlds);
+	numWorlds_ = numWorlds;
+}
+
+void BatchSimulator::setObstacleSet(const std::shared_ptr<const ObstacleSet>&
+                                    obstacleSet) {
+	obstacleSet_ = obstacleSet;
+}
+
+void BatchSimulator::setTimeStep(float timeStep) {
+	timeStep_ = timeStep;
+}
+
+void BatchSimulator::setWorlds(const RVOSimulator& sim, size_t numWorlds) {
+	hasDefaults_ = (sim.defaultAgent_ != NULL);
+
+	if (hasDefaults_) {
+		defaultAgent_.neighborDist = sim.defaultAgent_->neighborDist_;
+		defaultAgent_.maxNeighbors = sim.defaultAgent_->maxNeighbors_;
+		defaultAgent_.timeHorizon = sim.defaultAgent_->timeHorizon_;
+		defaultAgent_.timeHorizonObst = sim.defaultAgent_->timeHorizonObst_;
+		defaultAgent_.radius = sim.defaultRadius_;
+		defaultAgent_.maxSpeed = sim.defaultMaxSpeed_;
+		defaultAgent_.maxAccel = sim.defaultAgent_->maxAccel_;
+		defaultAgent_.prefSpeed = sim.defaultAgent_->prefSpeed_;
+	}
+
+	defaultVelocity_ = sim.defaultVelocity_;
+	globalTime_ = sim.globalTime_;
+	obstacleSet_ = sim.obstacleSet_;
+	timeStep_ = sim.timeStep_;
+
+	/* Arrays are resized in place, so repeated runs reuse their capacity. */
+	const size_t numAgents = sim.agents_.size();
+	const size_t size = numAgents * numWorlds;
+	agents_.resize(numAgents);
+	numWorlds_ = numWorlds;
+	positionsX_.resize(size);
+	positionsY_.resize(size);
+	velocitiesX_.resize(size);
+	velocitiesY_.resize(size);
+	prefVelocitiesX_.resize(size);
+	prefVelocitiesY_.resize(size);
+	newVelocitiesX_.resize(size);
+	newVelocitiesY_.resize(size);
+	goalsX_.resize(size);
+	goalsY_.resize(size);
+
+	for (size_t i = 0; i < numAgents; ++i) {
+		const Agent* const agent = sim.agents_[i];
+
+		AgentParameters& parameters = agents_[i];
+		parameters.neighborDist = agent->neighborDist_;
+		parameters.maxNeighbors = agent->maxNeighbors_;
+		parameters.timeHorizon = agent->timeHorizon_;
+		parameters.timeHorizonObst = agent->timeHorizonObst_;
+		parameters.radius = sim.agentRadii_[i];
+		parameters.maxSpeed = sim.agentMaxSpeeds_[i];
+		parameters.maxAccel = agent->maxAccel_;
+		parameters.prefSpeed = agent->prefSpeed_;
+		parameters.prefVelocityPolicy = agent->prefVelocityPolicy_;
+
+		const size_t begin = i * numWorlds;
+		const size_t end = begin + numWorlds;
+		std::fill(positionsX_.begin() + begin, positionsX_.begin() + end,
+		          sim.agentPositions_[i].x());
+		std::fill(positionsY_.begin() + begin, positionsY_.begin() + end,
+		          sim.agentPositions_[i].y());
+		std::fill(velocitiesX_.begin() + begin, velocitiesX_.begin() + end,
+		          sim.agentVelocities_[i].x());
+		std::fill(velocitiesY_.begin() + begin, velocitiesY_.begin() + end,
+		          sim.agentVelocities_[i].y());
+		std::fill(prefVelocitiesX_.begin() + begin,
+		          prefVelocitiesX_.begin() + end,
+		          sim.agentPrefVelocities_[i].x());
+		std::fill(prefVelocitiesY_.begin() + begin,
+		          prefVelocitiesY_.begin() + end,
+		          sim.agentPrefVelocities_[i].y());
+		std::fill(newVelocitiesX_.begin() + begin,
+		          newVelocitiesX_.begin() + end, 0.0f);
+		std::fill(newVelocitiesY_.begin() + begin,
+		          newVelocitiesY_.begin() + end, 0.0f);
+		std::fill(goalsX_.begin() + begin, goalsX_.begin() + end,
+		          agent->goal_.x());
+		std::fill(goalsY_.begin() + begin, goalsY_.begin() + end,
+		          agent->goal_.y());
+	}
+}
+
+void BatchSimulator::stepWorlds(size_t beginWorld, size_t endWorld) {
+	/* Scratch kept per thread, so steady-state steps do not allocate. */
+	static thread_local std::vector<float> distSq;
+	static thread_local std::vector<std::pair<float, size_t> > agentNeighbors;
+	static thread_local std::vector<std::pair<float, const Obstacle*> >
+	    obstacleNeighbors;
+	static thread_local std::vector<Line> orcaLines;
+
+	const size_t numAgents = agents_.size();
+	const size_t numLanes = endWorld - beginWorld;
+
+	/* Preferred velocities, from the agent state of each world. */
+	for (size_t i = 0; i < numAgents; ++i) {
+		const AgentParameters& agent = agents_[i];
+		const size_t begin = i * numWorlds_ + beginWorld;
+		const size_t end = begin + numLanes;
+
+		if (agent.prefVelocityPolicy == PREF_VELOCITY_KEEP) {
+			std::copy(velocitiesX_.begin() + begin, velocitiesX_.begin() + end,
+			          prefVelocitiesX_.begin() + begin);
+			std::copy(velocitiesY_.begin() + begin, velocitiesY_.begin() + end,
+			          prefVelocitiesY_.begin() + begin);
+		} else if (agent.prefVelocityPolicy == PREF_VELOCITY_GOAL) {
+			const float prefSpeed = agent.prefSpeed;
+			const float* const goalX = &goalsX_[begin];
+			const float* const goalY = &goalsY_[begin];
+			const float* const positionX = &positionsX_[begin];
+			const float* const positionY = &positionsY_[begin];
+			const float* const velocityX = &velocitiesX_[begin];
+			const float* const velocityY = &velocitiesY_[begin];
+			float* const prefVelocityX = &prefVelocitiesX_[begin];
+			float* const prefVelocityY = &prefVelocitiesY_[begin];
+
+			for (size_t lane = 0; lane < numLanes; ++lane) {
+				const float goalVectorX = goalX[lane] - positionX[lane];
+				const float goalVectorY = goalY[lane] - positionY[lane];
+				const float goalDistSq = goalVectorX * goalVectorX +
+				                         goalVectorY * goalVectorY;
+				const float invGoalDist = 1.0f / std::sqrt(goalDistSq);
+				const float scale = (goalDistSq > 1.0f) ? invGoalDist : 1.0f;
+				const float goalPrefX = prefSpeed * (goalVectorX * scale);
+				const float goalPrefY = prefSpeed * (goalVectorY * scale);
+				/* Agents without a goal keep their current velocity. */
+				const bool hasGoal = (goalX[lane] != 0.0f) | (goalY[lane] != 0.0f);
+
+				prefVelocityX[lane] = hasGoal ? goalPrefX : velocityX[lane];
+				prefVelocityY[lane] = hasGoal ? goalPrefY : velocityY[lane];
+			}
+		}
+	}
+
+	/* New velocities. The ORCA linear programs are data dependent, so they run
+	 * per world over distances computed across worlds. */
+	distSq.resize(numAgents * numLanes);
+
+	for (size_t i = 0; i < numAgents; ++i) {
+		const AgentParameters& agent = agents_[i];
+		const size_t begin = i * numWorlds_ + beginWorld;
+
+		if (agent.maxNeighbors > 0) {
+			for (size_t other = 0; other < numAgents; ++other) {
+				const size_t otherBegin = other * numWorlds_ + beginWorld;
+				float* const dist = &distSq[other * numLanes];
+
+				for (size_t lane = 0; lane < numLanes; ++lane) {
+					const float dx = positionsX_[begin + lane] -
+					                 positionsX_[otherBegin + lane];
+					const float dy = positionsY_[begin + lane] -
+					                 positionsY_[otherBegin + lane];
+					dist[lane] = dx * dx + dy * dy;
+				}
+			}
+		}
+
+		const float obstRangeSq = sqr(agent.timeHorizonObst * agent.maxSpeed +
+		                              agent.radius);
+		const float invTimeHorizon = 1.0f / agent.timeHorizon;
+
+		for (size_t lane = 0; lane < numLanes; ++lane) {
+			const size_t j = begin + lane;
+			const Vector2 position(positionsX_[j], positionsY_[j]);
+			const Vector2 velocity(velocitiesX_[j], velocitiesY_[j]);
+
+			obstacleNeighbors.clear();
+
+			if (obstacleSet_) {
+				obstacleSet_->computeObstacleNeighbors(position, obstRangeSq,
+				                                       obstacleNeighbors);
+			}
+
+			agentNeighbors.clear();
+
+			if (agent.maxNeighbors > 0) {
+				float rangeSq = sqr(agent.neighborDist);
+
+				for (size_t other = 0; other < numAgents; ++other) {
+					if (other != i) {
+						Agent::insertAgentNeighbor(agentNeighbors, agent.maxNeighbors,
+						    std::make_pair(distSq[other * numLanes + lane], other),
+						    rangeSq);
+					}
+				}
+
+				std::sort_heap(agentNeighbors.begin(), agentNeighbors.end());
+			}
+
+			orcaLines.clear();
+			Agent::computeObstacleORCALines(obstacleNeighbors, position, velocity,
+			                                agent.radius, agent.timeHorizonObst,
+			                                orcaLines);
+			const size_t numObstLines = orcaLines.size();
+
+			for (size_t k = 0; k < agentNeighbors.size(); ++k) {
+				const size_t other = agentNeighbors[k].second;
+				const size_t o = other * numWorlds_ + beginWorld + lane;
+
+				orcaLines.push_back(Agent::computeAgentORCALine(
+				    Vector2(positionsX_[o], positionsY_[o]) - position, velocity,
+				    velocity - Vector2(velocitiesX_[o], velocitiesY_[o]),
+				    agent.radius + agents_[other].radius, invTimeHorizon,
+				    timeStep_));
+			}
+
+			Vector2 newVelocity;
+			const size_t lineFail = linearProgram2(orcaLines, agent.maxSpeed,
+			    Vector2(prefVelocitiesX_[j], prefVelocitiesY_[j]), false,
+			    newVelocity);
+
+			if (lineFail < orcaLines.size()) {
+				linearProgram3(orcaLines, numObstLines, lineFail, agent.maxSpeed,
+				               newVelocity);
+			}
+
+			newVelocitiesX_[j] = newVelocity.x();
+			newVelocitiesY_[j] = newVelocity.y();
+		}
+	}
+
+	/* Accelerate towards the new velocities and move. */
+	const float timeStep = timeStep_;
+
+	for (size_t i = 0; i < numAgents; ++i) {
+		const float accelStep = agents_[i].maxAccel * timeStep;
+		const size_t begin = i * numWorlds_ + beginWorld;
+		const float* const newVelocityX = &newVelocitiesX_[begin];
+		const float* const newVelocityY = &newVelocitiesY_[begin];
+		float* const velocityX = &velocitiesX_[begin];
+		float* const velocityY = &velocitiesY_[begin];
+		float* const positionX = &positionsX_[begin];
+		float* const positionY = &positionsY_[begin];
+
+		for (size_t lane = 0; lane < numLanes; ++lane) {
+			const float dvX = newVelocityX[lane] - velocityX[lane];
+			const float dvY = newVelocityY[lane] - velocityY[lane];
+			const float dv = std::sqrt(dvX * dvX + dvY * dvY);
+			const float blend = accelStep / dv;
+			const float blendedX = (1.0f - blend) * velocityX[lane] +
+			                       blend * newVelocityX[lane];
+			const float blendedY = (1.0f - blend) * velocityY[lane] +
+			                       blend * newVelocityY[lane];
+			const bool reached = (dv < accelStep);
+
+			velocityX[lane] = reached ? newVelocityX[lane] : blendedX;
+			velocityY[lane] = reached ? newVelocityY[lane] : blendedY;
+			positionX[lane] += velocityX[lane] * timeStep;
+			positionY[lane] += velocityY[lane] * timeStep;
+		}
+	}
+}
+}
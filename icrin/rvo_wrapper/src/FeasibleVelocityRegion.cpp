@@ -0,0 +1,250 @@
+/*
+ * FeasibleVelocityRegion.cpp
+ * RVO2 Library
+ *
+ * Copyright (c) 2015 RAD-UoE Informatics (MIT).
+ */
+
+#include "rvo_wrapper/FeasibleVelocityRegion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "rvo_wrapper/Agent.h"
+
+namespace RVO {
+/* Number of preferred velocities projected together. */
+const size_t PROJECT_BLOCK_SIZE = 64;
+
+FeasibleVelocityRegion::FeasibleVelocityRegion(const std::vector<Line>& lines,
+                                               size_t numObstLines,
+                                               float maxSpeed) : lines_(lines),
+	numObstLines_(numObstLines), maxSpeed_(maxSpeed), feasible_(false) {
+	const size_t numLines = lines.size();
+
+	linePointX_.resize(numLines);
+	linePointY_.resize(numLines);
+	lineDirX_.resize(numLines);
+	lineDirY_.resize(numLines);
+
+	for (size_t i = 0; i < numLines; ++i) {
+		linePointX_[i] = lines[i].point.x();
+		linePointY_[i] = lines[i].point.y();
+		lineDirX_[i] = lines[i].direction.x();
+		lineDirY_[i] = lines[i].direction.y();
+	}
+
+	/* Clip the bounding square of the maximum speed disc by each half-plane. */
+	std::vector<Vector2> polygon;
+	std::vector<Vector2> clipped;
+	polygon.push_back(Vector2(-maxSpeed, -maxSpeed));
+	polygon.push_back(Vector2(maxSpeed, -maxSpeed));
+	polygon.push_back(Vector2(maxSpeed, maxSpeed));
+	polygon.push_back(Vector2(-maxSpeed, maxSpeed));
+
+	for (size_t i = 0; i < numLines && !polygon.empty(); ++i) {
+		clipped.clear();
+
+		for (size_t j = 0; j < polygon.size(); ++j) {
+			const Vector2& a = polygon[j];
+			const Vector2& b = polygon[(j + 1 == polygon.size() ? 0 : j + 1)];
+			const float sideA = det(lines[i].direction, lines[i].point - a);
+			const float sideB = det(lines[i].direction, lines[i].point - b);
+
+			if (sideA <= 0.0f) {
+				clipped.push_back(a);
+			}
+
+			if ((sideA <= 0.0f) != (sideB <= 0.0f)) {
+				clipped.push_back(a + (sideA / (sideA - sideB)) * (b - a));
+			}
+		}
+
+		polygon.swap(clipped);
+	}
+
+	/* Clip the polygon edges to the maximum speed disc. */
+	const float radiusSq = sqr(maxSpeed);
+
+	for (size_t j = 0; j < polygon.size(); ++j) {
+		const Vector2& a = polygon[j];
+		const Vector2 edge = polygon[(j + 1 == polygon.size() ? 0 : j + 1)] - a;
+		const float edgeLengthSq = absSq(edge);
+		float tLeft = 0.0f;
+		float tRight = 0.0f;
+
+		if (edgeLengthSq <= RVO_EPSILON * RVO_EPSILON) {
+			if (absSq(a) > radiusSq) {
+				continue;
+			}
+		} else {
+			const float dotProduct = a * edge;
+			const float discriminant = sqr(dotProduct) - edgeLengthSq * (absSq(a) - radiusSq);
+
+			if (discriminant < 0.0f) {
+				continue;
+			}
+
+			const float sqrtDiscriminant = std::sqrt(discriminant);
+			tLeft = std::max(0.0f, (-dotProduct - sqrtDiscriminant) / edgeLengthSq);
+			tRight = std::min(1.0f, (-dotProduct + sqrtDiscriminant) / edgeLengthSq);
+
+			if (tLeft > tRight) {
+				continue;
+			}
+		}
+
+		const Vector2 segment = (tRight - tLeft) * edge;
+		const float segmentLengthSq = absSq(segment);
+
+		edgeStartX_.push_back(a.x() + tLeft * edge.x());
+		edgeStartY_.push_back(a.y() + tLeft * edge.y());
+		edgeDirX_.push_back(segment.x());
+		edgeDirY_.push_back(segment.y());
+		edgeInvLengthSq_.push_back(segmentLengthSq > 0.0f ? 1.0f / segmentLengthSq : 0.0f);
+	}
+
+	if (!edgeStartX_.empty()) {
+		feasible_ = true;
+	} else if (!polygon.empty()) {
+		/* No edge reaches the disc, so the region is empty unless the disc lies inside the polygon. */
+		feasible_ = true;
+
+		for (size_t i = 0; i < numLines; ++i) {
+			if (det(lines[i].direction, lines[i].point) > 0.0f) {
+				feasible_ = false;
+				break;
+			}
+		}
+	}
+}
+
+void FeasibleVelocityRegion::project(const Vector2* prefVelocities,
+                                     Vector2* newVelocities,
+                                     size_t count) const {
+	if (!feasible_) {
+		for (size_t i = 0; i < count; ++i) {
+			Vector2 result;
+			const size_t lineFail = linearProgram2(lines_, maxSpeed_, prefVelocities[i],
+			                                       false, result);
+
+			if (lineFail < lines_.size()) {
+				linearProgram3(lines_, numObstLines_, lineFail, maxSpeed_, result);
+			}
+
+			newVelocities[i] = result;
+		}
+
+		return;
+	}
+
+	for (size_t begin = 0; begin < count; begin += PROJECT_BLOCK_SIZE) {
+		projectBlock(prefVelocities + begin, newVelocities + begin,
+		             std::min(PROJECT_BLOCK_SIZE, count - begin));
+	}
+}
+
+/*
+ * The loops below run over the block of preferred velocities in their
+ * innermost level, without branches or dependencies between velocities, so
+ * that the compiler can vectorize them.
+ */
+void FeasibleVelocityRegion::projectBlock(const Vector2* prefVelocities,
+                                          Vector2* newVelocities,
+                                          size_t count) const {
+	const float infinity = std::numeric_limits<float>::infinity();
+	const float radiusSq = sqr(maxSpeed_);
+
+	float prefX[PROJECT_BLOCK_SIZE];
+	float prefY[PROJECT_BLOCK_SIZE];
+	float radialX[PROJECT_BLOCK_SIZE];
+	float radialY[PROJECT_BLOCK_SIZE];
+	float prefViolation[PROJECT_BLOCK_SIZE];
+	float radialViolation[PROJECT_BLOCK_SIZE];
+	float bestX[PROJECT_BLOCK_SIZE];
+	float bestY[PROJECT_BLOCK_SIZE];
+	float bestDistSq[PROJECT_BLOCK_SIZE];
+
+	for (size_t k = 0; k < count; ++k) {
+		prefX[k] = prefVelocities[k].x();
+		prefY[k] = prefVelocities[k].y();
+	}
+
+	/* Closest point on the maximum speed circle. */
+	for (size_t k = 0; k < count; ++k) {
+		const float lengthSq = prefX[k] * prefX[k] + prefY[k] * prefY[k];
+		const float length = std::sqrt(lengthSq);
+		const float scale = (length > 0.0f ? maxSpeed_ / length : 0.0f);
+		radialX[k] = prefX[k] * scale;
+		radialY[k] = prefY[k] * scale;
+		prefViolation[k] = (lengthSq > radiusSq ? infinity : 0.0f);
+		radialViolation[k] = (length > 0.0f ? 0.0f : infinity);
+		bestDistSq[k] = sqr(length - maxSpeed_);
+	}
+
+	for (size_t i = 0; i < linePointX_.size(); ++i) {
+		const float pointX = linePointX_[i];
+		const float pointY = linePointY_[i];
+		const float dirX = lineDirX_[i];
+		const float dirY = lineDirY_[i];
+
+		for (size_t k = 0; k < count; ++k) {
+			const float side = dirX * (pointY - prefY[k]) - dirY * (pointX - prefX[k]);
+			const float radialSide = dirX * (pointY - radialY[k]) - dirY * (pointX - radialX[k]);
+			prefViolation[k] = std::max(prefViolation[k], side);
+			radialViolation[k] = std::max(radialViolation[k], radialSide);
+		}
+	}
+
+	for (size_t k = 0; k < count; ++k) {
+		const bool radialFeasible = (radialViolation[k] <= RVO_EPSILON);
+		bestX[k] = radialX[k];
+		bestY[k] = radialY[k];
+		bestDistSq[k] = (radialFeasible ? bestDistSq[k] : infinity);
+	}
+
+	/* Closest point on each polygon edge inside the disc. */
+	for (size_t i = 0; i < edgeStartX_.size(); ++i) {
+		const float startX = edgeStartX_[i];
+		const float startY = edgeStartY_[i];
+		const float dirX = edgeDirX_[i];
+		const float dirY = edgeDirY_[i];
+		const float invLengthSq = edgeInvLengthSq_[i];
+
+		for (size_t k = 0; k < count; ++k) {
+			float t = ((prefX[k] - startX) * dirX + (prefY[k] - startY) * dirY) * invLengthSq;
+			t = (t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t));
+			const float closestX = startX + t * dirX;
+			const float closestY = startY + t * dirY;
+			const float distSq = (prefX[k] - closestX) * (prefX[k] - closestX)
+			                     + (prefY[k] - closestY) * (prefY[k] - closestY);
+			const bool closer = (distSq < bestDistSq[k]);
+			bestX[k] = (closer ? closestX : bestX[k]);
+			bestY[k] = (closer ? closestY : bestY[k]);
+			bestDistSq[k] = (closer ? distSq : bestDistSq[k]);
+		}
+	}
+
+	for (size_t k = 0; k < count; ++k) {
+		if (prefViolation[k] <= 0.0f) {
+			/* Preferred velocity is feasible. */
+			newVelocities[k] = Vector2(prefX[k], prefY[k]);
+		} else if (bestDistSq[k] < infinity) {
+			newVelocities[k] = Vector2(bestX[k], bestY[k]);
+		} else {
+			/* Region too thin for a candidate, solve this one exactly. */
+			Vector2 result;
+			const size_t lineFail = linearProgram2(lines_, maxSpeed_,
+			                                       Vector2(prefX[k], prefY[k]),
+			                                       false, result);
+
+			if (lineFail < lines_.size()) {
+				linearProgram3(lines_, numObstLines_, lineFail, maxSpeed_, result);
+			}
+
+			newVelocities[k] = result;
+		}
+	}
+}
+}
@@ -58,44 +58,52 @@
 
 #include "rvo_wrapper/Agent.h"
 #include "rvo_wrapper/RVOSimulator.h"
-#include "rvo_wrapper/Obstacle.h"
+#include "rvo_wrapper/ObstacleSet.h"
 
 namespace RVO {
-KdTree::KdTree(RVOSimulator* sim) : obstacleTree_(NULL), sim_(sim) { }
+/*
+ * A subtree is built again when the bounds of its two children have grown
+ * past this factor of their extent when it was split.
+ */
+const float MAX_SPLIT_GROWTH = 1.5f;
 
-KdTree::~KdTree() {
-	deleteObstacleTree(obstacleTree_);
-}
+KdTree::KdTree(RVOSimulator* sim) : sim_(sim) { }
+
+KdTree::~KdTree() { }
 
 void KdTree::buildAgentTree() {
 	if (agents_.size() < sim_->agents_.size()) {
 		for (size_t i = agents_.size(); i < sim_->agents_.size(); ++i) {
-			agents_.push_back(sim_->agents_[i]);
+			agents_.push_back(i);
 		}
 
-		agentTree_.resize(2 * agents_.size() - 1);
-	}
+		if (agentTree_.size() < 2 * agents_.size() - 1) {
+			agentTree_.resize(2 * agents_.size() - 1);
+		}
 
-	if (!agents_.empty()) {
 		buildAgentTreeRecursive(0, agents_.size(), 0);
+	} else if (!agents_.empty()) {
+		refitAgentTreeRecursive(0);
 	}
 }
 
 void KdTree::buildAgentTreeRecursive(size_t begin, size_t end, size_t node) {
+	const std::vector<Vector2>& positions = sim_->agentPositions_;
+
 	agentTree_[node].begin = begin;
 	agentTree_[node].end = end;
-	agentTree_[node].minX = agentTree_[node].maxX = agents_[begin]->position_.x();
-	agentTree_[node].minY = agentTree_[node].maxY = agents_[begin]->position_.y();
+	agentTree_[node].minX = agentTree_[node].maxX = positions[agents_[begin]].x();
+	agentTree_[node].minY = agentTree_[node].maxY = positions[agents_[begin]].y();
 
 	for (size_t i = begin + 1; i < end; ++i) {
 		agentTree_[node].maxX = std::max(agentTree_[node].maxX,
-		                                 agents_[i]->position_.x());
+		                                 positions[agents_[i]].x());
 		agentTree_[node].minX = std::min(agentTree_[node].minX,
-		                                 agents_[i]->position_.x());
+		                                 positions[agents_[i]].x());
 		agentTree_[node].maxY = std::max(agentTree_[node].maxY,
-		                                 agents_[i]->position_.y());
+		                                 positions[agents_[i]].y());
 		agentTree_[node].minY = std::min(agentTree_[node].minY,
-		                                 agents_[i]->position_.y());
+		                                 positions[agents_[i]].y());
 	}
 
 	if (end - begin > MAX_LEAF_SIZE) {
@@ -111,14 +119,14 @@ void KdTree::buildAgentTreeRecursive(size_t begin, size_t end, size_t node) {
 
 		while (left < right) {
 			while (left < right &&
-			       (isVertical ? agents_[left]->position_.x() : agents_[left]->position_.y()) <
+			       (isVertical ? positions[agents_[left]].x() : positions[agents_[left]].y()) <
 			       splitValue) {
 				++left;
 			}
 
 			while (right > left &&
-			       (isVertical ? agents_[right - 1]->position_.x() : agents_[right -
-			                                                                 1]->position_.y()) >= splitValue) {
+			       (isVertical ? positions[agents_[right - 1]].x() :
+			        positions[agents_[right - 1]].y()) >= splitValue) {
 				--right;
 			}
 
@@ -139,198 +147,108 @@ void KdTree::buildAgentTreeRecursive(size_t begin, size_t end, size_t node) {
 
 		buildAgentTreeRecursive(begin, left, agentTree_[node].left);
 		buildAgentTreeRecursive(left, end, agentTree_[node].right);
-	}
-}
 
-void KdTree::buildObstacleTree() {
-	deleteObstacleTree(obstacleTree_);
-
-	std::vector<Obstacle*> obstacles(sim_->obstacles_.size());
-
-	for (size_t i = 0; i < sim_->obstacles_.size(); ++i) {
-		obstacles[i] = sim_->obstacles_[i];
+		agentTree_[node].splitExtent = agentTree_[agentTree_[node].left].halfPerimeter() +
+		                               agentTree_[agentTree_[node].right].halfPerimeter();
 	}
-
-	obstacleTree_ = buildObstacleTreeRecursive(obstacles);
 }
 
+void KdTree::refitAgentTreeRecursive(size_t node) {
+	AgentTreeNode& treeNode = agentTree_[node];
 
-KdTree::ObstacleTreeNode* KdTree::buildObstacleTreeRecursive(
-  const std::vector<Obstacle*>& obstacles) {
-	if (obstacles.empty()) {
-		return NULL;
-	} else {
-		ObstacleTreeNode* const node = new ObstacleTreeNode;
-
-		size_t optimalSplit = 0;
-		size_t minLeft = obstacles.size();
-		size_t minRight = obstacles.size();
-
-		for (size_t i = 0; i < obstacles.size(); ++i) {
-			size_t leftSize = 0;
-			size_t rightSize = 0;
-
-			const Obstacle* const obstacleI1 = obstacles[i];
-			const Obstacle* const obstacleI2 = obstacleI1->nextObstacle_;
-
-			/* Compute optimal split node. */
-			for (size_t j = 0; j < obstacles.size(); ++j) {
-				if (i == j) {
-					continue;
-				}
+	if (treeNode.end - treeNode.begin <= MAX_LEAF_SIZE) {
+		const std::vector<Vector2>& positions = sim_->agentPositions_;
 
-				const Obstacle* const obstacleJ1 = obstacles[j];
-				const Obstacle* const obstacleJ2 = obstacleJ1->nextObstacle_;
-
-				const float j1LeftOfI = leftOf(obstacleI1->point_, obstacleI2->point_,
-				                               obstacleJ1->point_);
-				const float j2LeftOfI = leftOf(obstacleI1->point_, obstacleI2->point_,
-				                               obstacleJ2->point_);
-
-				if (j1LeftOfI >= -RVO_EPSILON && j2LeftOfI >= -RVO_EPSILON) {
-					++leftSize;
-				} else if (j1LeftOfI <= RVO_EPSILON && j2LeftOfI <= RVO_EPSILON) {
-					++rightSize;
-				} else {
-					++leftSize;
-					++rightSize;
-				}
-
-				if (std::make_pair(std::max(leftSize, rightSize), std::min(leftSize,
-				                                                           rightSize)) >= std::make_pair(std::max(minLeft, minRight), std::min(minLeft,
-				                                                               minRight))) {
-					break;
-				}
-			}
+		treeNode.minX = treeNode.maxX = positions[agents_[treeNode.begin]].x();
+		treeNode.minY = treeNode.maxY = positions[agents_[treeNode.begin]].y();
 
-			if (std::make_pair(std::max(leftSize, rightSize), std::min(leftSize,
-			                                                           rightSize)) < std::make_pair(std::max(minLeft, minRight), std::min(minLeft,
-			                                                               minRight))) {
-				minLeft = leftSize;
-				minRight = rightSize;
-				optimalSplit = i;
-			}
+		for (size_t i = treeNode.begin + 1; i < treeNode.end; ++i) {
+			treeNode.maxX = std::max(treeNode.maxX, positions[agents_[i]].x());
+			treeNode.minX = std::min(treeNode.minX, positions[agents_[i]].x());
+			treeNode.maxY = std::max(treeNode.maxY, positions[agents_[i]].y());
+			treeNode.minY = std::min(treeNode.minY, positions[agents_[i]].y());
 		}
+	} else {
+		refitAgentTreeRecursive(treeNode.left);
+		refitAgentTreeRecursive(treeNode.right);
 
-		/* Build split node. */
-		std::vector<Obstacle*> leftObstacles(minLeft);
-		std::vector<Obstacle*> rightObstacles(minRight);
-
-		size_t leftCounter = 0;
-		size_t rightCounter = 0;
-		const size_t i = optimalSplit;
-
-		const Obstacle* const obstacleI1 = obstacles[i];
-		const Obstacle* const obstacleI2 = obstacleI1->nextObstacle_;
-
-		for (size_t j = 0; j < obstacles.size(); ++j) {
-			if (i == j) {
-				continue;
-			}
+		const AgentTreeNode& leftNode = agentTree_[treeNode.left];
+		const AgentTreeNode& rightNode = agentTree_[treeNode.right];
 
-			Obstacle* const obstacleJ1 = obstacles[j];
-			Obstacle* const obstacleJ2 = obstacleJ1->nextObstacle_;
-
-			const float j1LeftOfI = leftOf(obstacleI1->point_, obstacleI2->point_,
-			                               obstacleJ1->point_);
-			const float j2LeftOfI = leftOf(obstacleI1->point_, obstacleI2->point_,
-			                               obstacleJ2->point_);
-
-			if (j1LeftOfI >= -RVO_EPSILON && j2LeftOfI >= -RVO_EPSILON) {
-				leftObstacles[leftCounter++] = obstacles[j];
-			} else if (j1LeftOfI <= RVO_EPSILON && j2LeftOfI <= RVO_EPSILON) {
-				rightObstacles[rightCounter++] = obstacles[j];
-			} else {
-				/* Split obstacle j. */
-				const float t = det(obstacleI2->point_ - obstacleI1->point_,
-				                    obstacleJ1->point_ - obstacleI1->point_) / det(obstacleI2->point_ -
-				                                                                   obstacleI1->point_, obstacleJ1->point_ - obstacleJ2->point_);
-
-				const Vector2 splitpoint = obstacleJ1->point_ + t * (obstacleJ2->point_ -
-				                                                     obstacleJ1->point_);
-
-				Obstacle* const newObstacle = new Obstacle();
-				newObstacle->point_ = splitpoint;
-				newObstacle->prevObstacle_ = obstacleJ1;
-				newObstacle->nextObstacle_ = obstacleJ2;
-				newObstacle->isConvex_ = true;
-				newObstacle->unitDir_ = obstacleJ1->unitDir_;
-
-				newObstacle->id_ = sim_->obstacles_.size();
-
-				sim_->obstacles_.push_back(newObstacle);
-
-				obstacleJ1->nextObstacle_ = newObstacle;
-				obstacleJ2->prevObstacle_ = newObstacle;
-
-				if (j1LeftOfI > 0.0f) {
-					leftObstacles[leftCounter++] = obstacleJ1;
-					rightObstacles[rightCounter++] = newObstacle;
-				} else {
-					rightObstacles[rightCounter++] = obstacleJ1;
-					leftObstacles[leftCounter++] = newObstacle;
-				}
-			}
+		if (leftNode.halfPerimeter() + rightNode.halfPerimeter() >
+		    MAX_SPLIT_GROWTH * treeNode.splitExtent) {
+			/* Agents have drifted across the split line, split again. */
+			buildAgentTreeRecursive(treeNode.begin, treeNode.end, node);
+		} else {
+			treeNode.maxX = std::max(leftNode.maxX, rightNode.maxX);
+			treeNode.minX = std::min(leftNode.minX, rightNode.minX);
+			treeNode.maxY = std::max(leftNode.maxY, rightNode.maxY);
+			treeNode.minY = std::min(leftNode.minY, rightNode.minY);
 		}
-
-		node->obstacle = obstacleI1;
-		node->left = buildObstacleTreeRecursive(leftObstacles);
-		node->right = buildObstacleTreeRecursive(rightObstacles);
-		return node;
 	}
 }
 
 void KdTree::computeAgentNeighbors(Agent* agent, float& rangeSq) const {
-	queryAgentTreeRecursive(agent, rangeSq, 0);
+	queryAgentTreeRecursive(agent, sim_->agentPositions_[agent->id_], rangeSq,
+	                        0);
 }
 
 void KdTree::computeObstacleNeighbors(Agent* agent, float rangeSq) const {
-	queryObstacleTreeRecursive(agent, rangeSq, obstacleTree_);
+	if (sim_->obstacleSet_) {
+		sim_->obstacleSet_->computeObstacleNeighbors(agent,
+		                                             sim_->agentPositions_[agent->id_],
+		                                             rangeSq);
+	}
 }
 
-void KdTree::deleteObstacleTree(ObstacleTreeNode* node) {
-	if (node != NULL) {
-		deleteObstacleTree(node->left);
-		deleteObstacleTree(node->right);
-		delete node;
+void KdTree::computeAgentCandidates(Agent* agent, float rangeSq) const {
+	queryAgentRangeRecursive(agent, sim_->agentPositions_[agent->id_], rangeSq,
+	                         0);
+}
+
+void KdTree::computeObstacleCandidates(Agent* agent, float rangeSq) const {
+	if (sim_->obstacleSet_) {
+		sim_->obstacleSet_->computeObstacleCandidates(agent,
+		                                              sim_->agentPositions_[agent->id_],
+		                                              rangeSq);
 	}
 }
 
-void KdTree::queryAgentTreeRecursive(Agent* agent, float& rangeSq,
-                                     size_t node) const {
+void KdTree::queryAgentTreeRecursive(Agent* agent, const Vector2& position,
+                                     float& rangeSq, size_t node) const {
 	if (agentTree_[node].end - agentTree_[node].begin <= MAX_LEAF_SIZE) {
 		for (size_t i = agentTree_[node].begin; i < agentTree_[node].end; ++i) {
 			agent->insertAgentNeighbor(agents_[i], rangeSq);
 		}
 	} else {
 		const float distSqLeft = sqr(std::max(0.0f,
-		                                      agentTree_[agentTree_[node].left].minX - agent->position_.x())) + sqr(std::max(
-		                                            0.0f, agent->position_.x() - agentTree_[agentTree_[node].left].maxX)) + sqr(
-		                           std::max(0.0f, agentTree_[agentTree_[node].left].minY - agent->position_.y())) +
-		                         sqr(std::max(0.0f, agent->position_.y() -
+		                                      agentTree_[agentTree_[node].left].minX - position.x())) + sqr(std::max(
+		                                            0.0f, position.x() - agentTree_[agentTree_[node].left].maxX)) + sqr(
+		                           std::max(0.0f, agentTree_[agentTree_[node].left].minY - position.y())) +
+		                         sqr(std::max(0.0f, position.y() -
 		                                      agentTree_[agentTree_[node].left].maxY));
 
 		const float distSqRight = sqr(std::max(0.0f,
-		                                       agentTree_[agentTree_[node].right].minX - agent->position_.x())) + sqr(std::max(
-		                                             0.0f, agent->position_.x() - agentTree_[agentTree_[node].right].maxX)) + sqr(
-		                            std::max(0.0f, agentTree_[agentTree_[node].right].minY - agent->position_.y()))
-		                          + sqr(std::max(0.0f, agent->position_.y() -
+		                                       agentTree_[agentTree_[node].right].minX - position.x())) + sqr(std::max(
+		                                             0.0f, position.x() - agentTree_[agentTree_[node].right].maxX)) + sqr(
+		                            std::max(0.0f, agentTree_[agentTree_[node].right].minY - position.y()))
+		                          + sqr(std::max(0.0f, position.y() -
 		                                         agentTree_[agentTree_[node].right].maxY));
 
 		if (distSqLeft < distSqRight) {
-			if (distSqLeft < rangeSq) {
-				queryAgentTreeRecursive(agent, rangeSq, agentTree_[node].left);
+			if (distSqLeft <= rangeSq) {
+				queryAgentTreeRecursive(agent, position, rangeSq, agentTree_[node].left);
 
-				if (distSqRight < rangeSq) {
-					queryAgentTreeRecursive(agent, rangeSq, agentTree_[node].right);
+				if (distSqRight <= rangeSq) {
+					queryAgentTreeRecursive(agent, position, rangeSq, agentTree_[node].right);
 				}
 			}
 		} else {
-			if (distSqRight < rangeSq) {
-				queryAgentTreeRecursive(agent, rangeSq, agentTree_[node].right);
+			if (distSqRight <= rangeSq) {
+				queryAgentTreeRecursive(agent, position, rangeSq, agentTree_[node].right);
 
-				if (distSqLeft < rangeSq) {
-					queryAgentTreeRecursive(agent, rangeSq, agentTree_[node].left);
+				if (distSqLeft <= rangeSq) {
+					queryAgentTreeRecursive(agent, position, rangeSq, agentTree_[node].left);
 				}
 			}
 		}
@@ -338,81 +256,32 @@ void KdTree::queryAgentTreeRecursive(Agent* agent, float& rangeSq,
 	}
 }
 
-void KdTree::queryObstacleTreeRecursive(Agent* agent, float rangeSq,
-                                        const ObstacleTreeNode* node) const {
-	if (node == NULL) {
-		return;
-	} else {
-		const Obstacle* const obstacle1 = node->obstacle;
-		const Obstacle* const obstacle2 = obstacle1->nextObstacle_;
+void KdTree::queryAgentRangeRecursive(Agent* agent, const Vector2& position,
+                                      float rangeSq, size_t node) const {
+	const AgentTreeNode& treeNode = agentTree_[node];
 
-		const float agentLeftOfLine = leftOf(obstacle1->point_, obstacle2->point_,
-		                                     agent->position_);
+	if (treeNode.end - treeNode.begin <= MAX_LEAF_SIZE) {
+		const std::vector<Vector2>& positions = sim_->agentPositions_;
 
-		queryObstacleTreeRecursive(agent, rangeSq,
-		                           (agentLeftOfLine >= 0.0f ? node->left : node->right));
-
-		const float distSqLine = sqr(agentLeftOfLine) / absSq(obstacle2->point_ -
-		                                                      obstacle1->point_);
-
-		if (distSqLine < rangeSq) {
-			if (agentLeftOfLine < 0.0f) {
-				/*
-				 * Try obstacle at this node only if agent is on right side of
-				 * obstacle (and can see obstacle).
-				 */
-				agent->insertObstacleNeighbor(node->obstacle, rangeSq);
+		for (size_t i = treeNode.begin; i < treeNode.end; ++i) {
+			if (agents_[i] != agent->id_ &&
+			    absSq(position - positions[agents_[i]]) < rangeSq) {
+				agent->agentCandidates_.push_back(agents_[i]);
 			}
-
-			/* Try other side of line. */
-			queryObstacleTreeRecursive(agent, rangeSq,
-			                           (agentLeftOfLine >= 0.0f ? node->right : node->left));
-
 		}
-	}
-}
-
-bool KdTree::queryVisibility(const Vector2& q1, const Vector2& q2,
-                             float radius) const {
-	return queryVisibilityRecursive(q1, q2, radius, obstacleTree_);
-}
-
-bool KdTree::queryVisibilityRecursive(const Vector2& q1, const Vector2& q2,
-                                      float radius, const ObstacleTreeNode* node) const {
-	if (node == NULL) {
-		return true;
 	} else {
-		const Obstacle* const obstacle1 = node->obstacle;
-		const Obstacle* const obstacle2 = obstacle1->nextObstacle_;
-
-		const float q1LeftOfI = leftOf(obstacle1->point_, obstacle2->point_, q1);
-		const float q2LeftOfI = leftOf(obstacle1->point_, obstacle2->point_, q2);
-		const float invLengthI = 1.0f / absSq(obstacle2->point_ - obstacle1->point_);
-
-		if (q1LeftOfI >= 0.0f && q2LeftOfI >= 0.0f) {
-			return queryVisibilityRecursive(q1, q2, radius, node->left) &&
-			       ((sqr(q1LeftOfI) * invLengthI >= sqr(radius) &&
-			         sqr(q2LeftOfI) * invLengthI >= sqr(radius)) ||
-			        queryVisibilityRecursive(q1, q2, radius, node->right));
-		} else if (q1LeftOfI <= 0.0f && q2LeftOfI <= 0.0f) {
-			return queryVisibilityRecursive(q1, q2, radius, node->right) &&
-			       ((sqr(q1LeftOfI) * invLengthI >= sqr(radius) &&
-			         sqr(q2LeftOfI) * invLengthI >= sqr(radius)) ||
-			        queryVisibilityRecursive(q1, q2, radius, node->left));
-		} else if (q1LeftOfI >= 0.0f && q2LeftOfI <= 0.0f) {
-			/* One can see through obstacle from left to right. */
-			return queryVisibilityRecursive(q1, q2, radius, node->left) &&
-			       queryVisibilityRecursive(q1, q2, radius, node->right);
-		} else {
-			const float point1LeftOfQ = leftOf(q1, q2, obstacle1->point_);
-			const float point2LeftOfQ = leftOf(q1, q2, obstacle2->point_);
-			const float invLengthQ = 1.0f / absSq(q2 - q1);
-
-			return (point1LeftOfQ * point2LeftOfQ >= 0.0f &&
-			        sqr(point1LeftOfQ) * invLengthQ > sqr(radius) &&
-			        sqr(point2LeftOfQ) * invLengthQ > sqr(radius) &&
-			        queryVisibilityRecursive(q1, q2, radius, node->left) &&
-			        queryVisibilityRecursive(q1, q2, radius, node->right));
+		for (size_t child = 0; child < 2; ++child) {
+			const AgentTreeNode& childNode = agentTree_[child == 0 ? treeNode.left :
+			                                            treeNode.right];
+			const float distSq = sqr(std::max(0.0f, childNode.minX - position.x())) +
+			                     sqr(std::max(0.0f, position.x() - childNode.maxX)) +
+			                     sqr(std::max(0.0f, childNode.minY - position.y())) +
+			                     sqr(std::max(0.0f, position.y() - childNode.maxY));
+
+			if (distSq < rangeSq) {
+				queryAgentRangeRecursive(agent, position, rangeSq,
+				                         child == 0 ? treeNode.left : treeNode.right);
+			}
 		}
 	}
 }
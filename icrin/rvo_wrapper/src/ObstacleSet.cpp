@@ -0,0 +1,531 @@
+/*
+ * ObstacleSet.cpp
+ * RVO2 Library
+ *
+ * Copyright (c) 2015 RAD-UoE Informatics (MIT).
+ */
+
+#include "rvo_wrapper/ObstacleSet.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+
+#include "rvo_wrapper/Agent.h"
+#include "rvo_wrapper/Obstacle.h"
+
+namespace RVO {
+/*
+ * Traversal stack entries kept on the call stack for trees up to this depth,
+ * deeper trees use a stack kept per thread.
+ */
+const size_t OBSTACLE_STACK_SIZE = 64;
+
+/* Subtrees are built on their own thread down to this depth... */
+const size_t PARALLEL_BUILD_DEPTH = 3;
+
+/* ...if they hold at least this many obstacles. */
+const size_t PARALLEL_BUILD_SIZE = 256;
+
+ObstacleSet::ObstacleSet() : processed_(false), treeDepth_(0),
+	buildTime_(0.0f), maxSplitCandidates_(0) { }
+
+ObstacleSet::ObstacleSet(const ObstacleSet& other) : processed_(false),
+	treeDepth_(0), buildTime_(0.0f), maxSplitCandidates_(0) {
+	/*
+	 * Processing splits and relinks obstacles, so the copy is rebuilt from the
+	 * original polygons.
+	 */
+	for (size_t i = 0; i < other.polygons_.size(); ++i) {
+		addObstacle(other.polygons_[i]);
+	}
+
+	if (!other.obstacleTree_.empty()) {
+		processObstacles(other.maxSplitCandidates_);
+	}
+}
+
+ObstacleSet::~ObstacleSet() {
+	for (size_t i = 0; i < obstacles_.size(); ++i) {
+		delete obstacles_[i];
+	}
+}
+
+size_t ObstacleSet::addObstacle(const std::vector<Vector2>& vertices) {
+	if (vertices.size() < 2) {
+		return RVO_ERROR;
+	}
+
+	const size_t obstacleNo = obstacles_.size();
+
+	polygons_.push_back(vertices);
+
+	for (size_t i = 0; i < vertices.size(); ++i) {
+		Obstacle* obstacle = new Obstacle();
+		obstacle->point_ = vertices[i];
+
+		if (i != 0) {
+			obstacle->prevObstacle_ = obstacles_.back();
+			obstacle->prevObstacle_->nextObstacle_ = obstacle;
+		}
+
+		if (i == vertices.size() - 1) {
+			obstacle->nextObstacle_ = obstacles_[obstacleNo];
+			obstacle->nextObstacle_->prevObstacle_ = obstacle;
+		}
+
+		obstacle->unitDir_ = normalize(vertices[(i == vertices.size() - 1 ? 0 : i + 1)]
+		                               - vertices[i]);
+
+		if (vertices.size() == 2) {
+			obstacle->isConvex_ = true;
+		} else {
+			obstacle->isConvex_ = (leftOf(vertices[(i == 0 ? vertices.size() - 1 : i - 1)],
+			                              vertices[i], vertices[(i == vertices.size() - 1 ? 0 : i + 1)]) >= 0.0f);
+		}
+
+		obstacle->id_ = obstacles_.size();
+
+		obstacles_.push_back(obstacle);
+	}
+
+	processed_ = false;
+
+	return obstacleNo;
+}
+
+void ObstacleSet::processObstacles(size_t maxSplitCandidates) {
+	const std::chrono::steady_clock::time_point start =
+	  std::chrono::steady_clock::now();
+
+	maxSplitCandidates_ = maxSplitCandidates;
+
+	std::vector<Obstacle*> obstacles(obstacles_);
+
+	ObstacleTreeBuild build;
+	buildObstacleTreeRecursive(obstacles, 1, maxSplitCandidates, build);
+
+	/* Numbered in the order a sequential build would have created them. */
+	for (size_t i = 0; i < build.newObstacles.size(); ++i) {
+		build.newObstacles[i]->id_ = obstacles_.size();
+		obstacles_.push_back(build.newObstacles[i]);
+	}
+
+	obstacleTree_.swap(build.nodes);
+	treeDepth_ = build.depth;
+
+	/*
+	 * Splitting only relinks obstacles that are not yet tree nodes, so the
+	 * edge of every node is final once the whole tree is built.
+	 */
+	for (size_t i = 0; i < obstacleTree_.size(); ++i) {
+		ObstacleTreeNode& node = obstacleTree_[i];
+		node.point1 = node.obstacle->point_;
+		node.point2 = node.obstacle->nextObstacle_->point_;
+		node.lengthSq = absSq(node.point2 - node.point1);
+	}
+
+	processed_ = true;
+	buildTime_ = std::chrono::duration<float>(std::chrono::steady_clock::now() -
+	                                          start).count();
+}
+
+size_t ObstacleSet::getNumObstacleVertices() const {
+	return obstacles_.size();
+}
+
+const Vector2& ObstacleSet::getObstacleVertex(size_t vertexNo) const {
+	return obstacles_[vertexNo]->point_;
+}
+
+size_t ObstacleSet::getNextObstacleVertexNo(size_t vertexNo) const {
+	return obstacles_[vertexNo]->nextObstacle_->id_;
+}
+
+size_t ObstacleSet::getPrevObstacleVertexNo(size_t vertexNo) const {
+	return obstacles_[vertexNo]->prevObstacle_->id_;
+}
+
+size_t ObstacleSet::buildObstacleTreeRecursive(
+  const std::vector<Obstacle*>& obstacles, size_t depth,
+  size_t maxSplitCandidates, ObstacleTreeBuild& build) {
+	if (obstacles.empty()) {
+		return NO_NODE;
+	} else {
+		const size_t node = build.nodes.size();
+		build.nodes.push_back(ObstacleTreeNode());
+		build.depth = std::max(build.depth, depth);
+
+		size_t optimalSplit = 0;
+		size_t minLeft = obstacles.size();
+		size_t minRight = obstacles.size();
+
+		/*
+		 * Sampled nodes try evenly spaced obstacles, so each level costs linear
+		 * rather than quadratic time.
+		 */
+		const size_t numCandidates = (maxSplitCandidates == 0 ? obstacles.size() :
+		                              std::min(obstacles.size(),
+		                                       maxSplitCandidates));
+
+		for (size_t candidate = 0; candidate < numCandidates; ++candidate) {
+			const size_t i = candidate * obstacles.size() / numCandidates;
+
+			size_t leftSize = 0;
+			size_t rightSize = 0;
+
+			const Obstacle* const obstacleI1 = obstacles[i];
+			const Obstacle* const obstacleI2 = obstacleI1->nextObstacle_;
+
+			/* Compute optimal split node. */
+			for (size_t j = 0; j < obstacles.size(); ++j) {
+				if (i == j) {
+					continue;
+				}
+
+				const Obstacle* const obstacleJ1 = obstacles[j];
+				const Obstacle* const obstacleJ2 = obstacleJ1->nextObstacle_;
+
+				const float j1LeftOfI = leftOf(obstacleI1->point_, obstacleI2->point_,
+				                               obstacleJ1->point_);
+				const float j2LeftOfI = leftOf(obstacleI1->point_, obstacleI2->point_,
+				                               obstacleJ2->point_);
+
+				if (j1LeftOfI >= -RVO_EPSILON && j2LeftOfI >= -RVO_EPSILON) {
+					++leftSize;
+				} else if (j1LeftOfI <= RVO_EPSILON && j2LeftOfI <= RVO_EPSILON) {
+					++rightSize;
+				} else {
+					++leftSize;
+					++rightSize;
+				}
+
+				if (std::make_pair(std::max(leftSize, rightSize), std::min(leftSize,
+				                                                           rightSize)) >= std::make_pair(std::max(minLeft, minRight), std::min(minLeft,
+				                                                               minRight))) {
+					break;
+				}
+			}
+
+			if (std::make_pair(std::max(leftSize, rightSize), std::min(leftSize,
+			                                                           rightSize)) < std::make_pair(std::max(minLeft, minRight), std::min(minLeft,
+			                                                               minRight))) {
+				minLeft = leftSize;
+				minRight = rightSize;
+				optimalSplit = i;
+			}
+		}
+
+		/* Build split node. */
+		std::vector<Obstacle*> leftObstacles(minLeft);
+		std::vector<Obstacle*> rightObstacles(minRight);
+
+		size_t leftCounter = 0;
+		size_t rightCounter = 0;
+		const size_t i = optimalSplit;
+
+		const Obstacle* const obstacleI1 = obstacles[i];
+		const Obstacle* const obstacleI2 = obstacleI1->nextObstacle_;
+
+		for (size_t j = 0; j < obstacles.size(); ++j) {
+			if (i == j) {
+				continue;
+			}
+
+			Obstacle* const obstacleJ1 = obstacles[j];
+			Obstacle* const obstacleJ2 = obstacleJ1->nextObstacle_;
+
+			const float j1LeftOfI = leftOf(obstacleI1->point_, obstacleI2->point_,
+			                               obstacleJ1->point_);
+			const float j2LeftOfI = leftOf(obstacleI1->point_, obstacleI2->point_,
+			                               obstacleJ2->point_);
+
+			if (j1LeftOfI >= -RVO_EPSILON && j2LeftOfI >= -RVO_EPSILON) {
+				leftObstacles[leftCounter++] = obstacles[j];
+			} else if (j1LeftOfI <= RVO_EPSILON && j2LeftOfI <= RVO_EPSILON) {
+				rightObstacles[rightCounter++] = obstacles[j];
+			} else {
+				/* Split obstacle j. */
+				const float t = det(obstacleI2->point_ - obstacleI1->point_,
+				                    obstacleJ1->point_ - obstacleI1->point_) / det(obstacleI2->point_ -
+				                                                                   obstacleI1->point_, obstacleJ1->point_ - obstacleJ2->point_);
+
+				const Vector2 splitpoint = obstacleJ1->point_ + t * (obstacleJ2->point_ -
+				                                                     obstacleJ1->point_);
+
+				Obstacle* const newObstacle = new Obstacle();
+				newObstacle->point_ = splitpoint;
+				newObstacle->prevObstacle_ = obstacleJ1;
+				newObstacle->nextObstacle_ = obstacleJ2;
+				newObstacle->isConvex_ = true;
+				newObstacle->unitDir_ = obstacleJ1->unitDir_;
+
+				build.newObstacles.push_back(newObstacle);
+
+				obstacleJ1->nextObstacle_ = newObstacle;
+				obstacleJ2->prevObstacle_ = newObstacle;
+
+				if (j1LeftOfI > 0.0f) {
+					leftObstacles[leftCounter++] = obstacleJ1;
+					rightObstacles[rightCounter++] = newObstacle;
+				} else {
+					rightObstacles[rightCounter++] = obstacleJ1;
+					leftObstacles[leftCounter++] = newObstacle;
+				}
+			}
+		}
+
+		build.nodes[node].obstacle = obstacleI1;
+
+		/*
+		 * The two sides hold disjoint obstacles, so the right subtree can be
+		 * built on its own thread while this one builds the left subtree.
+		 */
+		std::future<ObstacleTreeBuild> rightFuture;
+
+		if (depth <= PARALLEL_BUILD_DEPTH &&
+		    rightObstacles.size() >= PARALLEL_BUILD_SIZE) {
+			rightFuture = std::async(std::launch::async,
+			                         [&rightObstacles, depth, maxSplitCandidates]() {
+				ObstacleTreeBuild rightBuild;
+				buildObstacleTreeRecursive(rightObstacles, depth + 1,
+				                           maxSplitCandidates, rightBuild);
+				return rightBuild;
+			});
+		}
+
+		const size_t left = buildObstacleTreeRecursive(leftObstacles, depth + 1,
+		                                               maxSplitCandidates, build);
+		build.nodes[node].left = left;
+
+		if (rightFuture.valid()) {
+			const ObstacleTreeBuild rightBuild = rightFuture.get();
+			const size_t offset = build.nodes.size();
+
+			for (size_t k = 0; k < rightBuild.nodes.size(); ++k) {
+				ObstacleTreeNode rightNode = rightBuild.nodes[k];
+
+				if (rightNode.left != NO_NODE) {
+					rightNode.left += offset;
+				}
+
+				if (rightNode.right != NO_NODE) {
+					rightNode.right += offset;
+				}
+
+				build.nodes.push_back(rightNode);
+			}
+
+			build.newObstacles.insert(build.newObstacles.end(),
+			                          rightBuild.newObstacles.begin(),
+			                          rightBuild.newObstacles.end());
+			build.depth = std::max(build.depth, rightBuild.depth);
+			build.nodes[node].right = (rightBuild.nodes.empty() ? NO_NODE : offset);
+		} else {
+			const size_t right = buildObstacleTreeRecursive(rightObstacles, depth + 1,
+			                                                maxSplitCandidates,
+			                                                build);
+			build.nodes[node].right = right;
+		}
+
+		return node;
+	}
+}
+
+std::vector<ObstacleSet::ObstacleStackEntry>& ObstacleSet::threadTreeStack() {
+	static thread_local std::vector<ObstacleStackEntry> stack;
+	return stack;
+}
+
+std::vector<size_t>& ObstacleSet::threadVisibilityStack() {
+	static thread_local std::vector<size_t> stack;
+	return stack;
+}
+
+void ObstacleSet::reserveQueryStacks() const {
+	if (treeDepth_ + 1 > OBSTACLE_STACK_SIZE) {
+		if (threadTreeStack().size() < treeDepth_ + 1) {
+			threadTreeStack().resize(treeDepth_ + 1);
+		}
+
+		if (threadVisibilityStack().size() < treeDepth_ + 1) {
+			threadVisibilityStack().resize(treeDepth_ + 1);
+		}
+	}
+}
+
+template <class Visitor>
+void ObstacleSet::queryObstacleTree(const Vector2& position, float rangeSq,
+                                    Visitor visit) const {
+	if (obstacleTree_.empty()) {
+		return;
+	}
+
+	/*
+	 * Visits the nodes in the same order as a recursive traversal: the side
+	 * of the position first, then the node obstacle and the other side if
+	 * the position is within range of the node line.
+	 */
+	ObstacleStackEntry localStack[OBSTACLE_STACK_SIZE];
+	std::vector<ObstacleStackEntry>& heapStack = threadTreeStack();
+	ObstacleStackEntry* stack = localStack;
+
+	if (treeDepth_ + 1 > OBSTACLE_STACK_SIZE) {
+		if (heapStack.size() < treeDepth_ + 1) {
+			heapStack.resize(treeDepth_ + 1);
+		}
+
+		stack = &heapStack[0];
+	}
+
+	size_t stackSize = 0;
+	size_t nodeNo = 0;
+
+	while (true) {
+		if (nodeNo != NO_NODE) {
+			const ObstacleTreeNode& node = obstacleTree_[nodeNo];
+			const float agentLeftOfLine = leftOf(node.point1, node.point2, position);
+
+			stack[stackSize].node = nodeNo;
+			stack[stackSize].leftOfLine = agentLeftOfLine;
+			++stackSize;
+
+			nodeNo = (agentLeftOfLine >= 0.0f ? node.left : node.right);
+		} else if (stackSize > 0) {
+			--stackSize;
+
+			const ObstacleTreeNode& node = obstacleTree_[stack[stackSize].node];
+			const float agentLeftOfLine = stack[stackSize].leftOfLine;
+			const float distSqLine = sqr(agentLeftOfLine) / node.lengthSq;
+
+			if (distSqLine < rangeSq) {
+				visit(node, agentLeftOfLine);
+
+				/* Try other side of line. */
+				nodeNo = (agentLeftOfLine >= 0.0f ? node.right : node.left);
+			}
+		} else {
+			break;
+		}
+	}
+}
+
+void ObstacleSet::computeObstacleNeighbors(Agent* agent,
+                                           const Vector2& position,
+                                           float rangeSq) const {
+	queryObstacleTree(position, rangeSq,
+	                  [agent, rangeSq](const ObstacleTreeNode& node,
+	                                   float agentLeftOfLine) {
+		if (agentLeftOfLine < 0.0f) {
+			/*
+			 * Try obstacle at this node only if agent is on right side of
+			 * obstacle (and can see obstacle).
+			 */
+			agent->insertObstacleNeighbor(node.obstacle, rangeSq);
+		}
+	});
+}
+
+void ObstacleSet::computeObstacleNeighbors(const Vector2& position,
+                                           float rangeSq,
+                                           std::vector<std::pair<float,
+                                           const Obstacle*> >&
+                                           obstacleNeighbors) const {
+	queryObstacleTree(position, rangeSq,
+	                  [&obstacleNeighbors, &position, rangeSq](
+	                    const ObstacleTreeNode& node, float agentLeftOfLine) {
+		if (agentLeftOfLine < 0.0f) {
+			Agent::insertObstacleNeighbor(obstacleNeighbors, node.obstacle,
+			                              position, rangeSq);
+		}
+	});
+}
+
+void ObstacleSet::computeObstacleCandidates(Agent* agent,
+                                            const Vector2& position,
+                                            float rangeSq) const {
+	/* The agent may cross the obstacle line before the list is rebuilt. */
+	queryObstacleTree(position, rangeSq,
+	                  [agent, &position, rangeSq](const ObstacleTreeNode& node,
+	                                              float) {
+		if (distSqPointLineSegment(node.point1, node.point2, position) < rangeSq) {
+			agent->obstacleCandidates_.push_back(node.obstacle);
+		}
+	});
+}
+
+bool ObstacleSet::queryVisibility(const Vector2& q1, const Vector2& q2,
+                                  float radius) const {
+	if (obstacleTree_.empty()) {
+		return true;
+	}
+
+	/*
+	 * Visibility holds if it holds in every subtree the query reaches, so the
+	 * subtrees can be checked in any order.
+	 */
+	size_t localStack[OBSTACLE_STACK_SIZE];
+	std::vector<size_t>& heapStack = threadVisibilityStack();
+	size_t* stack = localStack;
+
+	if (treeDepth_ + 1 > OBSTACLE_STACK_SIZE) {
+		if (heapStack.size() < treeDepth_ + 1) {
+			heapStack.resize(treeDepth_ + 1);
+		}
+
+		stack = &heapStack[0];
+	}
+
+	size_t stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		const size_t nodeNo = stack[--stackSize];
+
+		if (nodeNo == NO_NODE) {
+			continue;
+		}
+
+		const ObstacleTreeNode& node = obstacleTree_[nodeNo];
+
+		const float q1LeftOfI = leftOf(node.point1, node.point2, q1);
+		const float q2LeftOfI = leftOf(node.point1, node.point2, q2);
+		const float invLengthI = 1.0f / node.lengthSq;
+
+		if (q1LeftOfI >= 0.0f && q2LeftOfI >= 0.0f) {
+			stack[stackSize++] = node.left;
+
+			if (!(sqr(q1LeftOfI) * invLengthI >= sqr(radius) &&
+			      sqr(q2LeftOfI) * invLengthI >= sqr(radius))) {
+				stack[stackSize++] = node.right;
+			}
+		} else if (q1LeftOfI <= 0.0f && q2LeftOfI <= 0.0f) {
+			stack[stackSize++] = node.right;
+
+			if (!(sqr(q1LeftOfI) * invLengthI >= sqr(radius) &&
+			      sqr(q2LeftOfI) * invLengthI >= sqr(radius))) {
+				stack[stackSize++] = node.left;
+			}
+		} else if (q1LeftOfI >= 0.0f && q2LeftOfI <= 0.0f) {
+			/* One can see through obstacle from left to right. */
+			stack[stackSize++] = node.left;
+			stack[stackSize++] = node.right;
+		} else {
+			const float point1LeftOfQ = leftOf(q1, q2, node.point1);
+			const float point2LeftOfQ = leftOf(q1, q2, node.point2);
+			const float invLengthQ = 1.0f / absSq(q2 - q1);
+
+			if (!(point1LeftOfQ * point2LeftOfQ >= 0.0f &&
+			      sqr(point1LeftOfQ) * invLengthQ > sqr(radius) &&
+			      sqr(point2LeftOfQ) * invLengthQ > sqr(radius))) {
+				return false;
+			}
+
+			stack[stackSize++] = node.left;
+			stack[stackSize++] = node.right;
+		}
+	}
+
+	return true;
+}
+}
@@ -56,17 +56,53 @@
 
 #include "rvo_wrapper/RVOSimulator.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "rvo_wrapper/Agent.h"
+#include "rvo_wrapper/FeasibleVelocityRegion.h"
 #include "rvo_wrapper/KdTree.h"
 #include "rvo_wrapper/Obstacle.h"
+#include "rvo_wrapper/ObstacleSet.h"
+#include "rvo_wrapper/TrajectoryBuffer.h"
+#include "rvo_wrapper/thread_pool.hpp"
 
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 
 namespace RVO {
-RVOSimulator::RVOSimulator() : defaultAgent_(NULL), globalTime_(0.0f),
-	kdTree_(NULL), timeStep_(0.0f) {
+/* The bulk accessors copy Vector2 arrays as interleaved x, y floats. */
+static_assert(sizeof(Vector2) == 2 * sizeof(float),
+              "Vector2 must hold exactly two floats");
+
+/*
+ * Agents reserve obstacle neighbor and ORCA line lists for every obstacle
+ * vertex of maps up to this size. On larger maps the lists grow to their peak
+ * in the first steps.
+ */
+const size_t MAX_RESERVED_OBSTACLE_NEIGHBORS = 256;
+
+namespace {
+void copyToFloats(const std::vector<Vector2>& vectors, float* values) {
+	if (!vectors.empty()) {
+		std::memcpy(values, &vectors[0], vectors.size() * sizeof(Vector2));
+	}
+}
+
+void copyFromFloats(const float* values, std::vector<Vector2>& vectors) {
+	if (!vectors.empty()) {
+		std::memcpy(static_cast<void*>(&vectors[0]), values,
+		            vectors.size() * sizeof(Vector2));
+	}
+}
+}
+
+RVOSimulator::RVOSimulator() : defaultAgent_(NULL), defaultMaxSpeed_(0.0f),
+	defaultRadius_(0.0f), globalTime_(0.0f), kdTree_(NULL),
+	ownObstacleSet_(NULL), timeStep_(0.0f), neighborSkin_(0.0f),
+	neighborListsValid_(false), rebuildNeighborLists_(false),
+	numNeighborListBuilds_(0), numNeighborListSteps_(0) {
 	kdTree_ = new KdTree(this);
 }
 
@@ -75,19 +111,20 @@ RVOSimulator::RVOSimulator(float timeStep, float neighborDist,
                            float timeHorizonObst, float radius, float maxSpeed,
                            float maxAccel, float prefSpeed,
                            const Vector2& velocity) : defaultAgent_(NULL),
-	globalTime_(0.0f), kdTree_(NULL), timeStep_(timeStep) {
+	defaultMaxSpeed_(maxSpeed), defaultRadius_(radius),
+	defaultVelocity_(velocity), globalTime_(0.0f), kdTree_(NULL),
+	ownObstacleSet_(NULL), timeStep_(timeStep), neighborSkin_(0.0f),
+	neighborListsValid_(false), rebuildNeighborLists_(false),
+	numNeighborListBuilds_(0), numNeighborListSteps_(0) {
 	kdTree_ = new KdTree(this);
 	defaultAgent_ = new Agent(this);
 
 	defaultAgent_->maxNeighbors_ = maxNeighbors;
-	defaultAgent_->maxSpeed_ = maxSpeed;
 	defaultAgent_->neighborDist_ = neighborDist;
-	defaultAgent_->radius_ = radius;
 	defaultAgent_->timeHorizon_ = timeHorizon;
 	defaultAgent_->timeHorizonObst_ = timeHorizonObst;
 	defaultAgent_->maxAccel_ = maxAccel;
 	defaultAgent_->prefSpeed_ = prefSpeed;
-	defaultAgent_->velocity_ = velocity;
 }
 
 RVOSimulator::~RVOSimulator() {
@@ -99,8 +136,8 @@ RVOSimulator::~RVOSimulator() {
 		delete agents_[i];
 	}
 
-	for (size_t i = 0; i < obstacles_.size(); ++i) {
-		delete obstacles_[i];
+	for (size_t i = 0; i < freeAgents_.size(); ++i) {
+		delete freeAgents_[i];
 	}
 
 	delete kdTree_;
@@ -111,24 +148,18 @@ size_t RVOSimulator::addAgent(const Vector2& position) {
 		return RVO_ERROR;
 	}
 
-	Agent* agent = new Agent(this);
+	Agent* agent = newAgent(position, defaultRadius_, defaultMaxSpeed_,
+	                        defaultVelocity_);
 
-	agent->position_ = position;
 	agent->maxNeighbors_ = defaultAgent_->maxNeighbors_;
-	agent->maxSpeed_ = defaultAgent_->maxSpeed_;
 	agent->neighborDist_ = defaultAgent_->neighborDist_;
-	agent->radius_ = defaultAgent_->radius_;
 	agent->timeHorizon_ = defaultAgent_->timeHorizon_;
 	agent->timeHorizonObst_ = defaultAgent_->timeHorizonObst_;
 	agent->maxAccel_ = defaultAgent_->maxAccel_;
 	agent->prefSpeed_ = defaultAgent_->prefSpeed_;
-	agent->velocity_ = defaultAgent_->velocity_;
-
-	agent->id_ = agents_.size();
+	agent->reserveNeighbors(maxReservedObstacleNeighbors());
 
-	agents_.push_back(agent);
-
-	return agents_.size() - 1;
+	return agent->id_;
 }
 
 size_t RVOSimulator::addAgent(const Vector2& position, float neighborDist,
@@ -136,73 +167,91 @@ size_t RVOSimulator::addAgent(const Vector2& position, float neighborDist,
                               float timeHorizonObst, float radius,
                               float maxSpeed, float maxAccel, float prefSpeed,
                               const Vector2& velocity) {
-	Agent* agent = new Agent(this);
+	Agent* agent = newAgent(position, radius, maxSpeed, velocity);
 
-	agent->position_ = position;
 	agent->maxNeighbors_ = maxNeighbors;
-	agent->maxSpeed_ = maxSpeed;
 	agent->neighborDist_ = neighborDist;
-	agent->radius_ = radius;
 	agent->timeHorizon_ = timeHorizon;
 	agent->timeHorizonObst_ = timeHorizonObst;
 	agent->maxAccel_ = maxAccel;
 	agent->prefSpeed_ = prefSpeed;
-	agent->velocity_ = velocity;
+	agent->reserveNeighbors(maxReservedObstacleNeighbors());
 
-	agent->id_ = agents_.size();
+	return agent->id_;
+}
 
-	agents_.push_back(agent);
+size_t RVOSimulator::addObstacle(const std::vector<Vector2>& vertices) {
+	neighborListsValid_ = false;
+	return editObstacleSet()->addObstacle(vertices);
+}
 
-	return agents_.size() - 1;
+RVOSimulator* RVOSimulator::clone() const {
+	RVOSimulator* sim = new RVOSimulator();
+	sim->copyFrom(*this);
+	return sim;
 }
 
-size_t RVOSimulator::addObstacle(const std::vector<Vector2>& vertices) {
-	if (vertices.size() < 2) {
-		return RVO_ERROR;
+void RVOSimulator::copyFrom(const RVOSimulator& other) {
+	if (&other == this) {
+		return;
 	}
 
-	const size_t obstacleNo = obstacles_.size();
+	reset();
 
-	for (size_t i = 0; i < vertices.size(); ++i) {
-		Obstacle* obstacle = new Obstacle();
-		obstacle->point_ = vertices[i];
-
-		if (i != 0) {
-			obstacle->prevObstacle_ = obstacles_.back();
-			obstacle->prevObstacle_->nextObstacle_ = obstacle;
+	if (other.defaultAgent_ == NULL) {
+		delete defaultAgent_;
+		defaultAgent_ = NULL;
+	} else {
+		if (defaultAgent_ == NULL) {
+			defaultAgent_ = new Agent(this);
 		}
 
-		if (i == vertices.size() - 1) {
-			obstacle->nextObstacle_ = obstacles_[obstacleNo];
-			obstacle->nextObstacle_->prevObstacle_ = obstacle;
-		}
+		defaultAgent_->copyParameters(*other.defaultAgent_);
+	}
 
-		obstacle->unitDir_ = normalize(vertices[(i == vertices.size() - 1 ? 0 : i + 1)]
-		                               - vertices[i]);
+	defaultMaxSpeed_ = other.defaultMaxSpeed_;
+	defaultRadius_ = other.defaultRadius_;
+	defaultVelocity_ = other.defaultVelocity_;
+	globalTime_ = other.globalTime_;
+	timeStep_ = other.timeStep_;
+	neighborSkin_ = other.neighborSkin_;
+
+	for (size_t i = 0; i < other.agents_.size(); ++i) {
+		Agent* agent = newAgent(other.agentPositions_[i], other.agentRadii_[i],
+		                        other.agentMaxSpeeds_[i],
+		                        other.agentVelocities_[i]);
+		agent->copyParameters(*other.agents_[i]);
+	}
 
-		if (vertices.size() == 2) {
-			obstacle->isConvex_ = true;
-		} else {
-			obstacle->isConvex_ = (leftOf(vertices[(i == 0 ? vertices.size() - 1 : i - 1)],
-			                              vertices[i], vertices[(i == vertices.size() - 1 ? 0 : i + 1)]) >= 0.0f);
-		}
+	agentPrefVelocities_ = other.agentPrefVelocities_;
 
-		obstacle->id_ = obstacles_.size();
+	/* Copied on write by editObstacleSet() of either simulation. */
+	obstacleSet_ = other.obstacleSet_;
 
-		obstacles_.push_back(obstacle);
-	}
+	reserveAgentNeighbors();
+}
 
-	return obstacleNo;
+void RVOSimulator::computeNeighbors(Agent* agent) const {
+	if (neighborSkin_ > 0.0f) {
+		if (rebuildNeighborLists_) {
+			agent->computeNeighborCandidates(neighborSkin_);
+		}
+
+		agent->computeListedNeighbors();
+	} else {
+		agent->computeNeighbors();
+	}
 }
 
 void RVOSimulator::doStep() {
-	kdTree_->buildAgentTree();
+	prepareNeighbors();
 
 // #ifdef _OPENMP
 // 	#pragma omp parallel for
 // #endif
 	for (int i = 0; i < static_cast<int>(agents_.size()); ++i) {
-		agents_[i]->computeNeighbors();
+		agents_[i]->computePrefVelocity();
+		computeNeighbors(agents_[i]);
 		agents_[i]->computeNewVelocity();
 	}
 
@@ -216,9 +265,76 @@ void RVOSimulator::doStep() {
 	globalTime_ += timeStep_;
 }
 
+void RVOSimulator::doStep(ThreadPool& pool) {
+	prepareNeighbors();
+
+	/*
+	 * Each agent only writes its own preferred velocity, neighbors, ORCA lines
+	 * and new velocity, and only reads the positions and velocities of
+	 * others, which are not written until every new velocity is known.
+	 */
+	pool.parallelFor(agents_.size(), [this](size_t begin, size_t end, size_t) {
+		for (size_t i = begin; i < end; ++i) {
+			agents_[i]->computePrefVelocity();
+			computeNeighbors(agents_[i]);
+			agents_[i]->computeNewVelocity();
+		}
+	});
+
+	pool.parallelFor(agents_.size(), [this](size_t begin, size_t end, size_t) {
+		for (size_t i = begin; i < end; ++i) {
+			agents_[i]->update();
+		}
+	});
+
+	globalTime_ += timeStep_;
+}
+
+void RVOSimulator::reserveStepScratch() const {
+	size_t maxNeighbors = 0;
+
+	for (size_t i = 0; i < agents_.size(); ++i) {
+		maxNeighbors = std::max(maxNeighbors, agents_[i]->maxNeighbors_);
+	}
+
+	/* linearProgram3() projects at most the ORCA lines of an agent. */
+	reserveLinearProgram3(maxReservedObstacleNeighbors() + maxNeighbors);
+
+	if (obstacleSet_) {
+		obstacleSet_->reserveQueryStacks();
+	}
+}
+
+void RVOSimulator::reserveStepScratch(ThreadPool& pool) const {
+	pool.forEachThread([this](size_t) {
+		reserveStepScratch();
+	});
+}
+
+void RVOSimulator::doSteps(size_t numSteps, TrajectoryBuffer& trajectory) {
+	trajectory.resize(numSteps, agents_.size());
+
+	for (size_t step = 0; step < numSteps; ++step) {
+		doStep();
+		std::copy(agentPositions_.begin(), agentPositions_.end(),
+		          trajectory.getStep(step));
+	}
+}
+
+void RVOSimulator::doSteps(size_t numSteps, TrajectoryBuffer& trajectory,
+                           ThreadPool& pool) {
+	trajectory.resize(numSteps, agents_.size());
+
+	for (size_t step = 0; step < numSteps; ++step) {
+		doStep(pool);
+		std::copy(agentPositions_.begin(), agentPositions_.end(),
+		          trajectory.getStep(step));
+	}
+}
+
 size_t RVOSimulator::getAgentAgentNeighbor(size_t agentNo,
                                            size_t neighborNo) const {
-	return agents_[agentNo]->agentNeighbors_[neighborNo].second->id_;
+	return agents_[agentNo]->agentNeighbors_[neighborNo].second;
 }
 
 size_t RVOSimulator::getAgentMaxNeighbors(size_t agentNo) const {
@@ -226,7 +342,7 @@ size_t RVOSimulator::getAgentMaxNeighbors(size_t agentNo) const {
 }
 
 float RVOSimulator::getAgentMaxSpeed(size_t agentNo) const {
-	return agents_[agentNo]->maxSpeed_;
+	return agentMaxSpeeds_[agentNo];
 }
 
 float RVOSimulator::getAgentNeighborDist(size_t agentNo) const {
@@ -256,11 +372,24 @@ const Line& RVOSimulator::getAgentORCALine(size_t agentNo,
 }
 
 const Vector2& RVOSimulator::getAgentPosition(size_t agentNo) const {
-	return agents_[agentNo]->position_;
+	return agentPositions_[agentNo];
+}
+
+const Vector2& RVOSimulator::getAgentGoal(size_t agentNo) const {
+	return agents_[agentNo]->goal_;
+}
+
+PrefVelocityPolicy RVOSimulator::getAgentPrefVelocityPolicy(size_t agentNo)
+	const {
+	return agents_[agentNo]->prefVelocityPolicy_;
+}
+
+void RVOSimulator::getAgentPositions(float* positions) const {
+	copyToFloats(agentPositions_, positions);
 }
 
 const Vector2& RVOSimulator::getAgentPrefVelocity(size_t agentNo) const {
-	return agents_[agentNo]->prefVelocity_;
+	return agentPrefVelocities_[agentNo];
 }
 
 float RVOSimulator::getAgentPrefSpeed(size_t agentNo) const {
@@ -268,7 +397,7 @@ float RVOSimulator::getAgentPrefSpeed(size_t agentNo) const {
 }
 
 float RVOSimulator::getAgentRadius(size_t agentNo) const {
-	return agents_[agentNo]->radius_;
+	return agentRadii_[agentNo];
 }
 
 float RVOSimulator::getAgentTimeHorizon(size_t agentNo) const {
@@ -280,7 +409,11 @@ float RVOSimulator::getAgentTimeHorizonObst(size_t agentNo) const {
 }
 
 const Vector2& RVOSimulator::getAgentVelocity(size_t agentNo) const {
-	return agents_[agentNo]->velocity_;
+	return agentVelocities_[agentNo];
+}
+
+void RVOSimulator::getAgentVelocities(float* velocities) const {
+	copyToFloats(agentVelocities_, velocities);
 }
 
 float RVOSimulator::getGlobalTime() const {
@@ -291,33 +424,157 @@ size_t RVOSimulator::getNumAgents() const {
 	return agents_.size();
 }
 
+float RVOSimulator::getNeighborSkin() const {
+	return neighborSkin_;
+}
+
+size_t RVOSimulator::getNumNeighborListBuilds() const {
+	return numNeighborListBuilds_;
+}
+
+size_t RVOSimulator::getNumNeighborListSteps() const {
+	return numNeighborListSteps_;
+}
+
 size_t RVOSimulator::getNumObstacleVertices() const {
-	return obstacles_.size();
+	return (obstacleSet_ ? obstacleSet_->getNumObstacleVertices() : 0);
 }
 
 const Vector2& RVOSimulator::getObstacleVertex(size_t vertexNo) const {
-	return obstacles_[vertexNo]->point_;
+	return obstacleSet_->getObstacleVertex(vertexNo);
 }
 
 size_t RVOSimulator::getNextObstacleVertexNo(size_t vertexNo) const {
-	return obstacles_[vertexNo]->nextObstacle_->id_;
+	return obstacleSet_->getNextObstacleVertexNo(vertexNo);
 }
 
 size_t RVOSimulator::getPrevObstacleVertexNo(size_t vertexNo) const {
-	return obstacles_[vertexNo]->prevObstacle_->id_;
+	return obstacleSet_->getPrevObstacleVertexNo(vertexNo);
 }
 
 float RVOSimulator::getTimeStep() const {
 	return timeStep_;
 }
 
-void RVOSimulator::processObstacles() {
-	kdTree_->buildObstacleTree();
+const std::shared_ptr<const ObstacleSet>& RVOSimulator::getObstacleSet() const {
+	return obstacleSet_;
+}
+
+void RVOSimulator::processObstacles(size_t maxSplitCandidates) {
+	if (!obstacleSet_ || !obstacleSet_->isProcessed()) {
+		editObstacleSet()->processObstacles(maxSplitCandidates);
+		neighborListsValid_ = false;
+		reserveAgentNeighbors();
+	}
 }
 
 bool RVOSimulator::queryVisibility(const Vector2& point1, const Vector2& point2,
                                    float radius) const {
-	return kdTree_->queryVisibility(point1, point2, radius);
+	return (obstacleSet_ ? obstacleSet_->queryVisibility(point1, point2, radius) :
+	        true);
+}
+
+Agent* RVOSimulator::newAgent(const Vector2& position, float radius,
+                              float maxSpeed, const Vector2& velocity) {
+	Agent* agent = NULL;
+
+	if (freeAgents_.empty()) {
+		agent = new Agent(this);
+	} else {
+		agent = freeAgents_.back();
+		freeAgents_.pop_back();
+
+		agent->agentNeighbors_.clear();
+		agent->obstacleNeighbors_.clear();
+		agent->orcaLines_.clear();
+		agent->newVelocity_ = Vector2();
+		agent->goal_ = Vector2();
+		agent->prefVelocityPolicy_ = PREF_VELOCITY_MANUAL;
+	}
+
+	agent->id_ = agents_.size();
+	agents_.push_back(agent);
+
+	agentPositions_.push_back(position);
+	agentVelocities_.push_back(velocity);
+	agentPrefVelocities_.push_back(Vector2());
+	agentRadii_.push_back(radius);
+	agentMaxSpeeds_.push_back(maxSpeed);
+
+	return agent;
+}
+
+void RVOSimulator::reset() {
+	freeAgents_.insert(freeAgents_.end(), agents_.begin(), agents_.end());
+	agents_.clear();
+	kdTree_->agents_.clear();
+
+	agentPositions_.clear();
+	agentVelocities_.clear();
+	agentPrefVelocities_.clear();
+	agentRadii_.clear();
+	agentMaxSpeeds_.clear();
+
+	obstacleSet_.reset();
+	ownObstacleSet_ = NULL;
+
+	neighborListsValid_ = false;
+	neighborListPositions_.clear();
+	numNeighborListBuilds_ = 0;
+	numNeighborListSteps_ = 0;
+
+	globalTime_ = 0.0f;
+}
+
+ObstacleSet* RVOSimulator::editObstacleSet() {
+	if (ownObstacleSet_ == NULL || obstacleSet_.use_count() > 1) {
+		std::shared_ptr<ObstacleSet> obstacleSet = (obstacleSet_ ?
+		                                            std::make_shared<ObstacleSet>(*obstacleSet_) :
+		                                            std::make_shared<ObstacleSet>());
+		obstacleSet_ = obstacleSet;
+		ownObstacleSet_ = obstacleSet.get();
+	}
+
+	return ownObstacleSet_;
+}
+
+size_t RVOSimulator::maxReservedObstacleNeighbors() const {
+	return (obstacleSet_ ? std::min(obstacleSet_->getNumObstacleVertices(),
+	                                MAX_RESERVED_OBSTACLE_NEIGHBORS) : 0);
+}
+
+void RVOSimulator::reserveAgentNeighbors() {
+	const size_t maxObstacleNeighbors = maxReservedObstacleNeighbors();
+
+	for (size_t i = 0; i < agents_.size(); ++i) {
+		agents_[i]->reserveNeighbors(maxObstacleNeighbors);
+	}
+}
+
+void RVOSimulator::prepareNeighbors() {
+	if (neighborSkin_ <= 0.0f) {
+		kdTree_->buildAgentTree();
+		return;
+	}
+
+	rebuildNeighborLists_ = (!neighborListsValid_ ||
+	                         neighborListPositions_.size() != agents_.size());
+
+	const float maxMoveSq = sqr(0.5f * neighborSkin_);
+
+	for (size_t i = 0; i < agents_.size() && !rebuildNeighborLists_; ++i) {
+		rebuildNeighborLists_ = (absSq(agentPositions_[i] -
+		                               neighborListPositions_[i]) > maxMoveSq);
+	}
+
+	if (rebuildNeighborLists_) {
+		kdTree_->buildAgentTree();
+		neighborListPositions_ = agentPositions_;
+		neighborListsValid_ = true;
+		++numNeighborListBuilds_;
+	}
+
+	++numNeighborListSteps_;
 }
 
 void RVOSimulator::setAgentDefaults(float neighborDist, size_t maxNeighbors,
@@ -330,14 +587,15 @@ void RVOSimulator::setAgentDefaults(float neighborDist, size_t maxNeighbors,
 	}
 
 	defaultAgent_->maxNeighbors_ = maxNeighbors;
-	defaultAgent_->maxSpeed_ = maxSpeed;
 	defaultAgent_->neighborDist_ = neighborDist;
-	defaultAgent_->radius_ = radius;
 	defaultAgent_->timeHorizon_ = timeHorizon;
 	defaultAgent_->timeHorizonObst_ = timeHorizonObst;
 	defaultAgent_->maxAccel_ = maxAccel;
 	defaultAgent_->prefSpeed_ = prefSpeed;
-	defaultAgent_->velocity_ = velocity;
+
+	defaultMaxSpeed_ = maxSpeed;
+	defaultRadius_ = radius;
+	defaultVelocity_ = velocity;
 }
 
 void RVOSimulator::setAgentMaxAcceleration(size_t agentNo, float maxAccel) {
@@ -345,19 +603,32 @@ void RVOSimulator::setAgentMaxAcceleration(size_t agentNo, float maxAccel) {
 }
 
 void RVOSimulator::setAgentMaxNeighbors(size_t agentNo, size_t maxNeighbors) {
+	neighborListsValid_ = false;
 	agents_[agentNo]->maxNeighbors_ = maxNeighbors;
+	agents_[agentNo]->reserveNeighbors(maxReservedObstacleNeighbors());
 }
 
 void RVOSimulator::setAgentMaxSpeed(size_t agentNo, float maxSpeed) {
-	agents_[agentNo]->maxSpeed_ = maxSpeed;
+	neighborListsValid_ = false;
+	agentMaxSpeeds_[agentNo] = maxSpeed;
 }
 
 void RVOSimulator::setAgentNeighborDist(size_t agentNo, float neighborDist) {
+	neighborListsValid_ = false;
 	agents_[agentNo]->neighborDist_ = neighborDist;
 }
 
 void RVOSimulator::setAgentPosition(size_t agentNo, const Vector2& position) {
-	agents_[agentNo]->position_ = position;
+	agentPositions_[agentNo] = position;
+}
+
+void RVOSimulator::setAgentGoal(size_t agentNo, const Vector2& goal) {
+	agents_[agentNo]->goal_ = goal;
+	agents_[agentNo]->prefVelocityPolicy_ = PREF_VELOCITY_GOAL;
+}
+
+void RVOSimulator::setAgentPositions(const float* positions) {
+	copyFromFloats(positions, agentPositions_);
 }
 
 void RVOSimulator::setAgentPrefSpeed(size_t agentNo, float prefSpeed) {
@@ -366,11 +637,27 @@ void RVOSimulator::setAgentPrefSpeed(size_t agentNo, float prefSpeed) {
 
 void RVOSimulator::setAgentPrefVelocity(size_t agentNo,
                                         const Vector2& prefVelocity) {
-	agents_[agentNo]->prefVelocity_ = prefVelocity;
+	agentPrefVelocities_[agentNo] = prefVelocity;
+}
+
+void RVOSimulator::setAgentPrefVelocities(const float* prefVelocities) {
+	copyFromFloats(prefVelocities, agentPrefVelocities_);
+}
+
+void RVOSimulator::setAgentPrefVelocitiesFromGoals() {
+	for (size_t i = 0; i < agents_.size(); ++i) {
+		agents_[i]->computeGoalPrefVelocity();
+	}
+}
+
+void RVOSimulator::setAgentPrefVelocityPolicy(size_t agentNo,
+                                              PrefVelocityPolicy policy) {
+	agents_[agentNo]->prefVelocityPolicy_ = policy;
 }
 
 void RVOSimulator::setAgentRadius(size_t agentNo, float radius) {
-	agents_[agentNo]->radius_ = radius;
+	neighborListsValid_ = false;
+	agentRadii_[agentNo] = radius;
 }
 
 void RVOSimulator::setAgentTimeHorizon(size_t agentNo, float timeHorizon) {
@@ -379,14 +666,56 @@ void RVOSimulator::setAgentTimeHorizon(size_t agentNo, float timeHorizon) {
 
 void RVOSimulator::setAgentTimeHorizonObst(size_t agentNo,
                                            float timeHorizonObst) {
+	neighborListsValid_ = false;
 	agents_[agentNo]->timeHorizonObst_ = timeHorizonObst;
 }
 
 void RVOSimulator::setAgentVelocity(size_t agentNo, const Vector2& velocity) {
-	agents_[agentNo]->velocity_ = velocity;
+	agentVelocities_[agentNo] = velocity;
+}
+
+void RVOSimulator::setAgentVelocities(const float* velocities) {
+	copyFromFloats(velocities, agentVelocities_);
+}
+
+void RVOSimulator::setNeighborSkin(float skin) {
+	neighborSkin_ = skin;
+	neighborListsValid_ = false;
+}
+
+void RVOSimulator::setObstacleSet(const std::shared_ptr<const ObstacleSet>&
+                                  obstacleSet) {
+	obstacleSet_ = obstacleSet;
+	ownObstacleSet_ = NULL;
+	neighborListsValid_ = false;
+	reserveAgentNeighbors();
 }
 
 void RVOSimulator::setTimeStep(float timeStep) {
 	timeStep_ = timeStep;
 }
+
+void RVOSimulator::sweepAgentPrefVelocities(size_t agentNo,
+                                            const std::vector<Vector2>& prefVelocities,
+                                            std::vector<Vector2>& velocities) {
+	kdTree_->buildAgentTree();
+
+	Agent* const agent = agents_[agentNo];
+	agent->computeNeighbors();
+	agent->computeORCALines();
+
+	velocities.resize(prefVelocities.size());
+
+	if (prefVelocities.empty()) {
+		return;
+	}
+
+	const FeasibleVelocityRegion region(agent->orcaLines_, agent->numObstLines_,
+	                                    agentMaxSpeeds_[agentNo]);
+	region.project(&prefVelocities[0], &velocities[0], prefVelocities.size());
+
+	for (size_t i = 0; i < velocities.size(); ++i) {
+		velocities[i] = agent->acceleratedVelocity(velocities[i]);
+	}
+}
 }
@@ -0,0 +1,27 @@
+/*
+ * TrajectoryBuffer.cpp
+ * RVO2 Library
+ *
+ * Copyright (c) 2015 RAD-UoE Informatics (MIT).
+ */
+
+#include "rvo_wrapper/TrajectoryBuffer.h"
+
+namespace RVO {
+TrajectoryBuffer::TrajectoryBuffer() : numSteps_(0), numAgents_(0) { }
+
+void TrajectoryBuffer::reserve(size_t numSteps, size_t numAgents) {
+	positions_.reserve(numSteps * numAgents);
+}
+
+void TrajectoryBuffer::resize(size_t numSteps, size_t numAgents) {
+	positions_.resize(numSteps * numAgents);
+	numSteps_ = numSteps;
+	numAgents_ = numAgents;
+}
+
+const float* TrajectoryBuffer::data() const {
+	return (positions_.empty() ? NULL :
+	        reinterpret_cast<const float*>(&positions_[0]));
+}
+}
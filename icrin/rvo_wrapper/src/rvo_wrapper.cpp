@@ -23,11 +23,22 @@ RVOWrapper::~RVOWrapper() {
     delete (sim_vect_[i]);
   }
   sim_vect_.clear();
+  for (size_t i = 0; i < batch_vect_.size(); ++i) {
+    delete batch_vect_[i];
+  }
+  batch_vect_.clear();
+  delete thread_pool_;
+  thread_pool_ = NULL;
 }
 
 void RVOWrapper::init() {
   planner_init_ = false;
   debug_ = false;
+  int threads;
+  ros::param::param("~threads", threads, 0);  // 0 uses every core
+  thread_pool_ = new RVO::ThreadPool((threads > 0) ? threads : 0);
+  // Neighbour list skin of created sims, 0 queries the kd-trees every step
+  ros::param::param("~neighbor_skin", neighbor_skin_, 0.0f);
 }
 
 void RVOWrapper::rosSetup() {
@@ -52,6 +63,12 @@ void RVOWrapper::rosSetup() {
   srv_do_step_ =
     nh_->advertiseService("do_step",
                           &RVOWrapper::doStep, this);
+  srv_do_steps_ =
+    nh_->advertiseService("do_steps",
+                          &RVOWrapper::doSteps, this);
+  srv_fork_sim_ =
+    nh_->advertiseService("fork_sim",
+                          &RVOWrapper::forkSim, this);
   srv_get_agent_agent_neighbor_ =
     nh_->advertiseService("get_agent_agent_neighbor",
                           &RVOWrapper::getAgentAgentNeighbor, this);
@@ -82,6 +99,9 @@ void RVOWrapper::rosSetup() {
   srv_get_agent_radius_ =
     nh_->advertiseService("get_agent_radius",
                           &RVOWrapper::getAgentRadius, this);
+  srv_get_agent_states_ =
+    nh_->advertiseService("get_agent_states",
+                          &RVOWrapper::getAgentStates, this);
   srv_get_agent_time_horizon_ =
     nh_->advertiseService("get_agent_time_horizon",
                           &RVOWrapper::getAgentTimeHorizon, this);
@@ -106,6 +126,9 @@ void RVOWrapper::rosSetup() {
   srv_query_visibility_ =
     nh_->advertiseService("query_visibility",
                           &RVOWrapper::queryVisibility, this);
+  srv_run_scenario_ =
+    nh_->advertiseService("run_scenario",
+                          &RVOWrapper::runScenario, this);
   srv_set_agent_defaults_ =
     nh_->advertiseService("set_agent_defaults",
                           &RVOWrapper::setAgentDefaults, this);
@@ -136,6 +159,9 @@ void RVOWrapper::rosSetup() {
   srv_set_agent_radius_ =
     nh_->advertiseService("set_agent_radius",
                           &RVOWrapper::setAgentRadius, this);
+  srv_set_agent_states_ =
+    nh_->advertiseService("set_agent_states",
+                          &RVOWrapper::setAgentStates, this);
   srv_set_agent_time_horizon_ =
     nh_->advertiseService("set_agent_time_horizon",
                           &RVOWrapper::setAgentTimeHorizon, this);
@@ -150,6 +176,27 @@ void RVOWrapper::rosSetup() {
                           &RVOWrapper::setTimeStep, this);
 }
 
+bool RVOWrapper::goodSimRange(const std::vector<uint32_t>& sim_ids,
+                              bool batch_ok) const {
+  if ((sim_ids.back() < sim_ids.front()) ||
+      (sim_ids.back() >= sim_vect_.size())) {return false;}
+  if (batch_ok) {return true;}
+  for (uint32_t i = sim_ids.front(); i <= sim_ids.back(); ++i) {
+    if (sim_vect_[i] == NULL) {return false;}  // Batch worlds have no sim
+  }
+  return true;
+}
+
+RVO::BatchSimulator* RVOWrapper::simBatch(uint32_t sim_id,
+                                          size_t* world) const {
+  // Batches are created in sim id order
+  size_t batch = std::upper_bound(batch_first_ids_.begin(),
+                                  batch_first_ids_.end(), sim_id) -
+                 batch_first_ids_.begin() - 1;
+  *world = sim_id - batch_first_ids_[batch];
+  return batch_vect_[batch];
+}
+
 bool RVOWrapper::addAgent(
   rvo_wrapper_msgs::AddAgent::Request& req,
   rvo_wrapper_msgs::AddAgent::Response& res) {
@@ -169,27 +216,43 @@ bool RVOWrapper::addAgent(
                                         req.defaults.max_accel,
                                         req.defaults.pref_speed);
     }
-    planner_goals_.push_back(RVO::Vector2(0.0f, 0.0f));
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
-      if (req.defaults.radius == 0.0f) {  // If defaults not set
-        for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
-          res.agent_id = sim_vect_[i]->addAgent(agent_pos);
-          sim_vect_goals_[i].push_back(RVO::Vector2(0.0f, 0.0f));
+    if (this->goodSimRange(req.sim_ids, true)) {  // If good sim id range
+      RVO::BatchSimulator* last_batch = NULL;
+      for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
+        if (sim_vect_[i] != NULL) {
+          if (req.defaults.radius == 0.0f) {  // If defaults not set
+            res.agent_id = sim_vect_[i]->addAgent(agent_pos);
+          } else {
+            res.agent_id = sim_vect_[i]->addAgent(
+                             agent_pos,
+                             req.defaults.neighbor_dist,
+                             req.defaults.max_neighbors,
+                             req.defaults.time_horizon_agent,
+                             req.defaults.time_horizon_obst,
+                             req.defaults.radius,
+                             req.defaults.max_speed,
+                             req.defaults.max_accel,
+                             req.defaults.pref_speed);
+          }
+          continue;
         }
-      } else {
-        for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
-          res.agent_id = sim_vect_[i]->addAgent(agent_pos,
-                                                req.defaults.neighbor_dist,
-                                                req.defaults.max_neighbors,
-                                                req.defaults.time_horizon_agent,
-                                                req.defaults.time_horizon_obst,
-                                                req.defaults.radius,
-                                                req.defaults.max_speed,
-                                                req.defaults.max_accel,
-                                                req.defaults.pref_speed);
-          sim_vect_goals_[i].push_back(RVO::Vector2(0.0f, 0.0f));
+        size_t world;
+        RVO::BatchSimulator* batch = this->simBatch(i, &world);
+        if (batch == last_batch) {continue;}  // Agents join every batch world
+        last_batch = batch;
+        if (req.defaults.radius == 0.0f) {  // If defaults not set
+          res.agent_id = batch->addAgent(agent_pos);
+        } else {
+          res.agent_id = batch->addAgent(agent_pos,
+                                         req.defaults.neighbor_dist,
+                                         req.defaults.max_neighbors,
+                                         req.defaults.time_horizon_agent,
+                                         req.defaults.time_horizon_obst,
+                                         req.defaults.radius,
+                                         req.defaults.max_speed,
+                                         req.defaults.max_accel,
+                                         req.defaults.pref_speed);
         }
       }
     } else {
@@ -203,6 +266,48 @@ bool RVOWrapper::addAgent(
   return true;
 }
 
+void RVOWrapper::editObstacleSets(uint32_t first_sim, uint32_t last_sim,
+                                  const std::vector<RVO::Vector2>* vertices,
+                                  size_t max_split_candidates) {
+  // Sims sharing an obstacle set share its edited copy, so a map is copied
+  // and its tree built once per set rather than once per sim
+  std::map<const RVO::ObstacleSet*,
+      std::shared_ptr<const RVO::ObstacleSet> > edited_sets;
+  for (uint32_t i = first_sim; i <= last_sim; ++i) {
+    const std::shared_ptr<const RVO::ObstacleSet>& obstacle_set =
+      sim_vect_[i]->getObstacleSet();
+    if (vertices == NULL && obstacle_set && obstacle_set->isProcessed()) {
+      continue;  // Already processed
+    }
+    std::shared_ptr<const RVO::ObstacleSet>& edited_set =
+      edited_sets[obstacle_set.get()];
+    if (!edited_set) {
+      std::shared_ptr<RVO::ObstacleSet> new_set = obstacle_set ?
+        std::make_shared<RVO::ObstacleSet>(*obstacle_set) :
+        std::make_shared<RVO::ObstacleSet>();
+      if (vertices != NULL) {
+        new_set->addObstacle(*vertices);
+      } else {
+        new_set->processObstacles(max_split_candidates);
+      }
+      edited_set = new_set;
+    }
+    sim_vect_[i]->setObstacleSet(edited_set);
+  }
+}
+
+void RVOWrapper::addObstacleTreeStats(
+  const RVO::RVOSimulator* sim,
+  rvo_wrapper_msgs::ProcessObstacles::Response* res) {
+  const std::shared_ptr<const RVO::ObstacleSet>& obstacle_set =
+    sim->getObstacleSet();
+  if (obstacle_set) {
+    res->build_time = std::max(res->build_time, obstacle_set->getBuildTime());
+    res->tree_depth = std::max<uint32_t>(res->tree_depth,
+                                         obstacle_set->getTreeDepth());
+  }
+}
+
 bool RVOWrapper::addObstacle(
   rvo_wrapper_msgs::AddObstacle::Request& req,
   rvo_wrapper_msgs::AddObstacle::Response& res) {
@@ -214,11 +319,9 @@ bool RVOWrapper::addObstacle(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     planner_->addObstacle(vertices);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
-      for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
-        sim_vect_[i]->addObstacle(vertices);
-      }
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
+      this->editObstacleSets(req.sim_ids.front(), req.sim_ids.back(),
+                             &vertices);
     } else {
       ROS_WARN("Please provide a proper id range for sim_vector");
       res.ok = false;
@@ -234,56 +337,12 @@ bool RVOWrapper::calcPrefVelocities(
   rvo_wrapper_msgs::CalcPrefVelocities::Request& req,
   rvo_wrapper_msgs::CalcPrefVelocities::Response& res) {
   res.ok = true;
-  // ROS_INFO("Calc");
-  // sim_vect_goals_.resize(sim_vect_.size());
-  // for (size_t i = 0; i < sim_vect_goals_.size(); ++i) {
-  //   sim_vect_goals_[i].resize(sim_vect_[i]->getNumAgents());
-  // }
-  // ROS_INFO_STREAM("CalcPrefVel: " << req.sim_ids.back() << " - " <<
-  //                 req.sim_ids.front());
-  // ROS_INFO_STREAM("CalcV- SimSize: " << sim_vect_goals_.size());
-  // for (uint32_t j = req.sim_ids.front(); j <= req.sim_ids.back(); ++j) {
-  //   ROS_INFO_STREAM("Sim:" << j << "NumA: " << sim_vect_[j]->getNumAgents());
-  //   for (uint32_t i = 0; i < sim_vect_[j]->getNumAgents(); ++i) {
-  //     ROS_INFO_STREAM(" A: " << i <<  " G:" << sim_vect_goals_[j][i].x() <<
-  //                     ", " << sim_vect_goals_[j][i].y());
-  //   }
-  // }
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
-    for (uint32_t i = 0; i < planner_->getNumAgents(); ++i) {
-      RVO::Vector2 goalVector = planner_goals_[i] -
-                                planner_->getAgentPosition(i);
-      RVO::Vector2 prefVel;
-      if (i == 0) {
-        if (RVO::absSq(goalVector) > 1.0f) {
-          goalVector = RVO::normalize(goalVector);
-        }
-        prefVel = planner_->getAgentPrefSpeed(i) * goalVector;
-      } else {
-        prefVel = planner_->getAgentVelocity(i);
-      }
-      planner_->setAgentPrefVelocity(i, prefVel);
-    }
+    planner_->setAgentPrefVelocitiesFromGoals();
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (size_t j = req.sim_ids.front(); j <= req.sim_ids.back(); ++j) {
-        for (size_t i = 0; i < sim_vect_[j]->getNumAgents(); ++i) {
-          if (sim_vect_goals_[j][i] != null_vect_) {  // Goal has been set
-            RVO::Vector2 goalVector = sim_vect_goals_[j][i] -
-                                      sim_vect_[j]->getAgentPosition(i);
-            if (RVO::absSq(goalVector) > 1.0f) {
-              goalVector = RVO::normalize(goalVector);
-            }
-            RVO::Vector2 prefVel = sim_vect_[j]->getAgentPrefSpeed(i) *
-                                   goalVector;
-            sim_vect_[j]->setAgentPrefVelocity(i, prefVel);
-          } else {
-            // Unmodelled agents have no goals, so pref vel is current vel
-            sim_vect_[j]->setAgentPrefVelocity(
-              i, sim_vect_[j]->getAgentVelocity(i));
-          }
-        }
+        sim_vect_[j]->setAgentPrefVelocitiesFromGoals();
       }
     } else {
       ROS_WARN("Please provide a proper id range for sim_vector");
@@ -301,10 +360,10 @@ bool RVOWrapper::checkReachedGoal(
   rvo_wrapper_msgs::CheckReachedGoal::Response& res) {
   res.ok = true;
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
-    ROS_INFO("RVO Wrapper- Goal: %f, %f. Dist: %f",
-             planner_goals_[0].x(), planner_goals_[0].y(),
-             RVO::absSq(planner_->getAgentPosition(0) - planner_goals_[0]));
-    if (RVO::absSq(planner_->getAgentPosition(0) - planner_goals_[0]) <
+    const RVO::Vector2& goal = planner_->getAgentGoal(0);
+    ROS_INFO("RVO Wrapper- Goal: %f, %f. Dist: %f", goal.x(), goal.y(),
+             RVO::absSq(planner_->getAgentPosition(0) - goal));
+    if (RVO::absSq(planner_->getAgentPosition(0) - goal) <
         planner_->getAgentRadius(0) / 2) {
       res.reached = true;
     } else { res.reached = false; }
@@ -336,34 +395,59 @@ bool RVOWrapper::createRVOSim(
                                        req.defaults.max_accel,
                                        req.defaults.pref_speed);
     }
+    planner_->setNeighborSkin(neighbor_skin_);
     res.sim_ids.push_back(0);
     planner_init_ = true;
+  } else if (req.sim_num > 0 && req.batch) {  // If Sim Batch
+    uint32_t sim_vect_size = sim_vect_.size();
+    RVO::BatchSimulator* batch;
+    if (req.time_step == 0.0f) {  // If defaults not set
+      batch = new RVO::BatchSimulator();
+    } else {
+      batch = new RVO::BatchSimulator(req.time_step,
+                                      req.defaults.neighbor_dist,
+                                      req.defaults.max_neighbors,
+                                      req.defaults.time_horizon_agent,
+                                      req.defaults.time_horizon_obst,
+                                      req.defaults.radius,
+                                      req.defaults.max_speed,
+                                      req.defaults.max_accel,
+                                      req.defaults.pref_speed);
+    }
+    batch->setNumWorlds(req.sim_num);
+    batch_vect_.push_back(batch);
+    batch_first_ids_.push_back(sim_vect_size);
+    // Each world keeps a sim id, without a sim of its own
+    sim_vect_.resize(sim_vect_size + req.sim_num, NULL);
+    res.sim_ids.push_back(sim_vect_size);
+    res.sim_ids.push_back(sim_vect_.size() - 1);
   } else if (req.sim_num > 0) {
     uint32_t sim_vect_size = sim_vect_.size();  // If Sim Vector
     res.sim_ids.push_back(sim_vect_size);  // Store first sim_vector id
     if (req.time_step == 0.0f) {  // If defaults not set
       for (uint32_t i = sim_vect_size; i < req.sim_num + sim_vect_size; ++i) {
         sim_vect_.push_back(new RVO::RVOSimulator());
-        std::vector<RVO::Vector2> empty;
-        sim_vect_goals_.push_back(empty);
       }
     } else {
       for (uint32_t i = sim_vect_size; i < req.sim_num + sim_vect_size; ++i) {
-        sim_vect_.push_back(new RVO::RVOSimulator(req.time_step,
-                                                  req.defaults.neighbor_dist,
-                                                  req.defaults.max_neighbors,
-                                                  req.defaults.time_horizon_agent,
-                                                  req.defaults.time_horizon_obst,
-                                                  req.defaults.radius,
-                                                  req.defaults.max_speed,
-                                                  req.defaults.max_accel,
-                                                  req.defaults.pref_speed));
-        std::vector<RVO::Vector2> empty;
-        sim_vect_goals_.push_back(empty);
+        RVO::RVOSimulator* sim = sim_pool_.acquire();  // Reuse deleted sims
+        sim->setTimeStep(req.time_step);
+        sim->setAgentDefaults(req.defaults.neighbor_dist,
+                              req.defaults.max_neighbors,
+                              req.defaults.time_horizon_agent,
+                              req.defaults.time_horizon_obst,
+                              req.defaults.radius,
+                              req.defaults.max_speed,
+                              req.defaults.max_accel,
+                              req.defaults.pref_speed);
+        sim_vect_.push_back(sim);
       }
       // Store last sim_vector id
       res.sim_ids.push_back(sim_vect_.size() - 1);
     }
+    for (uint32_t i = sim_vect_size; i < sim_vect_.size(); ++i) {
+      sim_vect_[i]->setNeighborSkin(neighbor_skin_);
+    }
   } else if (planner_init_) {
     ROS_WARN("Planner already initialised!");
     res.ok = false;
@@ -381,11 +465,16 @@ bool RVOWrapper::deleteSimVector(
     planner_init_ = false;
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
     // ROS_INFO_STREAM("SizeBefore: " << sim_vect_.size());
+    // Sims are kept in the pool for the next createRVOSim
     for (uint32_t i = 0; i < sim_vect_.size(); ++i) {
-      delete (sim_vect_[i]);
+      if (sim_vect_[i] != NULL) {sim_pool_.release(sim_vect_[i]);}
     }
     sim_vect_.clear();
-    sim_vect_goals_.clear();
+    for (size_t i = 0; i < batch_vect_.size(); ++i) {
+      delete batch_vect_[i];
+    }
+    batch_vect_.clear();
+    batch_first_ids_.clear();
     // ROS_INFO_STREAM("SizeAfter: " << sim_vect_.size());
   }
   return true;
@@ -398,16 +487,30 @@ bool RVOWrapper::doStep(
   res.ok = true;
   // ROS_INFO_STREAM("RVOW- SimSize: " << sim_vect_.size());
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
-    planner_->doStep();
+    if (RVO::splitSimSteps(1, planner_->getNumAgents(), *thread_pool_)) {
+      planner_->doStep(*thread_pool_);
+    } else {
+      planner_->doStep();
+    }
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
-#ifdef _OPENMP
-      #pragma omp parallel for
-#endif
+    if (this->goodSimRange(req.sim_ids, true)) {  // If good sim id range
+      std::vector<RVO::RVOSimulator*> sims;
+      std::vector<RVO::BatchSimulator*> batches;
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
-        // ROS_INFO_STREAM("RVOW- ID: " << i);
-        sim_vect_[i]->doStep();
+        if (sim_vect_[i] != NULL) {
+          sims.push_back(sim_vect_[i]);
+          continue;
+        }
+        size_t world;
+        RVO::BatchSimulator* batch = this->simBatch(i, &world);
+        // A batch steps every world at once
+        if (batches.empty() || batches.back() != batch) {
+          batches.push_back(batch);
+        }
+      }
+      RVO::doSimSteps(sims, 0, sims.size(), thread_pool_);
+      for (size_t i = 0; i < batches.size(); ++i) {
+        batches[i]->doStep(*thread_pool_);
       }
     } else {
       ROS_WARN("Please provide a proper id range for sim_vector");
@@ -421,6 +524,97 @@ bool RVOWrapper::doStep(
   return true;
 }
 
+bool RVOWrapper::doSteps(
+  rvo_wrapper_msgs::DoSteps::Request& req,
+  rvo_wrapper_msgs::DoSteps::Response& res) {
+  res.ok = true;
+  std::vector<RVO::RVOSimulator*> sims;
+  if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
+    sims.push_back(planner_);
+  } else if (req.sim_ids.size() > 0) {  // If Sim Vector
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
+      sims.assign(sim_vect_.begin() + req.sim_ids.front(),
+                  sim_vect_.begin() + req.sim_ids.back() + 1);
+    } else {
+      ROS_WARN("Please provide a proper id range for sim_vector");
+      res.ok = false;
+    }
+  } else {
+    ROS_WARN("RVO Planner not initialised!");
+    res.ok = false;
+  }
+  size_t agent_no = 0;
+  for (size_t i = 0; i < sims.size(); ++i) {
+    agent_no = std::max(agent_no, sims[i]->getNumAgents());
+  }
+  // Each sim rolls out on one thread unless there are too few to go round
+  std::vector<RVO::TrajectoryBuffer> trajectories(sims.size());
+  if (RVO::splitSimSteps(sims.size(), agent_no, *thread_pool_)) {
+    for (size_t i = 0; i < sims.size(); ++i) {
+      sims[i]->doSteps(req.steps, trajectories[i], *thread_pool_);
+    }
+  } else {
+    thread_pool_->parallelFor(sims.size(),
+                              [&](size_t begin, size_t end, size_t) {
+      for (size_t i = begin; i < end; ++i) {
+        sims[i]->doSteps(req.steps, trajectories[i]);
+      }
+    });
+  }
+  size_t state_no = 0;
+  res.num_agents.resize(sims.size());
+  for (size_t i = 0; i < sims.size(); ++i) {
+    res.num_agents[i] = trajectories[i].getNumAgents();
+    state_no += 2 * req.steps * res.num_agents[i];
+  }
+  res.positions.resize(state_no);
+  size_t offset = 0;
+  for (size_t i = 0; i < sims.size(); ++i) {
+    const size_t sim_state_no = 2 * req.steps * res.num_agents[i];
+    if (sim_state_no > 0) {
+      std::copy(trajectories[i].data(), trajectories[i].data() + sim_state_no,
+                res.positions.begin() + offset);
+    }
+    offset += sim_state_no;
+  }
+  return true;
+}
+
+bool RVOWrapper::forkSim(
+  rvo_wrapper_msgs::ForkSim::Request& req,
+  rvo_wrapper_msgs::ForkSim::Response& res) {
+  res.ok = true;
+  RVO::RVOSimulator* source = NULL;
+  if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
+    source = planner_;
+  } else if (req.sim_ids.size() > 0) {  // If specific simulation
+    if ((req.sim_ids[0] < sim_vect_.size()) &&
+        (sim_vect_[req.sim_ids[0]] != NULL)) {  // If good sim id
+      source = sim_vect_[req.sim_ids[0]];
+    } else {
+      ROS_WARN("Please provide a proper sim id within range");
+      res.ok = false;
+    }
+  } else {
+    ROS_WARN("RVO Planner not initialised!");
+    res.ok = false;
+  }
+  if ((source == NULL) || (req.sim_num == 0)) {return true;}
+  uint32_t sim_vect_size = sim_vect_.size();
+  for (uint32_t i = 0; i < req.sim_num; ++i) {
+    sim_vect_.push_back(sim_pool_.acquire());  // Reuse deleted sims
+  }
+  // Copies only read the source and share its obstacles until edited
+  thread_pool_->parallelFor(req.sim_num, [&](size_t begin, size_t end, size_t) {
+    for (size_t i = begin; i < end; ++i) {
+      sim_vect_[sim_vect_size + i]->copyFrom(*source);
+    }
+  });
+  res.sim_ids.push_back(sim_vect_size);  // Store first sim_vector id
+  res.sim_ids.push_back(sim_vect_.size() - 1);  // Store last sim_vector id
+  return true;
+}
+
 bool RVOWrapper::getAgentAgentNeighbor(
   rvo_wrapper_msgs::GetAgentAgentNeighbor::Request& req,
   rvo_wrapper_msgs::GetAgentAgentNeighbor::Response& res) {
@@ -429,8 +623,7 @@ bool RVOWrapper::getAgentAgentNeighbor(
     res.neighbor_id = planner_->getAgentAgentNeighbor(req.agent_id,
                                                       req.agent_neighbor);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         res.neighbor_id = sim_vect_[i]->getAgentAgentNeighbor(
                             req.agent_id, req.agent_neighbor);
@@ -453,8 +646,7 @@ bool RVOWrapper::getAgentMaxNeighbors(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     res.max_neighbors = planner_->getAgentMaxNeighbors(req.agent_id);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         res.max_neighbors = sim_vect_[i]->getAgentMaxNeighbors(req.agent_id);
       }
@@ -476,8 +668,7 @@ bool RVOWrapper::getAgentMaxSpeed(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     res.max_speed = planner_->getAgentMaxSpeed(req.agent_id);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         res.max_speed = sim_vect_[i]->getAgentMaxSpeed(req.agent_id);
       }
@@ -499,8 +690,7 @@ bool RVOWrapper::getAgentNeighborDist(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     res.max_neighbor_dist = planner_->getAgentNeighborDist(req.agent_id);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         res.max_neighbor_dist =
           sim_vect_[i]->getAgentNeighborDist(req.agent_id);
@@ -523,8 +713,7 @@ bool RVOWrapper::getAgentNumAgentNeighbors(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     res.num_neighbors = planner_->getAgentNumAgentNeighbors(req.agent_id);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         res.num_neighbors =
           sim_vect_[i]->getAgentNumAgentNeighbors(req.agent_id);
@@ -547,8 +736,7 @@ bool RVOWrapper::getAgentNumObstacleNeighbors(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     res.num_obstacles = planner_->getAgentNumObstacleNeighbors(req.agent_id);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         res.num_obstacles =
           sim_vect_[i]->getAgentNumObstacleNeighbors(req.agent_id);
@@ -572,8 +760,7 @@ bool RVOWrapper::getAgentObstacleNeighbor(
     res.obstacle_vertex =
       planner_->getAgentObstacleNeighbor(req.agent_id, req.agent_obstacle);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         res.obstacle_vertex =
           sim_vect_[i]->getAgentObstacleNeighbor(req.agent_id, req.agent_obstacle);
@@ -597,10 +784,13 @@ bool RVOWrapper::getAgentPosition(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     position = planner_->getAgentPosition(req.agent_id);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids, true)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
-        position = sim_vect_[i]->getAgentPosition(req.agent_id);
+        size_t world;
+        position = (sim_vect_[i] != NULL) ?
+                   sim_vect_[i]->getAgentPosition(req.agent_id) :
+                   this->simBatch(i, &world)->getAgentPosition(world,
+                                                               req.agent_id);
       }
     } else {
       ROS_WARN("Please provide a proper id range for sim_vector");
@@ -623,8 +813,7 @@ bool RVOWrapper::getAgentPrefVelocity(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     pref_velocity = planner_->getAgentPrefVelocity(req.agent_id);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         pref_velocity = sim_vect_[i]->getAgentPrefVelocity(req.agent_id);
       }
@@ -648,8 +837,7 @@ bool RVOWrapper::getAgentRadius(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     res.radius = planner_->getAgentRadius(req.agent_id);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         res.radius = sim_vect_[i]->getAgentRadius(req.agent_id);
       }
@@ -664,6 +852,42 @@ bool RVOWrapper::getAgentRadius(
   return true;
 }
 
+bool RVOWrapper::getAgentStates(
+  rvo_wrapper_msgs::GetAgentStates::Request& req,
+  rvo_wrapper_msgs::GetAgentStates::Response& res) {
+  res.ok = true;
+  std::vector<RVO::RVOSimulator*> sims;
+  if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
+    sims.push_back(planner_);
+  } else if (req.sim_ids.size() > 0) {  // If Sim Vector
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
+      sims.assign(sim_vect_.begin() + req.sim_ids.front(),
+                  sim_vect_.begin() + req.sim_ids.back() + 1);
+    } else {
+      ROS_WARN("Please provide a proper id range for sim_vector");
+      res.ok = false;
+    }
+  } else {
+    ROS_WARN("RVO Planner not initialised!");
+    res.ok = false;
+  }
+  size_t state_no = 0;
+  res.num_agents.resize(sims.size());
+  for (size_t i = 0; i < sims.size(); ++i) {
+    res.num_agents[i] = sims[i]->getNumAgents();
+    state_no += 2 * res.num_agents[i];
+  }
+  res.positions.resize(state_no);
+  res.velocities.resize(state_no);
+  size_t offset = 0;
+  for (size_t i = 0; i < sims.size(); ++i) {  // Copied straight from the sims
+    sims[i]->getAgentPositions(res.positions.data() + offset);
+    sims[i]->getAgentVelocities(res.velocities.data() + offset);
+    offset += 2 * res.num_agents[i];
+  }
+  return true;
+}
+
 bool RVOWrapper::getAgentTimeHorizon(
   rvo_wrapper_msgs::GetAgentTimeHorizon::Request& req,
   rvo_wrapper_msgs::GetAgentTimeHorizon::Response& res) {
@@ -671,8 +895,7 @@ bool RVOWrapper::getAgentTimeHorizon(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     res.agent_time_horizon = planner_->getAgentTimeHorizon(req.agent_id);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         res.agent_time_horizon =
           sim_vect_[i]->getAgentTimeHorizon(req.agent_id);
@@ -695,8 +918,7 @@ bool RVOWrapper::getAgentTimeHorizonObst(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     res.obst_time_horizon = planner_->getAgentTimeHorizonObst(req.agent_id);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         res.obst_time_horizon =
           sim_vect_[i]->getAgentTimeHorizonObst(req.agent_id);
@@ -720,10 +942,13 @@ bool RVOWrapper::getAgentVelocity(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     velocity.push_back(planner_->getAgentVelocity(req.agent_id[0]));
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids, true)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
-        velocity.push_back(sim_vect_[i]->getAgentVelocity(req.agent_id[i]));
+        size_t world;
+        velocity.push_back((sim_vect_[i] != NULL) ?
+                           sim_vect_[i]->getAgentVelocity(req.agent_id[i]) :
+                           this->simBatch(i, &world)->getAgentVelocity(
+                             world, req.agent_id[i]));
       }
     } else {
       ROS_WARN("Please provide a proper id range for sim_vector");
@@ -748,8 +973,7 @@ bool RVOWrapper::getGlobalTime(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     res.global_time = planner_->getGlobalTime();
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         res.global_time = sim_vect_[i]->getGlobalTime();
       }
@@ -771,10 +995,12 @@ bool RVOWrapper::getNumAgents(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     res.num_agents = planner_->getNumAgents();
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids, true)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
-        res.num_agents = sim_vect_[i]->getNumAgents();
+        size_t world;
+        res.num_agents = (sim_vect_[i] != NULL) ?
+                         sim_vect_[i]->getNumAgents() :
+                         this->simBatch(i, &world)->getNumAgents();
       }
     } else {
       ROS_WARN("Please provide a proper id range for sim_vector");
@@ -794,8 +1020,7 @@ bool RVOWrapper::getTimeStep(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     res.time_step = planner_->getTimeStep();
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         res.time_step = sim_vect_[i]->getTimeStep();
       }
@@ -814,13 +1039,17 @@ bool RVOWrapper::processObstacles(
   rvo_wrapper_msgs::ProcessObstacles::Request& req,
   rvo_wrapper_msgs::ProcessObstacles::Response& res) {
   res.ok = true;
+  res.build_time = 0.0f;
+  res.tree_depth = 0;
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
-    planner_->processObstacles();
+    planner_->processObstacles(req.max_split_candidates);
+    this->addObstacleTreeStats(planner_, &res);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
+      this->editObstacleSets(req.sim_ids.front(), req.sim_ids.back(), NULL,
+                             req.max_split_candidates);
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
-        sim_vect_[i]->processObstacles();
+        this->addObstacleTreeStats(sim_vect_[i], &res);
       }
     } else {
       ROS_WARN("Please provide a proper id range for sim_vector");
@@ -842,8 +1071,7 @@ bool RVOWrapper::queryVisibility(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     res.visible = planner_->queryVisibility(point1, point2, req.radius);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         res.visible = sim_vect_[i]->queryVisibility(point1, point2, req.radius);
       }
@@ -858,6 +1086,53 @@ bool RVOWrapper::queryVisibility(
   return true;
 }
 
+bool RVOWrapper::runScenario(
+  rvo_wrapper_msgs::RunScenario::Request& req,
+  rvo_wrapper_msgs::RunScenario::Response& res) {
+  res.ok = true;
+  RVO::Scenario scenario;
+  scenario.time_step = req.time_step;
+  scenario.neighbor_dist = req.defaults.neighbor_dist;
+  scenario.max_neighbors = req.defaults.max_neighbors;
+  scenario.time_horizon_agent = req.defaults.time_horizon_agent;
+  scenario.time_horizon_obst = req.defaults.time_horizon_obst;
+  scenario.radius = req.defaults.radius;
+  scenario.max_speed = req.defaults.max_speed;
+  scenario.max_accel = req.defaults.max_accel;
+  scenario.pref_speed = req.defaults.pref_speed;
+  for (size_t i = 0; i < req.position.size(); ++i) {
+    scenario.positions.push_back(RVO::Vector2(req.position[i].x,
+                                              req.position[i].y));
+  }
+  for (size_t i = 0; i < req.velocity.size(); ++i) {
+    scenario.velocities.push_back(RVO::Vector2(req.velocity[i].x,
+                                               req.velocity[i].y));
+  }
+  for (size_t i = 0; i < req.agent_goals.size(); ++i) {
+    scenario.agent_goals.push_back(RVO::Vector2(req.agent_goals[i].x,
+                                                req.agent_goals[i].y));
+  }
+  scenario.model_agents.assign(req.model_agents.begin(),
+                               req.model_agents.end());
+  for (size_t i = 0; i < req.goals.size(); ++i) {
+    scenario.goals.push_back(RVO::Vector2(req.goals[i].x, req.goals[i].y));
+  }
+  scenario.steps = req.steps;
+  scenario.batch = req.batch;
+  std::vector<RVO::Vector2> velocity;
+  // Scenario sims are kept for the next call while the agent set holds
+  if (!scenario_runner_.run(scenario, &velocity, thread_pool_)) {
+    ROS_WARN("Please provide a proper scenario for every agent");
+    res.ok = false;
+  }
+  res.velocity.resize(velocity.size());
+  for (size_t i = 0; i < velocity.size(); ++i) {
+    res.velocity[i].x = velocity[i].x();
+    res.velocity[i].y = velocity[i].y();
+  }
+  return true;
+}
+
 bool RVOWrapper::setAgentDefaults(
   rvo_wrapper_msgs::SetAgentDefaults::Request& req,
   rvo_wrapper_msgs::SetAgentDefaults::Response& res) {
@@ -872,8 +1147,7 @@ bool RVOWrapper::setAgentDefaults(
                                req.defaults.max_accel,
                                req.defaults.pref_speed);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         sim_vect_[i]->setAgentDefaults(req.defaults.neighbor_dist,
                                        req.defaults.max_neighbors,
@@ -902,36 +1176,58 @@ bool RVOWrapper::setAgentGoals(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     uint32_t num_agents = planner_->getNumAgents();
     for (uint32_t i = 0; i < num_agents; ++i) {
-      planner_goals_[i] = RVO::Vector2(req.sim[0].agent[i].x,
-                                       req.sim[0].agent[i].y);
+      // Only the planner agent seeks its goal, the others keep moving
+      planner_->setAgentGoal(i, (i == 0) ?
+                             RVO::Vector2(req.sim[0].agent[i].x,
+                                          req.sim[0].agent[i].y) :
+                             RVO::Vector2());
     }
   } else if (req.sim_ids.size() == 1) {  // If specific simulation
     if (req.sim_ids[0] < sim_vect_.size()) {  // If good sim id
-      uint32_t num_agents = sim_vect_[req.sim_ids[0]]->getNumAgents();
+      RVO::RVOSimulator* sim = sim_vect_[req.sim_ids[0]];
+      size_t world = 0;
+      RVO::BatchSimulator* batch = (sim == NULL) ?
+                                   this->simBatch(req.sim_ids[0], &world) :
+                                   NULL;
+      uint32_t num_agents = (sim != NULL) ? sim->getNumAgents() :
+                            batch->getNumAgents();
       for (uint32_t i = 0; i < num_agents; ++i) {  // Cycle through sim agents
-        sim_vect_goals_[req.sim_ids[0]][i] =
-          RVO::Vector2(req.sim[0].agent[i].x, req.sim[0].agent[i].y);
+        RVO::Vector2 goal(req.sim[0].agent[i].x, req.sim[0].agent[i].y);
+        if (sim != NULL) {
+          sim->setAgentGoal(i, goal);
+        } else {
+          batch->setAgentGoal(world, i, goal);
+        }
       }
     } else {
       ROS_WARN("Please provide a proper sim id within range");
       res.ok = false;
     }
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids, true)) {  // If good sim id range
       if (debug_) {
         ROS_WARN_STREAM("RVOW- simVectSize: " << sim_vect_.size());
         ROS_WARN_STREAM("RVOW- F: " << req.sim_ids.front() <<
                         " B: " << req.sim_ids.back());
       }
       for (uint32_t j = req.sim_ids.front(); j <= req.sim_ids.back(); ++j) {
-        uint32_t num_agents = sim_vect_[j]->getNumAgents();
+        RVO::RVOSimulator* sim = sim_vect_[j];
+        size_t world = 0;
+        RVO::BatchSimulator* batch = (sim == NULL) ?
+                                     this->simBatch(j, &world) : NULL;
+        uint32_t num_agents = (sim != NULL) ? sim->getNumAgents() :
+                              batch->getNumAgents();
         if (debug_) {ROS_WARN_STREAM("RVOW- nA: " << num_agents);}
         // size_t sim_no = j - req.sim_ids.front();
         size_t sim_no = j;
         for (uint32_t i = 0; i < num_agents; ++i) {  // Cycle through sim agents
-          sim_vect_goals_[j][i] = RVO::Vector2(req.sim[sim_no].agent[i].x,
-                                               req.sim[sim_no].agent[i].y);
+          RVO::Vector2 goal(req.sim[sim_no].agent[i].x,
+                            req.sim[sim_no].agent[i].y);
+          if (sim != NULL) {
+            sim->setAgentGoal(i, goal);
+          } else {
+            batch->setAgentGoal(world, i, goal);
+          }
           if (debug_) {
             ROS_INFO_STREAM("RVOW- SimID: " << j << " No: " << sim_no <<
                             " A: " << i <<
@@ -958,8 +1254,7 @@ bool RVOWrapper::setAgentMaxNeighbors(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     planner_->setAgentMaxNeighbors(req.agent_id, req.max_neighbors);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         sim_vect_[i]->setAgentMaxNeighbors(req.agent_id, req.max_neighbors);
       }
@@ -981,8 +1276,7 @@ bool RVOWrapper::setAgentMaxSpeed(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     planner_->setAgentMaxSpeed(req.agent_id, req.max_speed);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         sim_vect_[i]->setAgentMaxSpeed(req.agent_id, req.max_speed);
       }
@@ -1005,8 +1299,7 @@ bool RVOWrapper::setAgentMaxAccel(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     planner_->setAgentMaxAcceleration(req.agent_id, req.max_accel);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         sim_vect_[i]->setAgentMaxAcceleration(req.agent_id, req.max_accel);
       }
@@ -1029,8 +1322,7 @@ bool RVOWrapper::setAgentPrefSpeed(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     planner_->setAgentPrefSpeed(req.agent_id, req.pref_speed);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         sim_vect_[i]->setAgentPrefSpeed(req.agent_id, req.pref_speed);
       }
@@ -1052,8 +1344,7 @@ bool RVOWrapper::setAgentNeighborDist(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     planner_->setAgentNeighborDist(req.agent_id, req.neighbor_dist);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         sim_vect_[i]->setAgentNeighborDist(req.agent_id, req.neighbor_dist);
       }
@@ -1076,8 +1367,7 @@ bool RVOWrapper::setAgentPosition(
     planner_->setAgentPosition(req.agent_id, RVO::Vector2(req.position.x,
                                                           req.position.y));
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         sim_vect_[i]->setAgentPosition(req.agent_id, RVO::Vector2(
                                          req.position.x, req.position.y));
@@ -1101,8 +1391,7 @@ bool RVOWrapper::setAgentPrefVelocity(
     planner_->setAgentPrefVelocity(req.agent_id, RVO::Vector2(
                                      req.pref_velocity.x, req.pref_velocity.y));
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         sim_vect_[i]->setAgentPrefVelocity(req.agent_id,
                                            RVO::Vector2(req.pref_velocity.x,
@@ -1126,8 +1415,7 @@ bool RVOWrapper::setAgentRadius(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     planner_->setAgentRadius(req.agent_id, req.radius);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         sim_vect_[i]->setAgentRadius(req.agent_id, req.radius);
       }
@@ -1142,6 +1430,48 @@ bool RVOWrapper::setAgentRadius(
   return true;
 }
 
+bool RVOWrapper::setAgentStates(
+  rvo_wrapper_msgs::SetAgentStates::Request& req,
+  rvo_wrapper_msgs::SetAgentStates::Response& res) {
+  res.ok = true;
+  std::vector<RVO::RVOSimulator*> sims;
+  if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
+    sims.push_back(planner_);
+  } else if (req.sim_ids.size() > 0) {  // If Sim Vector
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
+      sims.assign(sim_vect_.begin() + req.sim_ids.front(),
+                  sim_vect_.begin() + req.sim_ids.back() + 1);
+    } else {
+      ROS_WARN("Please provide a proper id range for sim_vector");
+      res.ok = false;
+    }
+  } else {
+    ROS_WARN("RVO Planner not initialised!");
+    res.ok = false;
+  }
+  for (size_t i = 0; i < sims.size(); ++i) {
+    const size_t state_no = 2 * sims[i]->getNumAgents();
+    if ((!req.positions.empty() && req.positions.size() != state_no) ||
+        (!req.velocities.empty() && req.velocities.size() != state_no) ||
+        (!req.pref_velocities.empty() &&
+         req.pref_velocities.size() != state_no)) {
+      ROS_WARN("Please provide a state for every agent of the sims");
+      res.ok = false;
+      continue;
+    }
+    if (!req.positions.empty()) {
+      sims[i]->setAgentPositions(req.positions.data());
+    }
+    if (!req.velocities.empty()) {
+      sims[i]->setAgentVelocities(req.velocities.data());
+    }
+    if (!req.pref_velocities.empty()) {
+      sims[i]->setAgentPrefVelocities(req.pref_velocities.data());
+    }
+  }
+  return true;
+}
+
 bool RVOWrapper::setAgentTimeHorizon(
   rvo_wrapper_msgs::SetAgentTimeHorizon::Request& req,
   rvo_wrapper_msgs::SetAgentTimeHorizon::Response& res) {
@@ -1149,8 +1479,7 @@ bool RVOWrapper::setAgentTimeHorizon(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     planner_->setAgentTimeHorizon(req.agent_id, req.agent_time_horizon);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         sim_vect_[i]->setAgentTimeHorizon(req.agent_id, req.agent_time_horizon);
       }
@@ -1172,8 +1501,7 @@ bool RVOWrapper::setAgentTimeHorizonObst(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     planner_->setAgentTimeHorizonObst(req.agent_id, req.obst_time_horizon);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         sim_vect_[i]->setAgentTimeHorizonObst(req.agent_id, req.obst_time_horizon);
       }
@@ -1196,11 +1524,16 @@ bool RVOWrapper::setAgentVelocity(
     planner_->setAgentVelocity(req.agent_id, RVO::Vector2(req.velocity.x,
                                                           req.velocity.y));
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids, true)) {  // If good sim id range
+      RVO::Vector2 velocity(req.velocity.x, req.velocity.y);
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
-        sim_vect_[i]->setAgentVelocity(req.agent_id, RVO::Vector2(
-                                         req.velocity.x, req.velocity.y));
+        size_t world;
+        if (sim_vect_[i] != NULL) {
+          sim_vect_[i]->setAgentVelocity(req.agent_id, velocity);
+        } else {
+          this->simBatch(i, &world)->setAgentVelocity(world, req.agent_id,
+                                                      velocity);
+        }
       }
     } else {
       ROS_WARN("Please provide a proper id range for sim_vector");
@@ -1220,8 +1553,7 @@ bool RVOWrapper::setTimeStep(
   if (req.sim_ids.size() == 0 && planner_init_) {  // If Planner
     planner_->setTimeStep(req.time_step);
   } else if (req.sim_ids.size() > 0) {  // If Sim Vector
-    if ((req.sim_ids.back() >= req.sim_ids.front()) &&
-        (req.sim_ids.back() < sim_vect_.size())) {  // If good sim id range
+    if (this->goodSimRange(req.sim_ids)) {  // If good sim id range
       for (uint32_t i = req.sim_ids.front(); i <= req.sim_ids.back(); ++i) {
         sim_vect_[i]->setTimeStep(req.time_step);
       }
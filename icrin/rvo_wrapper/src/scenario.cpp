@@ -0,0 +1,330 @@
+/**
+ * @file      scenario.cpp
+ * @brief     Goal inference scenarios run directly on the RVO library
+ * @author    agent <agent@local>
+ * @date      2026-10-16
+ * @copyright (MIT) 2015 RAD-UoE Informatics
+ */
+
+#include <rvo_wrapper/scenario.hpp>
+
+#include <algorithm>
+
+#include <rvo_wrapper/Definitions.h>
+
+namespace RVO {
+  Scenario::Scenario() : time_step(0.1f), neighbor_dist(2.0f),
+    max_neighbors(20), time_horizon_agent(5.0f), time_horizon_obst(5.0f),
+    radius(0.5f), max_speed(1.2f), max_accel(2.4f), pref_speed(0.6f),
+    steps(1), batch(false) { }
+
+  /* Preferred velocity towards a goal, capped at the preferred speed. */
+  static Vector2 goalPrefVelocity(const Vector2& goal, const Vector2& position,
+                                  float pref_speed) {
+    Vector2 goalVector = goal - position;
+    if (absSq(goalVector) > 1.0f) {
+      goalVector = normalize(goalVector);
+    }
+    return pref_speed * goalVector;
+  }
+
+  bool interactionFree(const Scenario& scenario, size_t model_agent) {
+    if (scenario.max_neighbors == 0) {return true;}
+    const Vector2& position = scenario.positions[model_agent];
+    const float range_sq = sqr(scenario.neighbor_dist);
+    for (size_t i = 0; i < scenario.positions.size(); ++i) {
+      if ((i != model_agent) &&
+          (absSq(position - scenario.positions[i]) < range_sq)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  Vector2 freeGoalVelocity(const Scenario& scenario, size_t model_agent,
+                           const Vector2& goal) {
+    const Vector2& velocity = scenario.velocities[model_agent];
+    Vector2 pref_vel = velocity;  // Null goal keeps current velocity
+    if (goal != Vector2()) {
+      pref_vel = goalPrefVelocity(goal, scenario.positions[model_agent],
+                                  scenario.pref_speed);
+    }
+    // Without ORCA lines the linear program only clips to the max speed
+    Vector2 new_vel = pref_vel;
+    if (absSq(pref_vel) > sqr(scenario.max_speed)) {
+      new_vel = normalize(pref_vel) * scenario.max_speed;
+    }
+    // Then the acceleration limit of Agent::acceleratedVelocity
+    const float dv = abs(new_vel - velocity);
+    if (dv < scenario.max_accel * scenario.time_step) {return new_vel;}
+    return (1.0f - (scenario.max_accel * scenario.time_step / dv))
+           * velocity + (scenario.max_accel * scenario.time_step / dv)
+           * new_vel;
+  }
+
+  bool splitSimSteps(size_t sim_no, size_t agent_no,
+                     const ThreadPool& threads) {
+    return (threads.numThreads() > 1) && (sim_no < threads.numThreads()) &&
+           (agent_no >= MIN_PARALLEL_AGENTS);
+  }
+
+  void doSimSteps(const std::vector<RVOSimulator*>& sims, size_t begin,
+                  size_t end, ThreadPool* threads) {
+    if (threads == NULL) {
+      for (size_t i = begin; i < end; ++i) {sims[i]->doStep();}
+      return;
+    }
+    size_t agent_no = 0;
+    for (size_t i = begin; i < end; ++i) {
+      agent_no = std::max(agent_no, sims[i]->getNumAgents());
+    }
+    if (splitSimSteps(end - begin, agent_no, *threads)) {
+      for (size_t i = begin; i < end; ++i) {sims[i]->doStep(*threads);}
+    } else {
+      threads->parallelFor(end - begin,
+                           [&sims, begin](size_t first, size_t last, size_t) {
+        for (size_t i = begin + first; i < begin + last; ++i) {
+          sims[i]->doStep();
+        }
+      });
+    }
+  }
+
+  bool runScenario(const Scenario& scenario, std::vector<Vector2>* velocities,
+                   SimPool* pool, ThreadPool* threads) {
+    ScenarioRunner runner(pool);
+    return runner.run(scenario, velocities, threads);
+  }
+
+  ScenarioRunner::ScenarioRunner(SimPool* pool) : scene_(NULL), pool_(pool),
+    builds_(0) {
+    if (pool_ == NULL) {pool_ = &own_pool_;}
+  }
+
+  ScenarioRunner::~ScenarioRunner() {
+    this->clear();
+  }
+
+  void ScenarioRunner::clear() {
+    if (scene_ != NULL) {
+      pool_->release(scene_);
+      scene_ = NULL;
+    }
+    for (size_t i = 0; i < sims_.size(); ++i) {
+      if (sims_[i] != NULL) {pool_->release(sims_[i]);}
+    }
+    sims_.clear();
+  }
+
+  bool ScenarioRunner::sameSims(const Scenario& scenario,
+                                size_t sim_no) const {
+    return (sims_.size() == sim_no) &&
+           (scenario.time_step == scenario_.time_step) &&
+           (scenario.neighbor_dist == scenario_.neighbor_dist) &&
+           (scenario.max_neighbors == scenario_.max_neighbors) &&
+           (scenario.time_horizon_agent == scenario_.time_horizon_agent) &&
+           (scenario.time_horizon_obst == scenario_.time_horizon_obst) &&
+           (scenario.radius == scenario_.radius) &&
+           (scenario.max_speed == scenario_.max_speed) &&
+           (scenario.max_accel == scenario_.max_accel) &&
+           (scenario.pref_speed == scenario_.pref_speed) &&
+           (scenario.positions.size() == scenario_.positions.size()) &&
+           (scenario.model_agents == scenario_.model_agents) &&
+           ((scenario.steps > 1) == (scenario_.steps > 1)) &&
+           (scenario.batch == scenario_.batch);
+  }
+
+  void ScenarioRunner::buildScene(const Scenario& scenario) {
+    scene_ = pool_->acquire();
+    scene_->setTimeStep(scenario.time_step);
+    scene_->setAgentDefaults(scenario.neighbor_dist, scenario.max_neighbors,
+                             scenario.time_horizon_agent,
+                             scenario.time_horizon_obst, scenario.radius,
+                             scenario.max_speed, scenario.max_accel,
+                             scenario.pref_speed);
+    for (size_t i = 0; i < scenario.positions.size(); ++i) {
+      scene_->addAgent(scenario.positions[i]);
+      scene_->setAgentVelocity(i, scenario.velocities[i]);
+    }
+    ++builds_;
+  }
+
+  RVOSimulator* ScenarioRunner::acquireSim(const Scenario& scenario) {
+    if (scene_ == NULL) {this->buildScene(scenario);}
+    return pool_->acquire();
+  }
+
+  void ScenarioRunner::prepareSim(RVOSimulator* sim) const {
+    // Acquired sims have no agents, while scenario sims have at least the
+    // model agent. The scene is only read, so sims copy it in parallel.
+    if (sim->getNumAgents() == 0) {sim->copyFrom(*scene_);}
+    sim->setAgentPositions(&positions_[0]);
+    sim->setAgentVelocities(&velocities_[0]);
+  }
+
+  bool ScenarioRunner::run(const Scenario& scenario,
+                           std::vector<Vector2>* velocities,
+                           ThreadPool* threads) {
+    size_t agent_no = scenario.positions.size();
+    size_t goal_no = scenario.goals.size();
+    if ((scenario.velocities.size() != agent_no) ||
+        (scenario.agent_goals.size() != agent_no)) {
+      return false;
+    }
+    for (size_t m = 0; m < scenario.model_agents.size(); ++m) {
+      if (scenario.model_agents[m] >= agent_no) {return false;}
+    }
+    size_t steps = (scenario.steps > 0) ? scenario.steps : 1;
+    velocities->resize(scenario.model_agents.size() * goal_no);
+    // Within one step sims only differ in the model agent pref velocity,
+    // so a single sim per model agent sweeps all goals. A batch steps its
+    // worlds instead of sims.
+    size_t world_no = scenario.model_agents.size() * goal_no;
+    bool batch = scenario.batch && (steps > 1);
+    size_t sim_no = (steps == 1) ? scenario.model_agents.size() :
+                    batch ? 0 : world_no;
+    bool new_sims = !this->sameSims(scenario, sim_no);
+    if (new_sims) {
+      this->clear();
+      sims_.assign(sim_no, NULL);
+    }
+    // Copied and kept sims take the current agent states
+    positions_.resize(2 * agent_no);
+    velocities_.resize(2 * agent_no);
+    for (size_t i = 0; i < agent_no; ++i) {
+      positions_[2 * i] = scenario.positions[i].x();
+      positions_[2 * i + 1] = scenario.positions[i].y();
+      velocities_[2 * i] = scenario.velocities[i].x();
+      velocities_[2 * i + 1] = scenario.velocities[i].y();
+    }
+    if (steps == 1) {
+      // Sims are only acquired for model agents that interact
+      free_agents_.resize(sim_no);
+      for (size_t m = 0; m < sim_no; ++m) {
+        free_agents_[m] = interactionFree(scenario, scenario.model_agents[m]);
+        if (!free_agents_[m] && (sims_[m] == NULL)) {
+          sims_[m] = this->acquireSim(scenario);
+        }
+      }
+      // Model agents are independent sims, sharded across the threads
+      size_t thread_no = (threads == NULL) ? 1 : threads->numThreads();
+      pref_vels_.resize(thread_no);
+      goal_vels_.resize(thread_no);
+      auto sweep_goals = [&](size_t begin, size_t end, size_t thread) {
+        std::vector<Vector2>& pref_vels = pref_vels_[thread];
+        std::vector<Vector2>& goal_vels = goal_vels_[thread];
+        pref_vels.resize(goal_no);
+        for (size_t m = begin; m < end; ++m) {
+          size_t model_agent = scenario.model_agents[m];
+          if (free_agents_[m]) {  // No sim needed
+            for (size_t goal = 0; goal < goal_no; ++goal) {
+              (*velocities)[m * goal_no + goal] =
+                freeGoalVelocity(scenario, model_agent, scenario.goals[goal]);
+            }
+            continue;
+          }
+          RVOSimulator* sim = sims_[m];
+          this->prepareSim(sim);
+          for (size_t goal = 0; goal < goal_no; ++goal) {
+            if (scenario.goals[goal] != Vector2()) {
+              pref_vels[goal] =
+                goalPrefVelocity(scenario.goals[goal],
+                                 scenario.positions[model_agent],
+                                 scenario.pref_speed);
+            } else {  // Null goal keeps current velocity
+              pref_vels[goal] = scenario.velocities[model_agent];
+            }
+          }
+          sim->sweepAgentPrefVelocities(model_agent, pref_vels, goal_vels);
+          std::copy(goal_vels.begin(), goal_vels.end(),
+                    velocities->begin() + m * goal_no);
+        }
+      };
+      if (threads == NULL) {
+        sweep_goals(0, sim_no, 0);
+      } else {
+        threads->parallelFor(sim_no, sweep_goals);
+      }
+      scenario_ = scenario;
+      return true;
+    }
+    if (world_no == 0) {
+      scenario_ = scenario;
+      return true;
+    }
+    // Goals are kept by the sims until the hypotheses change
+    bool set_goals = new_sims || (scenario.goals != scenario_.goals) ||
+                     (scenario.agent_goals != scenario_.agent_goals);
+    if (batch) {
+      // Every (model agent, goal) pair is a world of one batch, set from the
+      // scene sim and stepped together over the whole horizon
+      if (scene_ == NULL) {
+        this->buildScene(scenario);
+        set_goals = true;
+      }
+      scene_->setAgentPositions(&positions_[0]);
+      scene_->setAgentVelocities(&velocities_[0]);
+      if (set_goals) {
+        for (size_t i = 0; i < agent_no; ++i) {
+          scene_->setAgentGoal(i, scenario.agent_goals[i]);
+        }
+      }
+      batch_.setWorlds(*scene_, world_no);
+      for (size_t world = 0; world < world_no; ++world) {
+        batch_.setAgentGoal(world, scenario.model_agents[world / goal_no],
+                            scenario.goals[world % goal_no]);
+      }
+      for (size_t step = 0; step < steps; ++step) {
+        if (threads == NULL) {
+          batch_.doStep();
+        } else {
+          batch_.doStep(*threads);
+        }
+      }
+      for (size_t world = 0; world < world_no; ++world) {
+        size_t model_agent = scenario.model_agents[world / goal_no];
+        (*velocities)[world] = batch_.getAgentVelocity(world, model_agent);
+      }
+      scenario_ = scenario;
+      return true;
+    }
+    if (sims_[0] == NULL) {  // Sims of a new sim set, copied in run_sims
+      set_goals = true;
+      for (size_t sim_id = 0; sim_id < sim_no; ++sim_id) {
+        sims_[sim_id] = this->acquireSim(scenario);
+      }
+    }
+    // Each (model agent, goal) pair is an independent sim, run over the
+    // whole horizon on one thread unless there are too few sims to go round
+    bool split = (threads != NULL) && splitSimSteps(sim_no, agent_no, *threads);
+    auto run_sims = [&](size_t begin, size_t end, size_t) {
+      for (size_t sim_id = begin; sim_id < end; ++sim_id) {
+        size_t model_agent = scenario.model_agents[sim_id / goal_no];
+        RVOSimulator* sim = sims_[sim_id];
+        this->prepareSim(sim);
+        if (set_goals) {
+          for (size_t i = 0; i < agent_no; ++i) {
+            sim->setAgentGoal(i, scenario.agent_goals[i]);
+          }
+          // Pref velocities are then set from the goals within each step
+          sim->setAgentGoal(model_agent, scenario.goals[sim_id % goal_no]);
+        }
+        for (size_t step = 0; step < steps; ++step) {
+          if (split) {
+            sim->doStep(*threads);
+          } else {
+            sim->doStep();
+          }
+        }
+        (*velocities)[sim_id] = sim->getAgentVelocity(model_agent);
+      }
+    };
+    if ((threads == NULL) || split) {
+      run_sims(0, sim_no, 0);
+    } else {
+      threads->parallelFor(sim_no, run_sims);
+    }
+    scenario_ = scenario;
+    return true;
+  }
+}
@@ -0,0 +1,34 @@
+/**
+ * @file      sim_pool.cpp
+ * @brief     Pool of reusable RVO simulators
+ * @author    agent <agent@local>
+ * @date      2026-10-16
+ * @copyright (MIT) 2015 RAD-UoE Informatics
+ */
+
+#include <rvo_wrapper/sim_pool.hpp>
+
+namespace RVO {
+  SimPool::SimPool() { }
+
+  SimPool::~SimPool() {
+    for (size_t i = 0; i < sims_.size(); ++i) {
+      delete sims_[i];
+    }
+    sims_.clear();
+  }
+
+  RVOSimulator* SimPool::acquire() {
+    if (sims_.empty()) {
+      return new RVOSimulator();
+    }
+    RVOSimulator* sim = sims_.back();
+    sims_.pop_back();
+    return sim;
+  }
+
+  void SimPool::release(RVOSimulator* sim) {
+    sim->reset();
+    sims_.push_back(sim);
+  }
+}
@@ -0,0 +1,93 @@
+/**
+ * @file      thread_pool.cpp
+ * @brief     Persistent worker threads for parallel simulation loops
+ * @author    agent <agent@local>
+ * @date      2026-10-16
+ * @copyright (MIT) 2015 RAD-UoE Informatics
+ */
+
+#include <rvo_wrapper/thread_pool.hpp>
+
+#include <algorithm>
+
+namespace RVO {
+  ThreadPool::ThreadPool(size_t num_threads) : stop_(false), generation_(0),
+    active_(0), task_(NULL), count_(0), chunk_(1), next_(0) {
+    if (num_threads == 0) {
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t thread = 1; thread < num_threads; ++thread) {
+      workers_.push_back(std::thread(&ThreadPool::workerLoop, this, thread));
+    }
+  }
+
+  ThreadPool::~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i].join();
+    }
+  }
+
+  void ThreadPool::parallelFor(size_t count, const Task& task) {
+    if (count == 0) {return;}
+    if (workers_.empty() || count == 1) {
+      task(0, count, 0);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      task_ = &task;
+      count_ = count;
+      // A few chunks per thread balances uneven agent neighbourhoods
+      chunk_ = std::max<size_t>(1, count / (4 * numThreads()));
+      next_ = 0;
+      active_ = workers_.size();
+      ++generation_;
+    }
+    wake_.notify_all();
+    this->runChunks(0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (active_ > 0) {done_.wait(lock);}
+    task_ = NULL;
+  }
+
+  void ThreadPool::forEachThread(
+    const std::function<void(size_t thread)>& task) {
+    // One item per thread: each thread holds on to its item until every item
+    // is taken, so no thread can take two
+    const size_t num_threads = numThreads();
+    std::atomic<size_t> arrived(0);
+    this->parallelFor(num_threads, [&task, &arrived, num_threads](
+                        size_t, size_t, size_t thread) {
+      task(thread);
+      ++arrived;
+      while (arrived < num_threads) {std::this_thread::yield();}
+    });
+  }
+
+  void ThreadPool::workerLoop(size_t thread) {
+    size_t generation = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      while (!stop_ && generation_ == generation) {wake_.wait(lock);}
+      if (stop_) {return;}
+      generation = generation_;
+      lock.unlock();
+      this->runChunks(thread);
+      lock.lock();
+      if (--active_ == 0) {done_.notify_one();}
+    }
+  }
+
+  void ThreadPool::runChunks(size_t thread) {
+    while (true) {
+      size_t begin = next_.fetch_add(chunk_);
+      if (begin >= count_) {break;}
+      (*task_)(begin, std::min(begin + chunk_, count_), thread);
+    }
+  }
+}
@@ -0,0 +1,116 @@
+/**
+ * @file      test_obstacle_tree.cpp
+ * @brief     Agent velocities over exact and sampled obstacle trees
+ * @author    agent <agent@local>
+ * @date      2026-10-16
+ * @copyright (MIT) 2015 RAD-UoE Informatics
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <rvo_wrapper/ObstacleSet.h>
+#include <rvo_wrapper/RVOSimulator.h>
+
+namespace {
+const size_t SAMPLED_SPLIT_CANDIDATES = 32;
+
+// 200 overlapping boxes over a 40x40 m area, so the tree splits edges
+std::shared_ptr<RVO::ObstacleSet> buildMap() {
+  std::shared_ptr<RVO::ObstacleSet> obstacle_set =
+    std::make_shared<RVO::ObstacleSet>();
+  std::srand(1);
+  for (int o = 0; o < 200; ++o) {
+    float x = (std::rand() % 4000) / 100.0f;
+    float y = (std::rand() % 4000) / 100.0f;
+    float w = 0.3f + (std::rand() % 300) / 100.0f;
+    float h = 0.3f + (std::rand() % 300) / 100.0f;
+    std::vector<RVO::Vector2> vertices;
+    vertices.push_back(RVO::Vector2(x, y));
+    vertices.push_back(RVO::Vector2(x + w, y));
+    vertices.push_back(RVO::Vector2(x + w, y + h));
+    vertices.push_back(RVO::Vector2(x, y + h));
+    obstacle_set->addObstacle(vertices);
+  }
+  return obstacle_set;
+}
+
+// Agent velocities after one step of 400 agents among the obstacles
+std::vector<RVO::Vector2> stepVelocities(
+  const std::shared_ptr<const RVO::ObstacleSet>& obstacle_set) {
+  RVO::RVOSimulator sim(0.1f, 3.0f, 20, 5.0f, 2.0f, 0.3f, 1.2f, 2.4f, 0.8f);
+  sim.setObstacleSet(obstacle_set);
+  std::srand(2);
+  for (size_t i = 0; i < 400; ++i) {
+    sim.addAgent(RVO::Vector2((std::rand() % 4000) / 100.0f,
+                              (std::rand() % 4000) / 100.0f));
+    float vx = (std::rand() % 100 - 50) / 50.0f;
+    float vy = (std::rand() % 100 - 50) / 50.0f;
+    sim.setAgentPrefVelocity(i, RVO::Vector2(vx, vy));
+  }
+  sim.doStep();
+  std::vector<RVO::Vector2> velocities(sim.getNumAgents());
+  for (size_t i = 0; i < sim.getNumAgents(); ++i) {
+    velocities[i] = sim.getAgentVelocity(i);
+  }
+  return velocities;
+}
+
+size_t countDifferent(const std::vector<RVO::Vector2>& a,
+                      const std::vector<RVO::Vector2>& b) {
+  size_t different = 0;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i] != b[i]) {++different;}
+  }
+  return different;
+}
+}  // namespace
+
+// Trying every obstacle is the default, and a bound no node reaches builds
+// the same tree
+TEST(ObstacleTree, DefaultBuildTriesEverySplit) {
+  std::shared_ptr<RVO::ObstacleSet> exact = buildMap();
+  exact->processObstacles();
+  std::shared_ptr<RVO::ObstacleSet> unbounded = buildMap();
+  unbounded->processObstacles(unbounded->getNumObstacleVertices());
+
+  EXPECT_EQ(exact->getNumObstacleVertices(),
+            unbounded->getNumObstacleVertices());
+  EXPECT_EQ(0u, countDifferent(stepVelocities(exact),
+                               stepVelocities(unbounded)));
+}
+
+// Sampled splits cut obstacle edges at other points, which changes the
+// velocities of agents near them, so sampling has to stay opt-in
+TEST(ObstacleTree, SampledSplitsChangeVelocities) {
+  std::shared_ptr<RVO::ObstacleSet> exact = buildMap();
+  exact->processObstacles();
+  std::shared_ptr<RVO::ObstacleSet> sampled = buildMap();
+  sampled->processObstacles(SAMPLED_SPLIT_CANDIDATES);
+
+  EXPECT_NE(exact->getNumObstacleVertices(),
+            sampled->getNumObstacleVertices());
+  EXPECT_LT(0u, countDifferent(stepVelocities(exact),
+                               stepVelocities(sampled)));
+}
+
+// Copies rebuild their tree the way the original was built
+TEST(ObstacleTree, CopiesKeepSplitSampling) {
+  std::shared_ptr<RVO::ObstacleSet> sampled = buildMap();
+  sampled->processObstacles(SAMPLED_SPLIT_CANDIDATES);
+  std::shared_ptr<RVO::ObstacleSet> copy =
+    std::make_shared<RVO::ObstacleSet>(*sampled);
+
+  EXPECT_EQ(sampled->getNumObstacleVertices(),
+            copy->getNumObstacleVertices());
+  EXPECT_EQ(0u, countDifferent(stepVelocities(sampled),
+                               stepVelocities(copy)));
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
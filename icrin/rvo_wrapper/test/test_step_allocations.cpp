@@ -0,0 +1,127 @@
+/**
+ * @file      test_step_allocations.cpp
+ * @brief     Warmed-up RVOSimulator steps do not allocate on the heap
+ * @author    agent <agent@local>
+ * @date      2026-10-16
+ * @copyright (MIT) 2015 RAD-UoE Informatics
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <rvo_wrapper/RVOSimulator.h>
+#include <rvo_wrapper/thread_pool.hpp>
+
+namespace {
+std::atomic<bool> counting(false);
+std::atomic<size_t> allocations(0);
+
+void* countedAlloc(size_t size) {
+  if (counting) {++allocations;}
+  return std::malloc(size ? size : 1);
+}
+
+// Kept out of line: gcc inlining free() into a site that calls operator new
+// reports a mismatched new and delete
+[[gnu::noinline]] void countedFree(void* p) { std::free(p); }
+}  // namespace
+
+// Every heap allocation of the test binary goes through the counter
+void* operator new(size_t size) {
+  void* p = countedAlloc(size);
+  if (!p) {throw std::bad_alloc();}
+  return p;
+}
+void* operator new[](size_t size) {
+  void* p = countedAlloc(size);
+  if (!p) {throw std::bad_alloc();}
+  return p;
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return countedAlloc(size);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return countedAlloc(size);
+}
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+
+namespace {
+const size_t WARM_STEPS = 50;
+const size_t COUNTED_STEPS = 300;
+
+// 400 agents crossing a 20x20 m area between 60 box obstacles, 240 obstacle
+// vertices, so agents reserve room for every obstacle neighbor
+void buildScene(RVO::RVOSimulator* sim) {
+  std::srand(1);
+  for (int o = 0; o < 60; ++o) {
+    float x = (std::rand() % 2000) / 100.0f;
+    float y = (std::rand() % 2000) / 100.0f;
+    float w = 0.3f + (std::rand() % 200) / 100.0f;
+    float h = 0.3f + (std::rand() % 200) / 100.0f;
+    std::vector<RVO::Vector2> vertices;
+    vertices.push_back(RVO::Vector2(x, y));
+    vertices.push_back(RVO::Vector2(x + w, y));
+    vertices.push_back(RVO::Vector2(x + w, y + h));
+    vertices.push_back(RVO::Vector2(x, y + h));
+    sim->addObstacle(vertices);
+  }
+  sim->processObstacles();
+  for (size_t i = 0; i < 400; ++i) {
+    sim->addAgent(RVO::Vector2((std::rand() % 2000) / 100.0f,
+                               (std::rand() % 2000) / 100.0f));
+    float vx = (std::rand() % 100 - 50) / 50.0f;
+    float vy = (std::rand() % 100 - 50) / 50.0f;
+    sim->setAgentPrefVelocity(i, RVO::Vector2(vx, vy));
+  }
+}
+
+void doSteps(RVO::RVOSimulator* sim, RVO::ThreadPool* pool, size_t steps) {
+  for (size_t step = 0; step < steps; ++step) {
+    if (pool == NULL) {
+      sim->doStep();
+    } else {
+      sim->doStep(*pool);
+    }
+  }
+}
+
+// Agents reserve their neighbor and ORCA line lists when added, and the
+// per-thread linear program and tree stack scratch is reserved up front, so
+// once the agent kd-tree has been built the steps allocate nothing, however
+// many neighbors the agents meet later on
+void expectWarmStepsDoNotAllocate(RVO::ThreadPool* pool) {
+  RVO::RVOSimulator sim(0.1f, 3.0f, 20, 5.0f, 2.0f, 0.3f, 1.2f, 2.4f, 0.8f);
+  buildScene(&sim);
+  if (pool == NULL) {
+    sim.reserveStepScratch();
+  } else {
+    sim.reserveStepScratch(*pool);
+  }
+  doSteps(&sim, pool, WARM_STEPS);
+
+  size_t before = allocations;
+  counting = true;
+  doSteps(&sim, pool, COUNTED_STEPS);
+  counting = false;
+  EXPECT_EQ(0u, allocations - before);
+}
+}  // namespace
+
+TEST(StepAllocations, SerialStepsDoNotAllocate) {
+  expectWarmStepsDoNotAllocate(NULL);
+}
+
+TEST(StepAllocations, PooledStepsDoNotAllocate) {
+  RVO::ThreadPool pool(4);
+  expectWarmStepsDoNotAllocate(&pool);
+}
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}